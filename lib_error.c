@@ -6,7 +6,7 @@
 extern void    gtkx_warn(int warn, char *buffer);
 
 #ifdef MALLOC_CHECK
-#include "../lib/zmalloc.h"
+#include "zmalloc.h"
 #endif
 
 void _lib_error_report5(ErrorType err, const char *when, const char *where_file, const char *where_func, int where_line)
@@ -1,20 +1,89 @@
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <time.h>
 #include <math.h>
 #include <stdio.h>
+#include "lib_math.h"
+
+// The generator is xorshift128+, seeded through splitmix64. Its entire state
+// is the RandomState struct, so a simulation's position in the random stream
+// can be saved and restored along with the rest of its state. Each thread
+// has its own state, so simulations run in parallel neither share nor race on
+// a stream. The state starts at zero (which xorshift never reaches), and a
+// thread that draws a number without seeding is seeded then from the time and
+// the address of its own state, so no two threads draw the same stream.
+
+static __thread RandomState random_state = {{0, 0}};
+
+static uint64_t splitmix64(uint64_t *x)
+{
+    uint64_t z = (*x += 0x9E3779B97F4A7C15ULL);
+
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return(z ^ (z >> 31));
+}
+
+static void random_seed_thread(void)
+{
+    uint64_t x = ((uint64_t) time(NULL) << 20) ^ (uint64_t) clock() ^ (uint64_t) (uintptr_t) &random_state;
+
+    random_state.s[0] = splitmix64(&x);
+    random_state.s[1] = splitmix64(&x);
+}
+
+static uint64_t random_next(void)
+{
+    uint64_t s1, s0;
+
+    if ((random_state.s[0] | random_state.s[1]) == 0) {
+        random_seed_thread();
+    }
+    s1 = random_state.s[0];
+    s0 = random_state.s[1];
+
+    random_state.s[0] = s0;
+    s1 ^= s1 << 23;
+    random_state.s[1] = s1 ^ s0 ^ (s1 >> 18) ^ (s0 >> 5);
+    return(random_state.s[1] + s0);
+}
+
+static double random_unit(void)
+{
+    // Return a random double >= 0.0, < 1.0 (with 53 bits of precision)
+    return((random_next() >> 11) * (1.0 / 9007199254740992.0));
+}
+
+void random_seed(unsigned long seed)
+{
+    uint64_t x = (uint64_t) seed;
+
+    random_state.s[0] = splitmix64(&x);
+    random_state.s[1] = splitmix64(&x);
+}
 
 void random_initialise()
 {
-    srandom(time(NULL));
+    random_seed((unsigned long) time(NULL));
+}
+
+void random_state_get(RandomState *state)
+{
+    *state = random_state;
+}
+
+void random_state_set(const RandomState *state)
+{
+    random_state = *state;
 }
 
 double random_normal(double mean, double sd)
 {
     /* This generates a random integer with given mean and standard deviation */
 
-    double r1 = random() / (double) RAND_MAX;
-    double r2 = random() / (double) RAND_MAX;
+    double r1 = 1.0 - random_unit(); /* Exclude 0, as we take its log */
+    double r2 = random_unit();
 
     return(mean + sd * sqrt(-2 * log(r1)) * cos(2.0 * M_PI * r2));
 }
@@ -22,12 +91,11 @@ double random_normal(double mean, double sd)
 int random_integer(int min, int max)
 {
     // Return a random integer >= min, < max
-    return((int) (min + random() * ((max - min) / ((double) RAND_MAX+1))));
+    return((int) (min + random_unit() * (max - min)));
 }
 
 double random_uniform(double min, double max)
 {
-    // Return a random double >= min, <= max
-    return(min + random() * ((max - min) / (double) RAND_MAX));
+    // Return a random double >= min, < max
+    return(min + random_unit() * (max - min));
 }
-
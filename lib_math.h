@@ -1,4 +1,19 @@
+#ifndef _lib_math_h_
+
+#define _lib_math_h_
+
+#include <stdint.h>
+
+typedef struct random_state {
+    uint64_t s[2];
+} RandomState;
+
 extern void random_initialise();
+extern void random_seed(unsigned long seed);
+extern void random_state_get(RandomState *state);
+extern void random_state_set(const RandomState *state);
 extern int random_integer(int min, int max);
 extern double random_uniform(double min, double max);
 extern double random_normal(double mean, double sd);
+
+#endif
@@ -0,0 +1,90 @@
+/*******************************************************************************
+
+    File:       lib_thread.c
+    Contents:   Running a function across several threads.
+
+    Public procedures:
+        int  thread_count();
+        void thread_parallel_run(int n, void (*function)(int, void *), void *data);
+        void thread_range(int thread_id, int n, long total, long *start, long *end);
+        int  thread_claim(volatile int *next);
+
+*******************************************************************************/
+
+#include <stdio.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "lib_thread.h"
+
+typedef struct thread_job {
+    int    thread_id;
+    void (*function)(int thread_id, void *data);
+    void  *data;
+} ThreadJob;
+
+/******************************************************************************/
+
+int thread_count()
+{
+    // The number of threads worth running: one per online processor
+
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return((n < 1) ? 1 : ((n > THREAD_MAX) ? THREAD_MAX : (int) n));
+}
+
+static void *thread_job_run(void *arg)
+{
+    ThreadJob *job = (ThreadJob *)arg;
+
+    job->function(job->thread_id, job->data);
+    return(NULL);
+}
+
+void thread_parallel_run(int n, void (*function)(int thread_id, void *data), void *data)
+{
+    pthread_t thread[THREAD_MAX];
+    ThreadJob job[THREAD_MAX];
+    int started[THREAD_MAX];
+    int i;
+
+    n = (n < 1) ? 1 : ((n > THREAD_MAX) ? THREAD_MAX : n);
+
+    for (i = 1; i < n; i++) {
+        job[i].thread_id = i;
+        job[i].function = function;
+        job[i].data = data;
+        started[i] = (pthread_create(&thread[i], NULL, thread_job_run, &job[i]) == 0);
+    }
+    /* The calling thread does the first share of the work, and also the     */
+    /* share of any thread that could not be started:                        */
+    function(0, data);
+    for (i = 1; i < n; i++) {
+        if (started[i]) {
+            pthread_join(thread[i], NULL);
+        }
+        else {
+            function(i, data);
+        }
+    }
+}
+
+void thread_range(int thread_id, int n, long total, long *start, long *end)
+{
+    // Divide items 0..total-1 into n contiguous ranges of (nearly) equal size
+    // and return the range [start, end) for the given thread
+
+    *start = (total * thread_id) / n;
+    *end = (total * (thread_id + 1)) / n;
+}
+
+int thread_claim(volatile int *next)
+{
+    // Atomically take the next item from a shared counter. For work whose
+    // items vary in cost, threads call this until it passes the last item,
+    // rather than each taking a fixed range.
+
+    return(__sync_fetch_and_add(next, 1));
+}
+
+/******************************************************************************/
@@ -0,0 +1,16 @@
+#ifndef _lib_thread_h_
+
+#define _lib_thread_h_
+
+/* A minimal fork/join wrapper around pthreads: thread_parallel_run/3 calls   */
+/* function(thread_id, data) once in each of n threads (thread 0 is the       */
+/* caller) and returns when all have finished.                                */
+
+#define THREAD_MAX 64
+
+extern int  thread_count();
+extern void thread_parallel_run(int n, void (*function)(int thread_id, void *data), void *data);
+extern void thread_range(int thread_id, int n, long total, long *start, long *end);
+extern int  thread_claim(volatile int *next);
+
+#endif
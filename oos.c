@@ -1,6 +1,6 @@
 
 // OOS Interpreter
-// Version 1.2.6
+// Version 1.3.6
 // R. Cooper (c) 29/06/15
 
 // Changes (1.0.1):
@@ -37,16 +37,53 @@
 //   Efficiency tweak: Set trials_per_subject and subjects_per_experiment directly in oos_globals_create/0
 // Changes (1.2.6):
 //   Set VertexStyle and LineStyle in oos_arrow_create
+// Changes (1.2.7):
+//   Separate model structure from model state so a model can be built once and reused
+//   New functions: oos_model_reset/1, oos_buffer_set_decay/4
+// Changes (1.3.0):
+//   Add snapshots of the model state (including the random number generator and task data)
+//   New functions: oos_snapshot_create/1, oos_snapshot_restore/2, oos_snapshot_free/1,
+//   oos_snapshot_write_to_file/2, oos_snapshot_read_from_file/1, oos_globals_clone/1
+// Changes (1.3.1):
+//   Add counters of the work done in the hot paths (matching, unification,
+//   messages, clause allocation, decay), in total and per box
+//   New functions: oos_counters_reset/1, oos_counters_print/2, oos_counters_print_json/2
+// Changes (1.3.2):
+//   Optionally (with OOS_PROFILE) time each process's output and each buffer update phase
+//   New functions: oos_profile_reset/1, oos_profile_print/2
+// Changes (1.3.3):
+//   Optionally write a trace of each cycle in Chrome trace-event format
+//   New functions: oos_trace_open/3, oos_trace_open_from_environment/2, oos_trace_close/1
+// Changes (1.3.4):
+//   Optionally record each cycle's messages and random number generator state,
+//   so that any block of a run can be replayed without its processes
+//   New functions: oos_record_open/2, oos_record_open_from_environment/2, oos_record_close/1,
+//   oos_replay_open/1, oos_replay_blocks/1, oos_replay_block/3, oos_replay_step/2,
+//   oos_replay_mismatches/1, oos_replay_close/1
+// Changes (1.3.5):
+//   Add a bounded history of per-cycle changes, for stepping back through a block
+//   New functions: oos_history_create/1, oos_history_clear/1, oos_history_free/1,
+//   oos_history_step/2, oos_history_back/2, oos_history_goto/3,
+//   oos_history_first_cycle/1, oos_history_last_cycle/1
+// Changes (1.3.6):
+//   Bug fix: oos_snapshot_restore/2 decodes the whole snapshot before changing the
+//   model, so a snapshot that is not valid leaves the model as it was
+//   Efficiency tweak: oos_message_create/5 finds the sending box without a search
+//   when it is the process whose output function is running
 
 /******************************************************************************/
 
 #include <stdio.h>
 #include <glib.h>
 #include <math.h>
+#include <time.h>
 #include "oos.h"
 #include "lib_math.h"
 #include "lib_string.h"
 
+// Define OOS_DUMP_COUNTERS for oos_dump/2 to print the counters with the state:
+#undef OOS_DUMP_COUNTERS
+
 char *oos_class_name[BOX_TYPE_MAX] = {
     "Process", "Buffer"
 };
@@ -267,16 +304,22 @@ char *oos_box_name(OosVars *gv, int id)
 /******************************************************************************/
 /* Initialisation functions: **************************************************/
 
-void oos_messages_free(OosVars *gv)
+static void message_list_free(MessageList *messages)
 {
-    while (gv->messages != NULL) {
-        MessageList *tmp = gv->messages->next;
-        pl_clause_free(gv->messages->content);
-        g_free(gv->messages);
-        gv->messages = tmp;
+    while (messages != NULL) {
+        MessageList *tmp = messages->next;
+        pl_clause_free(messages->content);
+        free(messages);
+        messages = tmp;
     }
 }
 
+void oos_messages_free(OosVars *gv)
+{
+    message_list_free(gv->messages);
+    gv->messages = NULL;
+}
+
 void oos_annotations_free(OosVars *gv)
 {
     while (gv->annotations != NULL) {
@@ -372,6 +415,10 @@ BoxList *oos_process_create(OosVars *gv, char *name, int id, double x, double y,
         new->stopped = FALSE;
         new->output_function = output_function;
         new->content = NULL;
+        memset(&(new->counters), 0, sizeof(OosBoxCounters));
+#ifdef OOS_PROFILE
+        memset(new->profile, 0, OOS_PHASE_MAX * sizeof(OosPhaseProfile));
+#endif
         gv->components = new;
     }
     return(new);
@@ -399,6 +446,10 @@ BoxList *oos_buffer_create(OosVars *gv, char *name, int id, double x, double y,
         new->excess_capacity = excess_capacity;
         new->access = access;
         new->content = NULL;
+        memset(&(new->counters), 0, sizeof(OosBoxCounters));
+#ifdef OOS_PROFILE
+        memset(new->profile, 0, OOS_PHASE_MAX * sizeof(OosPhaseProfile));
+#endif
         gv->components = new;
     }
     return(new);
@@ -416,6 +467,21 @@ void oos_buffer_create_element(OosVars *gv, int box_id, char *element, double ac
     }
 }
 
+Boolean oos_buffer_set_decay(OosVars *gv, int box_id, BufferDecayProp decay, int decay_constant)
+{
+    BoxList *this = oos_locate_box_ptr(gv, box_id);
+
+    if ((this == NULL) || (this->bt != BOX_BUFFER)) {
+        fprintf(stdout, "WARNING: Cannot locate buffer %d in oos_buffer_set_decay\n", box_id);
+        return(FALSE);
+    }
+    else {
+        this->decay = decay;
+        this->decay_constant = decay_constant;
+        return(TRUE);
+    }
+}
+
 /*----------------------------------------------------------------------------*/
 
 OosVars *oos_globals_create()
@@ -432,8 +498,14 @@ OosVars *oos_globals_create()
         gv->annotations = NULL;
         gv->arrows = NULL;
         gv->messages = NULL;
+        gv->sender = NULL;
         gv->trials_per_subject = 1;
         gv->subjects_per_experiment = 1;
+        gv->task_data_save = NULL;
+        gv->task_data_restore = NULL;
+        memset(&(gv->counters), 0, sizeof(OosCounters));
+        gv->trace = NULL;
+        gv->record = NULL;
     }
     random_initialise();
     return(gv);
@@ -442,6 +514,8 @@ OosVars *oos_globals_create()
 void oos_globals_destroy(OosVars *gv)
 {
     if (gv != NULL) {
+        oos_trace_close(gv);
+        oos_record_close(gv);
         g_free(gv->name);
         oos_model_free(gv);
         oos_messages_free(gv);
@@ -452,10 +526,15 @@ void oos_globals_destroy(OosVars *gv)
 
 /*----------------------------------------------------------------------------*/
 
+/* Calls by this thread, attributed to a model by oos_step/1: */
+static __thread long unify_calls = 0;
+
 ClauseType *unify_terms(ClauseType *template, ClauseType *term)
 {
     ClauseType *result = NULL;
 
+    unify_calls++;
+
     /* This implementation of unification is incomplete - it doesn't deal */
     /* correctly with variables that occur more than once in either term. */
 
@@ -594,6 +673,313 @@ void oos_dump(OosVars *gv, Boolean state)
 	}
         fprintf(stdout, "\n");
     }
+#ifdef OOS_DUMP_COUNTERS
+    if (state) {
+        oos_counters_print(stdout, gv);
+    }
+#endif
+}
+
+/*----------------------------------------------------------------------------*/
+
+void oos_counters_reset(OosVars *gv)
+{
+    // The counters accumulate over runs (oos_model_reset/1 leaves them alone)
+    // until they are reset here
+
+    BoxList *tmp;
+
+    memset(&(gv->counters), 0, sizeof(OosCounters));
+    for (tmp = gv->components; tmp != NULL; tmp = tmp->next) {
+        memset(&(tmp->counters), 0, sizeof(OosBoxCounters));
+    }
+}
+
+void oos_counters_print(FILE *fp, OosVars *gv)
+{
+    OosCounters *c = &(gv->counters);
+    BoxList *tmp;
+    int i;
+
+    fprintf(fp, "COUNTERS: %ld cycles in %ld blocks (%.1f per block; max %ld)\n", c->cycles, c->blocks, c->cycles / (double) MAX(c->blocks, 1), c->block_cycles_max);
+    fprintf(fp, "  Unifications: %ld; Clauses allocated: %ld; Clauses freed: %ld; Decay evictions: %ld\n", c->unify_calls, c->clause_allocations, c->clause_frees, c->evictions);
+    fprintf(fp, "  Messages:");
+    for (i = 0; i < MT_MAX; i++) {
+        fprintf(fp, " %s %ld%s", oos_message_type_name[i], c->messages[i], (i < MT_MAX-1) ? ";" : "\n");
+    }
+    for (tmp = gv->components; tmp != NULL; tmp = tmp->next) {
+        OosBoxCounters *b = &(tmp->counters);
+        fprintf(fp, "  %s: Sent %ld", tmp->name ? tmp->name : "Unnamed", b->messages_sent);
+        if (tmp->bt == BOX_BUFFER) {
+            fprintf(fp, "; Matched %ld (hits %ld, %.1f%%); Evicted %ld", b->match_calls, b->match_hits, 100.0 * b->match_hits / (double) MAX(b->match_calls, 1), b->evictions);
+        }
+        fprintf(fp, "\n");
+    }
+}
+
+static void fprint_json_string(FILE *fp, const char *s)
+{
+    fputc('"', fp);
+    for (; (s != NULL) && (*s != '\0'); s++) {
+        if ((*s == '"') || (*s == '\\')) {
+            fputc('\\', fp);
+        }
+        fputc(*s, fp);
+    }
+    fputc('"', fp);
+}
+
+void oos_counters_print_json(FILE *fp, OosVars *gv)
+{
+    OosCounters *c = &(gv->counters);
+    BoxList *tmp;
+    int i;
+
+    fprintf(fp, "{\"cycles\": %ld, \"blocks\": %ld, \"block_cycles_max\": %ld, ", c->cycles, c->blocks, c->block_cycles_max);
+    fprintf(fp, "\"unify_calls\": %ld, \"clause_allocations\": %ld, \"clause_frees\": %ld, \"evictions\": %ld, ", c->unify_calls, c->clause_allocations, c->clause_frees, c->evictions);
+    fprintf(fp, "\"messages\": {");
+    for (i = 0; i < MT_MAX; i++) {
+        fprintf(fp, "%s\"%s\": %ld", (i > 0) ? ", " : "", oos_message_type_name[i], c->messages[i]);
+    }
+    fprintf(fp, "}, \"boxes\": [");
+    for (tmp = gv->components; tmp != NULL; tmp = tmp->next) {
+        OosBoxCounters *b = &(tmp->counters);
+        fprintf(fp, "{\"id\": %d, \"name\": ", tmp->id);
+        fprint_json_string(fp, tmp->name);
+        fprintf(fp, ", \"class\": \"%s\", \"messages_sent\": %ld, \"match_calls\": %ld, \"match_hits\": %ld, \"evictions\": %ld}%s", oos_class_name[(int) tmp->bt], b->messages_sent, b->match_calls, b->match_hits, b->evictions, (tmp->next != NULL) ? ", " : "");
+    }
+    fprintf(fp, "]}\n");
+}
+
+/******************************************************************************/
+/* Profiling: *****************************************************************/
+
+char *oos_profile_phase_name[OOS_PHASE_MAX] = {
+    "Output", "Clear", "Delete", "Add", "Activate", "Decay"
+};
+
+static long oos_clock()
+{
+    // Nanoseconds on the monotonic clock, for profiling and tracing
+
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return(t.tv_sec * 1000000000L + t.tv_nsec);
+}
+
+#ifdef OOS_PROFILE
+
+#define PROFILE(BOX, PHASE, CALL) { long t0 = oos_clock(); CALL; profile_record(&((BOX)->profile[PHASE]), oos_clock() - t0); }
+
+static void profile_record(OosPhaseProfile *profile, long ns)
+{
+    int bucket = 0;
+
+    while ((bucket < OOS_PROFILE_BUCKETS-1) && (ns >= (2L << bucket))) {
+        bucket++;
+    }
+    profile->histogram[bucket]++;
+    profile->calls++;
+    profile->total_ns += ns;
+    profile->max_ns = MAX(profile->max_ns, ns);
+}
+
+static double profile_percentile(OosPhaseProfile *profile, double q)
+{
+    // The upper bound of the histogram bucket holding the q'th quantile, in us
+
+    long target = (long) ceil(q * profile->calls), sum = 0;
+    int i;
+
+    for (i = 0; i < OOS_PROFILE_BUCKETS-1; i++) {
+        if ((sum += profile->histogram[i]) >= target) {
+            break;
+        }
+    }
+    return((2L << i) / 1000.0);
+}
+
+void oos_profile_reset(OosVars *gv)
+{
+    BoxList *tmp;
+
+    for (tmp = gv->components; tmp != NULL; tmp = tmp->next) {
+        memset(tmp->profile, 0, OOS_PHASE_MAX * sizeof(OosPhaseProfile));
+    }
+}
+
+void oos_profile_print(FILE *fp, OosVars *gv)
+{
+    // One line per box and phase that has run, with its share of the total
+    // time profiled, then the phase's histogram (bucket upper bound: count)
+
+    BoxList *tmp;
+    long total = 0;
+    int i, j;
+
+    for (tmp = gv->components; tmp != NULL; tmp = tmp->next) {
+        for (i = 0; i < OOS_PHASE_MAX; i++) {
+            total += tmp->profile[i].total_ns;
+        }
+    }
+    fprintf(fp, "PROFILE: %.3f ms in output functions and buffer updates\n", total / 1e6);
+    fprintf(fp, "  %-24s %-8s %10s %10s %6s %9s %9s %9s %9s\n", "Box", "Phase", "Calls", "Total ms", "Share", "Mean us", "p50 us", "p99 us", "Max us");
+    for (tmp = gv->components; tmp != NULL; tmp = tmp->next) {
+        for (i = 0; i < OOS_PHASE_MAX; i++) {
+            OosPhaseProfile *p = &(tmp->profile[i]);
+            if (p->calls == 0) {
+                continue;
+            }
+            fprintf(fp, "  %-24s %-8s %10ld %10.3f %5.1f%% %9.3f %9.3f %9.3f %9.3f\n", tmp->name ? tmp->name : "Unnamed", oos_profile_phase_name[i], p->calls, p->total_ns / 1e6, 100.0 * p->total_ns / (double) MAX(total, 1), p->total_ns / (1000.0 * p->calls), profile_percentile(p, 0.5), profile_percentile(p, 0.99), p->max_ns / 1000.0);
+            fprintf(fp, "    [");
+            for (j = 0; j < OOS_PROFILE_BUCKETS; j++) {
+                if (p->histogram[j] > 0) {
+                    fprintf(fp, " <%ldns: %ld", 2L << j, p->histogram[j]);
+                }
+            }
+            fprintf(fp, " ]\n");
+        }
+    }
+}
+
+#else
+
+#define PROFILE(BOX, PHASE, CALL) CALL
+
+#endif
+
+/******************************************************************************/
+/* Tracing: *******************************************************************/
+
+// A trace is a JSON array of Chrome trace events (load it in chrome://tracing
+// or ui.perfetto.dev), with a span for each block, each cycle, each process's
+// output function and each buffer's update, and counter tracks for the size of
+// each buffer and the messages of each type created in each cycle. All work is
+// guarded by a test of gv->trace, so when no trace is open it costs nothing
+// but that test. Each model writes its own file; tid distinguishes models
+// whose traces are viewed together.
+
+typedef struct oos_trace {
+    FILE *fp;
+    int   tid;
+    long  origin;           /* oos_clock() when the trace was opened */
+    long  block_start;
+    long  events;
+} OosTrace;
+
+#define TRACE_START(GV)   (((GV)->trace != NULL) ? oos_clock() : 0)
+
+static void oos_trace_event_begin(OosTrace *trace, char ph, const char *name, const char *category, long start)
+{
+    // Start an event, leaving its object open for any further fields
+
+    fprintf(trace->fp, "%s{\"ph\": \"%c\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"name\": ", (trace->events++ > 0) ? ",\n" : "", ph, trace->tid, (start - trace->origin) / 1000.0);
+    fprint_json_string(trace->fp, name);
+    if (category != NULL) {
+        fprintf(trace->fp, ", \"cat\": \"%s\"", category);
+    }
+}
+
+static void oos_trace_span(OosVars *gv, const char *name, const char *category, long start)
+{
+    // A complete ("X") event from start to now
+
+    long now = oos_clock();
+
+    oos_trace_event_begin(gv->trace, 'X', name ? name : "Unnamed", category, start);
+    fprintf(gv->trace->fp, ", \"dur\": %.3f}", (now - start) / 1000.0);
+}
+
+static void oos_trace_cycle(OosVars *gv, long start)
+{
+    // The cycle's span and the counter tracks, sampled at the end of the cycle
+
+    long now = oos_clock();
+    long messages[MT_MAX];
+    MessageList *ml;
+    BoxList *tmp;
+    int i, n = 0;
+
+    oos_trace_event_begin(gv->trace, 'X', "Cycle", "cycle", start);
+    fprintf(gv->trace->fp, ", \"dur\": %.3f, \"args\": {\"block\": %d, \"cycle\": %d}}", (now - start) / 1000.0, gv->block, gv->cycle);
+
+    oos_trace_event_begin(gv->trace, 'C', "Buffer sizes", NULL, now);
+    fprintf(gv->trace->fp, ", \"args\": {");
+    for (tmp = gv->components; tmp != NULL; tmp = tmp->next) {
+        if (tmp->bt == BOX_BUFFER) {
+            fprintf(gv->trace->fp, "%s", (n++ > 0) ? ", " : "");
+            fprint_json_string(gv->trace->fp, tmp->name ? tmp->name : "Unnamed");
+            fprintf(gv->trace->fp, ": %d", timestamped_clause_list_length(tmp->content));
+        }
+    }
+    fprintf(gv->trace->fp, "}}");
+
+    for (i = 0; i < MT_MAX; i++) {
+        messages[i] = 0;
+    }
+    for (ml = gv->messages; ml != NULL; ml = ml->next) {
+        messages[ml->mt]++;
+    }
+    oos_trace_event_begin(gv->trace, 'C', "Messages", NULL, now);
+    fprintf(gv->trace->fp, ", \"args\": {");
+    for (i = 0; i < MT_MAX; i++) {
+        fprintf(gv->trace->fp, "%s\"%s\": %ld", (i > 0) ? ", " : "", oos_message_type_name[i], messages[i]);
+    }
+    fprintf(gv->trace->fp, "}}");
+}
+
+Boolean oos_trace_open(OosVars *gv, const char *filename, int tid)
+{
+    // Start tracing the model to filename (closing any trace already open)
+
+    OosTrace *trace;
+
+    oos_trace_close(gv);
+    if ((trace = (OosTrace *)malloc(sizeof(OosTrace))) == NULL) {
+        return(FALSE);
+    }
+    else if ((trace->fp = fopen(filename, "w")) == NULL) {
+        fprintf(stdout, "WARNING: Cannot open trace file %s\n", filename);
+        free(trace);
+        return(FALSE);
+    }
+    trace->tid = tid;
+    trace->origin = oos_clock();
+    trace->block_start = trace->origin;
+    trace->events = 0;
+    fprintf(trace->fp, "[\n");
+    gv->trace = trace;
+    return(TRUE);
+}
+
+Boolean oos_trace_open_from_environment(OosVars *gv, int tid)
+{
+    // Trace to the file named by OOS_TRACE, if it is set. Where a program has
+    // several models, those with tid > 0 trace to the name followed by .tid
+
+    char *filename, buffer[1024];
+
+    if (((filename = getenv("OOS_TRACE")) == NULL) || (filename[0] == '\0')) {
+        return(FALSE);
+    }
+    else if (tid > 0) {
+        g_snprintf(buffer, 1024, "%s.%d", filename, tid);
+        return(oos_trace_open(gv, buffer, tid));
+    }
+    else {
+        return(oos_trace_open(gv, filename, tid));
+    }
+}
+
+void oos_trace_close(OosVars *gv)
+{
+    if (gv->trace != NULL) {
+        fprintf(gv->trace->fp, "\n]\n");
+        fclose(gv->trace->fp);
+        free(gv->trace);
+        gv->trace = NULL;
+    }
 }
 
 /******************************************************************************/
@@ -607,7 +993,9 @@ Boolean oos_match_above_threshold(OosVars *gv, int id, ClauseType *template, dou
     Boolean match = FALSE;
 
     /* Locate the buffer (for its content and access property): */
-    this = oos_locate_box_ptr(gv, id);
+    if ((this = oos_locate_box_ptr(gv, id)) != NULL) {
+        this->counters.match_calls++;
+    }
 
     /* Get the buffer's content, suitably reordered: */
     if (this != NULL) {
@@ -635,6 +1023,9 @@ Boolean oos_match_above_threshold(OosVars *gv, int id, ClauseType *template, dou
 
     /* Free temporary copy and return the result: */
     timestamped_clause_list_free(buffer_contents);
+    if (match) {
+        this->counters.match_hits++;
+    }
     return(match);
 }
 
@@ -646,7 +1037,16 @@ Boolean oos_match(OosVars *gv, int id, ClauseType *template)
 void oos_message_create(OosVars *gv, MessageType mt, int source, int target, ClauseType *content)
 {
     MessageList *new;
+    BoxList *box;
 
+    // Messages are almost always sent by the process whose output function
+    // is running, so check it before searching the components
+
+    gv->counters.messages[mt]++;
+    box = ((gv->sender != NULL) && (gv->sender->id == source)) ? gv->sender : oos_locate_box_ptr(gv, source);
+    if (box != NULL) {
+        box->counters.messages_sent++;
+    }
     if ((new = (MessageList *)malloc(sizeof(MessageList))) != NULL) {
         new->source = source;
         new->target = target;
@@ -663,7 +1063,13 @@ static void generate_messages(OosVars *gv)
 
     for (tmp = gv->components; tmp != NULL; tmp = tmp->next) {
         if (!tmp->stopped && (tmp->bt == BOX_PROCESS) && (tmp->output_function != NULL)) {
-            tmp->output_function(gv);
+            long start = TRACE_START(gv);
+            gv->sender = tmp;
+            PROFILE(tmp, OOS_PHASE_OUTPUT, tmp->output_function(gv));
+            gv->sender = NULL;
+            if (gv->trace != NULL) {
+                oos_trace_span(gv, tmp->name, "process", start);
+            }
         }
     }
 }
@@ -902,6 +1308,8 @@ static void oos_buffer_apply_decay(OosVars *gv, BoxList *this, BufferDecayProp d
             }
             else {
                 pl_clause_free(before->head);
+                this->counters.evictions++;
+                gv->counters.evictions++;
             }
             tmp = before->tail;
             free(before);
@@ -926,13 +1334,17 @@ static void update_component_state(OosVars *gv, BoxList *this)
 {
     oos_component_process_stop_messages(gv, this);
     if (!this->stopped && (this->bt == BOX_BUFFER)) {
+        long start = TRACE_START(gv);
         // Process all the messages bound for the buffer:
-        oos_buffer_apply_clear_messages(gv, this);
-        oos_buffer_apply_delete_messages(gv, this);
-        oos_buffer_apply_add_messages(gv, this);
-        oos_buffer_apply_activate_messages(gv, this);
+        PROFILE(this, OOS_PHASE_CLEAR, oos_buffer_apply_clear_messages(gv, this));
+        PROFILE(this, OOS_PHASE_DELETE, oos_buffer_apply_delete_messages(gv, this));
+        PROFILE(this, OOS_PHASE_ADD, oos_buffer_apply_add_messages(gv, this));
+        PROFILE(this, OOS_PHASE_ACTIVATE, oos_buffer_apply_activate_messages(gv, this));
         // Now apply decay: 
-        oos_buffer_apply_decay(gv, this, this->decay, this->decay_constant);
+        PROFILE(this, OOS_PHASE_DECAY, oos_buffer_apply_decay(gv, this, this->decay, this->decay_constant));
+        if (gv->trace != NULL) {
+            oos_trace_span(gv, this->name, "buffer", start);
+        }
     }
 }
 
@@ -982,23 +1394,88 @@ TimestampedClauseList  *oos_buffer_get_contents(OosVars *gv, int id)
 
 /*----------------------------------------------------------------------------*/
 
+/* Recording (see below): */
+#define RECORD_BLOCK_START  0
+#define RECORD_CYCLE        1
+#define RECORD_BLOCK_END    2
+
+static void oos_record_block(OosVars *gv, int type);
+static void oos_record_cycle(OosVars *gv);
+
 Boolean oos_step(OosVars *gv)
 {
+    long unify_start = unify_calls;
+    long allocations_start = pl_clause_allocations;
+    long frees_start = pl_clause_frees;
+    long start = TRACE_START(gv);
+
+    if ((gv->trace != NULL) && (gv->cycle == 0)) {
+        gv->trace->block_start = start;
+    }
+    if ((gv->record != NULL) && (gv->cycle == 0)) {
+        oos_record_block(gv, RECORD_BLOCK_START);
+    }
     oos_messages_free(gv);
     gv->cycle++;
     generate_messages(gv);
     oos_model_process_stop_messages(gv);
+    if (gv->record != NULL) {
+        oos_record_cycle(gv);
+    }
     if (!gv->stopped) {
         update_states(gv);
     }
+
+    gv->counters.cycles++;
+    gv->counters.unify_calls += unify_calls - unify_start;
+    gv->counters.clause_allocations += pl_clause_allocations - allocations_start;
+    gv->counters.clause_frees += pl_clause_frees - frees_start;
+    if (gv->trace != NULL) {
+        oos_trace_cycle(gv, start);
+    }
     return(!gv->stopped);
 }
 
 void oos_step_block(OosVars *gv)
 {
+    if (gv->trace != NULL) {
+        char name[32];
+        g_snprintf(name, 32, "Block %d", gv->block);
+        oos_trace_span(gv, name, "block", gv->trace->block_start);
+    }
+    if (gv->record != NULL) {
+        oos_record_block(gv, RECORD_BLOCK_END);
+    }
+    gv->counters.blocks++;
+    gv->counters.block_cycles_max = MAX(gv->counters.block_cycles_max, gv->cycle);
     gv->block++;
     gv->stopped = FALSE;
     oos_component_initialise_states(gv);
+#ifdef MALLOC_CHECK
+    {
+        /* Buffers are now empty, so anything left over from the block leaked: */
+        char label[64];
+        g_snprintf(label, 64, "%s block %d", gv->name ? gv->name : "Model", gv->block);
+        zmalloc_check(stdout, label);
+    }
+#endif
+}
+
+void oos_model_reset(OosVars *gv)
+{
+    // Return the model to its just-created state without rebuilding its
+    // structure: empty all buffers, restart all processes and zero the counters
+
+    BoxList *tmp;
+
+    oos_messages_free(gv);
+    for (tmp = gv->components; tmp != NULL; tmp = tmp->next) {
+        oos_component_initialise_state(gv, tmp);
+        tmp->stopped = FALSE;
+    }
+    gv->cycle = 0;
+    gv->block = 0;
+    gv->stopped = FALSE;
 }
 
 void oos_initialise_trial(OosVars *gv)
@@ -1017,6 +1494,1248 @@ void oos_initialise_session(OosVars *gv, int trials_per_subject, int subjects_pe
     gv->subjects_per_experiment = subjects_per_experiment;
 }
 
+/******************************************************************************/
+/* Snapshot functions: ********************************************************/
+
+// A snapshot is a flat binary image of everything that changes as the model
+// runs. The model's structure (boxes and their output functions) is not saved,
+// so a snapshot can only be restored into a model with the same boxes. Numbers
+// are saved in native byte order: snapshots are not portable between machines.
+
+#define SNAPSHOT_MAGIC    0x534F4F53     /* "SOOS" */
+#define SNAPSHOT_VERSION  1
+
+static Boolean oos_snapshot_reserve(OosSnapshot *snapshot, size_t n)
+{
+    if (snapshot->length + n > snapshot->capacity) {
+        size_t capacity = MAX(2 * snapshot->capacity, snapshot->length + n + 1024);
+        unsigned char *data;
+
+        if ((data = (unsigned char *)realloc(snapshot->data, capacity)) == NULL) {
+            return(FALSE);
+        }
+        snapshot->data = data;
+        snapshot->capacity = capacity;
+    }
+    return(TRUE);
+}
+
+void oos_snapshot_put_bytes(OosSnapshot *snapshot, const void *data, size_t n)
+{
+    if (oos_snapshot_reserve(snapshot, n)) {
+        memcpy(snapshot->data + snapshot->length, data, n);
+        snapshot->length += n;
+    }
+    else {
+        fprintf(stdout, "WARNING: Memory allocation failed when extending snapshot\n");
+    }
+}
+
+void oos_snapshot_put_int(OosSnapshot *snapshot, int i)
+{
+    oos_snapshot_put_bytes(snapshot, &i, sizeof(int));
+}
+
+void oos_snapshot_put_long(OosSnapshot *snapshot, long l)
+{
+    oos_snapshot_put_bytes(snapshot, &l, sizeof(long));
+}
+
+void oos_snapshot_put_double(OosSnapshot *snapshot, double d)
+{
+    oos_snapshot_put_bytes(snapshot, &d, sizeof(double));
+}
+
+static void oos_snapshot_put_string(OosSnapshot *snapshot, const char *string)
+{
+    if (string == NULL) {
+        oos_snapshot_put_int(snapshot, -1);
+    }
+    else {
+        int l = strlen(string);
+        oos_snapshot_put_int(snapshot, l);
+        oos_snapshot_put_bytes(snapshot, string, l);
+    }
+}
+
+static void oos_snapshot_put_clause(OosSnapshot *snapshot, ClauseType *clause)
+{
+    // Mirrors pl_clause_copy/1: every field, then the arguments recursively
+
+    if (clause == NULL) {
+        oos_snapshot_put_int(snapshot, -1);
+    }
+    else {
+        ClauseList *tmp;
+
+        oos_snapshot_put_int(snapshot, (int) pl_clause_type(clause));
+        oos_snapshot_put_int(snapshot, pl_arity(clause));
+        oos_snapshot_put_long(snapshot, pl_integer(clause));
+        oos_snapshot_put_double(snapshot, pl_double(clause));
+        oos_snapshot_put_string(snapshot, pl_functor(clause));
+        oos_snapshot_put_int(snapshot, pl_clause_list_length(pl_arguments(clause)));
+        for (tmp = pl_arguments(clause); tmp != NULL; tmp = tmp->tail) {
+            oos_snapshot_put_clause(snapshot, tmp->head);
+        }
+    }
+}
+
+Boolean oos_snapshot_get_bytes(OosSnapshot *snapshot, void *data, size_t n)
+{
+    if (snapshot->position + n > snapshot->length) {
+        return(FALSE);
+    }
+    else {
+        memcpy(data, snapshot->data + snapshot->position, n);
+        snapshot->position += n;
+        return(TRUE);
+    }
+}
+
+Boolean oos_snapshot_get_int(OosSnapshot *snapshot, int *i)
+{
+    return(oos_snapshot_get_bytes(snapshot, i, sizeof(int)));
+}
+
+Boolean oos_snapshot_get_long(OosSnapshot *snapshot, long *l)
+{
+    return(oos_snapshot_get_bytes(snapshot, l, sizeof(long)));
+}
+
+Boolean oos_snapshot_get_double(OosSnapshot *snapshot, double *d)
+{
+    return(oos_snapshot_get_bytes(snapshot, d, sizeof(double)));
+}
+
+static Boolean oos_snapshot_get_string(OosSnapshot *snapshot, char **string)
+{
+    int l;
+
+    if (!oos_snapshot_get_int(snapshot, &l)) {
+        return(FALSE);
+    }
+    else if (l < 0) {
+        *string = NULL;
+        return(TRUE);
+    }
+    else if ((*string = string_new(l+1)) == NULL) {
+        return(FALSE);
+    }
+    else if (!oos_snapshot_get_bytes(snapshot, *string, l)) {
+        free(*string);
+        *string = NULL;
+        return(FALSE);
+    }
+    else {
+        (*string)[l] = '\0';
+        return(TRUE);
+    }
+}
+
+static Boolean oos_snapshot_get_clause(OosSnapshot *snapshot, ClauseType **result)
+{
+    ClauseType *clause;
+    ClauseList first_arg, *last_arg;
+    int sort, arity, n;
+
+    *result = NULL;
+    if (!oos_snapshot_get_int(snapshot, &sort)) {
+        return(FALSE);
+    }
+    else if (sort < 0) {
+        return(TRUE);
+    }
+    else if ((clause = pl_clause_allocate()) == NULL) {
+        return(FALSE);
+    }
+    pl_clause_type_set(clause, (TypeOfTerm) sort);
+    pl_functor_set(clause, NULL);
+    pl_arguments_set(clause, NULL);
+    if (!(oos_snapshot_get_int(snapshot, &arity) && oos_snapshot_get_long(snapshot, &(clause->number)) && oos_snapshot_get_double(snapshot, &(clause->real)) && oos_snapshot_get_string(snapshot, &(clause->functor)) && oos_snapshot_get_int(snapshot, &n))) {
+        pl_clause_free(clause);
+        return(FALSE);
+    }
+    pl_arity_set(clause, arity);
+
+    last_arg = &first_arg;
+    last_arg->tail = NULL;
+    while (n-- > 0) {
+        if ((last_arg->tail = (ClauseList *) malloc(sizeof(ClauseList))) == NULL) {
+            pl_arguments_set(clause, first_arg.tail);
+            pl_clause_free(clause);
+            return(FALSE);
+        }
+        last_arg = last_arg->tail;
+        last_arg->tail = NULL;
+        if (!oos_snapshot_get_clause(snapshot, &(last_arg->head))) {
+            pl_arguments_set(clause, first_arg.tail);
+            pl_clause_free(clause);
+            return(FALSE);
+        }
+    }
+    pl_arguments_set(clause, first_arg.tail);
+    *result = clause;
+    return(TRUE);
+}
+
+/*----------------------------------------------------------------------------*/
+
+static void oos_snapshot_put_components(OosSnapshot *snapshot, OosVars *gv)
+{
+    TimestampedClauseList *cl;
+    BoxList *tmp;
+    int n = 0;
+
+    for (tmp = gv->components; tmp != NULL; tmp = tmp->next) {
+        n++;
+    }
+    oos_snapshot_put_int(snapshot, n);
+    for (tmp = gv->components; tmp != NULL; tmp = tmp->next) {
+        oos_snapshot_put_int(snapshot, tmp->id);
+        oos_snapshot_put_int(snapshot, tmp->stopped);
+        oos_snapshot_put_int(snapshot, (int) tmp->decay);
+        oos_snapshot_put_int(snapshot, tmp->decay_constant);
+        oos_snapshot_put_int(snapshot, timestamped_clause_list_length(tmp->content));
+        for (cl = tmp->content; cl != NULL; cl = cl->tail) {
+            oos_snapshot_put_long(snapshot, cl->timestamp);
+            oos_snapshot_put_double(snapshot, cl->activation);
+            oos_snapshot_put_clause(snapshot, cl->head);
+        }
+    }
+}
+
+static void oos_snapshot_put_messages(OosSnapshot *snapshot, OosVars *gv)
+{
+    MessageList *ml;
+    int n = 0;
+
+    for (ml = gv->messages; ml != NULL; ml = ml->next) {
+        n++;
+    }
+    oos_snapshot_put_int(snapshot, n);
+    for (ml = gv->messages; ml != NULL; ml = ml->next) {
+        oos_snapshot_put_int(snapshot, ml->source);
+        oos_snapshot_put_int(snapshot, ml->target);
+        oos_snapshot_put_int(snapshot, (int) ml->mt);
+        oos_snapshot_put_clause(snapshot, ml->content);
+    }
+}
+
+typedef struct oos_snapshot_box {
+    BoxList *box;
+    int stopped;
+    int decay;
+    int decay_constant;
+    TimestampedClauseList *content;
+} OosSnapshotBox;
+
+static void oos_snapshot_boxes_free(OosSnapshotBox *boxes, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        timestamped_clause_list_free(boxes[i].content);
+    }
+    free(boxes);
+}
+
+static Boolean oos_snapshot_get_components(OosSnapshot *snapshot, OosVars *gv, OosSnapshotBox **result, int *count)
+{
+    // Decode the components' states into *result (count of them), without
+    // changing the model. FALSE (and nothing to free) if the snapshot is bad.
+
+    OosSnapshotBox *boxes;
+    int n, i;
+
+    if (!oos_snapshot_get_int(snapshot, &n) || (n < 0)) {
+        return(FALSE);
+    }
+    else if ((boxes = (OosSnapshotBox *)malloc(MAX(n, 1) * sizeof(OosSnapshotBox))) == NULL) {
+        return(FALSE);
+    }
+    for (i = 0; i < n; i++) {
+        int id, elements;
+
+        boxes[i].content = NULL;
+        if (!(oos_snapshot_get_int(snapshot, &id) && oos_snapshot_get_int(snapshot, &(boxes[i].stopped)) && oos_snapshot_get_int(snapshot, &(boxes[i].decay)) && oos_snapshot_get_int(snapshot, &(boxes[i].decay_constant)) && oos_snapshot_get_int(snapshot, &elements))) {
+            oos_snapshot_boxes_free(boxes, i + 1);
+            return(FALSE);
+        }
+        else if ((boxes[i].box = oos_locate_box_ptr(gv, id)) == NULL) {
+            fprintf(stdout, "WARNING: Snapshot refers to box %d, which is not in the model\n", id);
+            oos_snapshot_boxes_free(boxes, i + 1);
+            return(FALSE);
+        }
+        while (elements-- > 0) {
+            ClauseType *element;
+            double activation;
+            long timestamp;
+
+            if (!(oos_snapshot_get_long(snapshot, &timestamp) && oos_snapshot_get_double(snapshot, &activation) && oos_snapshot_get_clause(snapshot, &element))) {
+                oos_snapshot_boxes_free(boxes, i + 1);
+                return(FALSE);
+            }
+            boxes[i].content = timestamped_clause_list_add_element_to_tail(boxes[i].content, element, timestamp, activation);
+        }
+    }
+    *result = boxes;
+    *count = n;
+    return(TRUE);
+}
+
+static void oos_snapshot_set_components(OosVars *gv, OosSnapshotBox *boxes, int n)
+{
+    // Install decoded component states. The contents pass to the boxes.
+
+    int i;
+
+    for (i = 0; i < n; i++) {
+        timestamped_clause_list_free(boxes[i].box->content);
+        boxes[i].box->content = boxes[i].content;
+        boxes[i].box->stopped = boxes[i].stopped;
+        boxes[i].box->decay = (BufferDecayProp) boxes[i].decay;
+        boxes[i].box->decay_constant = boxes[i].decay_constant;
+        boxes[i].content = NULL;
+    }
+}
+
+static Boolean oos_snapshot_load_components(OosSnapshot *snapshot, OosVars *gv)
+{
+    OosSnapshotBox *boxes;
+    int n;
+
+    if (!oos_snapshot_get_components(snapshot, gv, &boxes, &n)) {
+        return(FALSE);
+    }
+    oos_snapshot_set_components(gv, boxes, n);
+    oos_snapshot_boxes_free(boxes, n);
+    return(TRUE);
+}
+
+static Boolean oos_snapshot_get_messages(OosSnapshot *snapshot, MessageList **result)
+{
+    // Decode the messages, in their order, into *result. FALSE (and nothing
+    // to free) if the snapshot is bad.
+
+    MessageList *messages = NULL, **last_message = &messages;
+    int n, i;
+
+    if (!oos_snapshot_get_int(snapshot, &n)) {
+        return(FALSE);
+    }
+    for (i = 0; i < n; i++) {
+        MessageList *new;
+        int mt;
+
+        if ((new = (MessageList *)malloc(sizeof(MessageList))) == NULL) {
+            break;
+        }
+        new->next = NULL;
+        *last_message = new;
+        last_message = &(new->next);
+        if (!(oos_snapshot_get_int(snapshot, &(new->source)) && oos_snapshot_get_int(snapshot, &(new->target)) && oos_snapshot_get_int(snapshot, &mt) && oos_snapshot_get_clause(snapshot, &(new->content)))) {
+            new->content = NULL;
+            break;
+        }
+        new->mt = (MessageType) mt;
+    }
+    if (i < n) {
+        message_list_free(messages);
+        return(FALSE);
+    }
+    *result = messages;
+    return(TRUE);
+}
+
+static Boolean oos_snapshot_load_messages(OosSnapshot *snapshot, OosVars *gv)
+{
+    // Replace the model's messages with those in the snapshot
+
+    MessageList *messages;
+
+    if (!oos_snapshot_get_messages(snapshot, &messages)) {
+        return(FALSE);
+    }
+    oos_messages_free(gv);
+    gv->messages = messages;
+    return(TRUE);
+}
+
+/*----------------------------------------------------------------------------*/
+
+OosSnapshot *oos_snapshot_create(OosVars *gv)
+{
+    OosSnapshot *snapshot;
+    RandomState rs;
+
+    if ((snapshot = (OosSnapshot *)malloc(sizeof(OosSnapshot))) == NULL) {
+        return(NULL);
+    }
+    snapshot->data = NULL;
+    snapshot->length = 0;
+    snapshot->capacity = 0;
+    snapshot->position = 0;
+
+    oos_snapshot_put_int(snapshot, SNAPSHOT_MAGIC);
+    oos_snapshot_put_int(snapshot, SNAPSHOT_VERSION);
+
+    /* Counters and the random number generator: */
+    oos_snapshot_put_int(snapshot, gv->cycle);
+    oos_snapshot_put_int(snapshot, gv->block);
+    oos_snapshot_put_int(snapshot, gv->trials_per_subject);
+    oos_snapshot_put_int(snapshot, gv->subjects_per_experiment);
+    oos_snapshot_put_int(snapshot, gv->stopped);
+    random_state_get(&rs);
+    oos_snapshot_put_bytes(snapshot, &rs, sizeof(RandomState));
+
+    /* Components and (for buffers) their contents: */
+    oos_snapshot_put_components(snapshot, gv);
+
+    /* Messages from the most recent cycle: */
+    oos_snapshot_put_messages(snapshot, gv);
+
+    /* Task specific data: */
+    oos_snapshot_put_int(snapshot, gv->task_data_save != NULL);
+    if (gv->task_data_save != NULL) {
+        gv->task_data_save(gv, snapshot);
+    }
+    return(snapshot);
+}
+
+Boolean oos_snapshot_restore(OosVars *gv, OosSnapshot *snapshot)
+{
+    // The whole snapshot is decoded before anything is changed, so if it is
+    // not valid the model is left as it was. (The task's restore function
+    // must do the same.)
+
+    int magic, version, cycle, block, trials, subjects, stopped, task, n;
+    OosSnapshotBox *boxes;
+    MessageList *messages;
+    RandomState rs;
+
+    snapshot->position = 0;
+    if (!(oos_snapshot_get_int(snapshot, &magic) && oos_snapshot_get_int(snapshot, &version))) {
+        return(FALSE);
+    }
+    else if ((magic != SNAPSHOT_MAGIC) || (version != SNAPSHOT_VERSION)) {
+        fprintf(stdout, "WARNING: Not an OOS snapshot (or wrong version) in %s\n", __FUNCTION__);
+        return(FALSE);
+    }
+    if (!(oos_snapshot_get_int(snapshot, &cycle) && oos_snapshot_get_int(snapshot, &block) && oos_snapshot_get_int(snapshot, &trials) && oos_snapshot_get_int(snapshot, &subjects) && oos_snapshot_get_int(snapshot, &stopped) && oos_snapshot_get_bytes(snapshot, &rs, sizeof(RandomState)))) {
+        return(FALSE);
+    }
+    else if (!oos_snapshot_get_components(snapshot, gv, &boxes, &n)) {
+        return(FALSE);
+    }
+    else if (!oos_snapshot_get_messages(snapshot, &messages)) {
+        oos_snapshot_boxes_free(boxes, n);
+        return(FALSE);
+    }
+    else if (!oos_snapshot_get_int(snapshot, &task) || (task && (gv->task_data_restore != NULL) && !gv->task_data_restore(gv, snapshot))) {
+        oos_snapshot_boxes_free(boxes, n);
+        message_list_free(messages);
+        return(FALSE);
+    }
+
+    gv->cycle = cycle;
+    gv->block = block;
+    gv->trials_per_subject = trials;
+    gv->subjects_per_experiment = subjects;
+    gv->stopped = stopped;
+    random_state_set(&rs);
+    oos_snapshot_set_components(gv, boxes, n);
+    oos_snapshot_boxes_free(boxes, n);
+    oos_messages_free(gv);
+    gv->messages = messages;
+    return(TRUE);
+}
+
+void oos_snapshot_free(OosSnapshot *snapshot)
+{
+    if (snapshot != NULL) {
+        free(snapshot->data);
+        free(snapshot);
+    }
+}
+
+Boolean oos_snapshot_write_to_file(OosSnapshot *snapshot, const char *filename)
+{
+    // Write to a temporary file and then rename it, so that if we crash part
+    // way through an existing snapshot (e.g. a checkpoint) is not corrupted
+
+    char tmp_file[1024];
+    FILE *fp;
+
+    g_snprintf(tmp_file, 1024, "%s.tmp", filename);
+    if ((fp = fopen(tmp_file, "wb")) == NULL) {
+        return(FALSE);
+    }
+    else if (fwrite(snapshot->data, 1, snapshot->length, fp) != snapshot->length) {
+        fclose(fp);
+        remove(tmp_file);
+        return(FALSE);
+    }
+    else if (fclose(fp) != 0) {
+        remove(tmp_file);
+        return(FALSE);
+    }
+    else {
+        return(rename(tmp_file, filename) == 0);
+    }
+}
+
+OosSnapshot *oos_snapshot_read_from_file(const char *filename)
+{
+    OosSnapshot *snapshot;
+    FILE *fp;
+    long l;
+
+    if ((fp = fopen(filename, "rb")) == NULL) {
+        return(NULL);
+    }
+    else if ((snapshot = (OosSnapshot *)malloc(sizeof(OosSnapshot))) == NULL) {
+        fclose(fp);
+        return(NULL);
+    }
+    fseek(fp, 0, SEEK_END);
+    l = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    snapshot->length = 0;
+    snapshot->position = 0;
+    snapshot->capacity = (l > 0) ? l : 1;
+    if ((snapshot->data = (unsigned char *)malloc(snapshot->capacity)) == NULL) {
+        free(snapshot);
+        snapshot = NULL;
+    }
+    else {
+        snapshot->length = fread(snapshot->data, 1, l, fp);
+    }
+    fclose(fp);
+    return(snapshot);
+}
+
+/*----------------------------------------------------------------------------*/
+
+OosVars *oos_globals_clone(OosVars *gv)
+{
+    // Create an independent copy of a model (without its diagram) in the same
+    // state as the original, e.g. to fork several continuations from a single
+    // warmed-up state. Note that the copy shares the random number generator
+    // position of the original, so reseed between forks if they should differ.
+
+    OosSnapshot *snapshot;
+    RandomState rs;
+    OosVars *copy;
+    BoxList *tmp, *reversed = NULL;
+
+    random_state_get(&rs);
+    if ((copy = oos_globals_create()) == NULL) {
+        return(NULL);
+    }
+    random_state_set(&rs);
+
+    copy->name = string_copy(gv->name);
+    copy->task_data_save = gv->task_data_save;
+    copy->task_data_restore = gv->task_data_restore;
+
+    /* Components are prepended when created, so create them in reverse order: */
+    for (tmp = gv->components; tmp != NULL; tmp = tmp->next) {
+        BoxList *link = (BoxList *)malloc(sizeof(BoxList));
+        if (link != NULL) {
+            *link = *tmp;
+            link->next = reversed;
+            reversed = link;
+        }
+    }
+    while (reversed != NULL) {
+        BoxList *next = reversed->next;
+        if (reversed->bt == BOX_PROCESS) {
+            oos_process_create(copy, reversed->name, reversed->id, reversed->x, reversed->y, reversed->output_function);
+        }
+        else {
+            oos_buffer_create(copy, reversed->name, reversed->id, reversed->x, reversed->y, reversed->decay, reversed->decay_constant, reversed->capacity, reversed->capacity_constant, reversed->excess_capacity, reversed->access);
+        }
+        free(reversed);
+        reversed = next;
+    }
+
+    if ((snapshot = oos_snapshot_create(gv)) == NULL) {
+        oos_globals_destroy(copy);
+        return(NULL);
+    }
+    else if (!oos_snapshot_restore(copy, snapshot)) {
+        oos_snapshot_free(snapshot);
+        oos_globals_destroy(copy);
+        return(NULL);
+    }
+    oos_snapshot_free(snapshot);
+    return(copy);
+}
+
+/******************************************************************************/
+/* Record and replay: *********************************************************/
+
+// A recording holds, for each cycle, the messages generated and the state of
+// the random number generator once they were generated. That is all that is
+// needed to rerun the cycle's buffer updates (decay and random overflow draw
+// random numbers), so a block can be replayed from its initial buffer contents
+// without calling any process's output function. Each block's buffer contents
+// are also recorded at its end, so a replay can check that it reached the same
+// state. Task data is not recorded: a replay shows the model, not the task.
+//
+// The file is a header (magic number and version) followed by records, each
+// of them a type, a length and that many bytes in the snapshot encoding.
+
+#define RECORD_MAGIC        0x524F4F53     /* "SOOR" */
+#define RECORD_VERSION      1
+
+typedef struct oos_record {
+    FILE        *fp;
+    OosSnapshot  buffer;    /* The record being built */
+} OosRecord;
+
+struct oos_replay {
+    OosSnapshot *data;
+    size_t      *block;     /* Offset of each BLOCK_START record */
+    int          blocks;
+    size_t       position;  /* Offset of the next record to replay */
+    int          mismatches;
+};
+
+static void oos_record_write(OosVars *gv, int type)
+{
+    OosRecord *record = gv->record;
+    int header[2];
+
+    header[0] = type;
+    header[1] = (int) record->buffer.length;
+    fwrite(header, sizeof(int), 2, record->fp);
+    fwrite(record->buffer.data, 1, record->buffer.length, record->fp);
+    record->buffer.length = 0;
+}
+
+static void oos_record_block(OosVars *gv, int type)
+{
+    oos_snapshot_put_int(&(gv->record->buffer), gv->block);
+    oos_snapshot_put_int(&(gv->record->buffer), gv->cycle);
+    oos_snapshot_put_components(&(gv->record->buffer), gv);
+    oos_record_write(gv, type);
+}
+
+static void oos_record_cycle(OosVars *gv)
+{
+    RandomState rs;
+
+    random_state_get(&rs);
+    oos_snapshot_put_int(&(gv->record->buffer), gv->cycle);
+    oos_snapshot_put_bytes(&(gv->record->buffer), &rs, sizeof(RandomState));
+    oos_snapshot_put_messages(&(gv->record->buffer), gv);
+    oos_record_write(gv, RECORD_CYCLE);
+}
+
+Boolean oos_record_open(OosVars *gv, const char *filename)
+{
+    // Start recording the model to filename (closing any recording already
+    // open). Recording starts properly with the next block.
+
+    OosRecord *record;
+    int header[2];
+
+    oos_record_close(gv);
+    if ((record = (OosRecord *)malloc(sizeof(OosRecord))) == NULL) {
+        return(FALSE);
+    }
+    else if ((record->fp = fopen(filename, "wb")) == NULL) {
+        fprintf(stdout, "WARNING: Cannot open record file %s\n", filename);
+        free(record);
+        return(FALSE);
+    }
+    record->buffer.data = NULL;
+    record->buffer.length = 0;
+    record->buffer.capacity = 0;
+    record->buffer.position = 0;
+    header[0] = RECORD_MAGIC;
+    header[1] = RECORD_VERSION;
+    fwrite(header, sizeof(int), 2, record->fp);
+    gv->record = record;
+    return(TRUE);
+}
+
+Boolean oos_record_open_from_environment(OosVars *gv, int tid)
+{
+    // Record to the file named by OOS_RECORD, if it is set. As with traces,
+    // models with tid > 0 record to the name followed by .tid
+
+    char *filename, buffer[1024];
+
+    if (((filename = getenv("OOS_RECORD")) == NULL) || (filename[0] == '\0')) {
+        return(FALSE);
+    }
+    else if (tid > 0) {
+        g_snprintf(buffer, 1024, "%s.%d", filename, tid);
+        return(oos_record_open(gv, buffer));
+    }
+    else {
+        return(oos_record_open(gv, filename));
+    }
+}
+
+void oos_record_close(OosVars *gv)
+{
+    if (gv->record != NULL) {
+        fclose(gv->record->fp);
+        free(gv->record->buffer.data);
+        free(gv->record);
+        gv->record = NULL;
+    }
+}
+
+/*----------------------------------------------------------------------------*/
+
+static Boolean oos_replay_next(OosReplay *replay, int *type, OosSnapshot *view)
+{
+    // Point view at the body of the next record, if there is one
+
+    int header[2];
+
+    if (replay->position + 2 * sizeof(int) > replay->data->length) {
+        return(FALSE);
+    }
+    memcpy(header, replay->data->data + replay->position, 2 * sizeof(int));
+    if ((header[1] < 0) || (replay->position + 2 * sizeof(int) + header[1] > replay->data->length)) {
+        return(FALSE);
+    }
+    *type = header[0];
+    view->data = replay->data->data + replay->position + 2 * sizeof(int);
+    view->length = header[1];
+    view->capacity = header[1];
+    view->position = 0;
+    replay->position += 2 * sizeof(int) + header[1];
+    return(TRUE);
+}
+
+OosReplay *oos_replay_open(const char *filename)
+{
+    // Read a recording and index its blocks. A recording cut short (e.g. by
+    // a crash) is usable up to its last complete record.
+
+    OosReplay *replay;
+    OosSnapshot view;
+    int magic, version, type;
+
+    if ((replay = (OosReplay *)malloc(sizeof(OosReplay))) == NULL) {
+        return(NULL);
+    }
+    else if ((replay->data = oos_snapshot_read_from_file(filename)) == NULL) {
+        fprintf(stdout, "WARNING: Cannot read record file %s\n", filename);
+        free(replay);
+        return(NULL);
+    }
+    else if (!(oos_snapshot_get_int(replay->data, &magic) && oos_snapshot_get_int(replay->data, &version)) || (magic != RECORD_MAGIC) || (version != RECORD_VERSION)) {
+        fprintf(stdout, "WARNING: %s is not an OOS recording (or is from an incompatible version)\n", filename);
+        oos_snapshot_free(replay->data);
+        free(replay);
+        return(NULL);
+    }
+    replay->block = NULL;
+    replay->blocks = 0;
+    replay->mismatches = 0;
+    replay->position = replay->data->position;
+    while (oos_replay_next(replay, &type, &view)) {
+        if (type == RECORD_BLOCK_START) {
+            size_t *block;
+            if ((block = (size_t *)realloc(replay->block, (replay->blocks + 1) * sizeof(size_t))) == NULL) {
+                break;
+            }
+            replay->block = block;
+            replay->block[replay->blocks++] = replay->position - 2 * sizeof(int) - view.length;
+        }
+    }
+    if (replay->position < replay->data->length) {
+        fprintf(stdout, "WARNING: %s is truncated; replaying its first %d blocks\n", filename, replay->blocks);
+    }
+    replay->position = (replay->blocks > 0) ? replay->block[0] : replay->data->length;
+    return(replay);
+}
+
+int oos_replay_blocks(OosReplay *replay)
+{
+    return(replay->blocks);
+}
+
+int oos_replay_mismatches(OosReplay *replay)
+{
+    return(replay->mismatches);
+}
+
+Boolean oos_replay_block(OosVars *gv, OosReplay *replay, int k)
+{
+    // Put the model (which must have the structure of the one recorded) into
+    // the state it was in at the start of the kth block of the recording
+
+    OosSnapshot view;
+    int type, block, cycle;
+
+    if ((k < 0) || (k >= replay->blocks)) {
+        return(FALSE);
+    }
+    replay->position = replay->block[k];
+    if (!(oos_replay_next(replay, &type, &view) && oos_snapshot_get_int(&view, &block) && oos_snapshot_get_int(&view, &cycle) && oos_snapshot_load_components(&view, gv))) {
+        return(FALSE);
+    }
+    oos_messages_free(gv);
+    gv->block = block;
+    gv->cycle = cycle;
+    gv->stopped = FALSE;
+    return(TRUE);
+}
+
+Boolean oos_replay_step(OosVars *gv, OosReplay *replay)
+{
+    // The replay equivalent of oos_step/1, but FALSE only once the block is
+    // over. At the end of the block the buffers are checked against those
+    // recorded, and any difference is reported and counted as a mismatch.
+
+    OosSnapshot view, current;
+    RandomState rs;
+    int type, block, cycle;
+
+    if (!oos_replay_next(replay, &type, &view)) {
+        return(FALSE);
+    }
+    else if (type == RECORD_CYCLE) {
+        if (!(oos_snapshot_get_int(&view, &cycle) && oos_snapshot_get_bytes(&view, &rs, sizeof(RandomState)) && oos_snapshot_load_messages(&view, gv))) {
+            fprintf(stdout, "WARNING: Corrupt record in block %d, cycle %d\n", gv->block, gv->cycle + 1);
+            return(FALSE);
+        }
+        gv->cycle = cycle;
+        oos_model_process_stop_messages(gv);
+        random_state_set(&rs);
+        if (!gv->stopped) {
+            update_states(gv);
+        }
+        return(TRUE);
+    }
+    else if (type == RECORD_BLOCK_END) {
+        current.data = NULL;
+        current.length = 0;
+        current.capacity = 0;
+        current.position = 0;
+        oos_snapshot_put_components(&current, gv);
+        if (!(oos_snapshot_get_int(&view, &block) && oos_snapshot_get_int(&view, &cycle))) {
+            fprintf(stdout, "WARNING: Corrupt record at the end of block %d\n", gv->block);
+            replay->mismatches++;
+        }
+        else if ((cycle != gv->cycle) || (current.length != view.length - view.position) || (memcmp(current.data, view.data + view.position, current.length) != 0)) {
+            fprintf(stdout, "WARNING: Replay of block %d diverges from the recording (cycle %d; recorded cycle %d)\n", block, gv->cycle, cycle);
+            replay->mismatches++;
+        }
+        free(current.data);
+        return(FALSE);
+    }
+    else {
+        /* The next block started without this one ending (not recorded): */
+        replay->position -= 2 * sizeof(int) + view.length;
+        return(FALSE);
+    }
+}
+
+void oos_replay_close(OosReplay *replay)
+{
+    if (replay != NULL) {
+        oos_snapshot_free(replay->data);
+        free(replay->block);
+        free(replay);
+    }
+}
+
+/******************************************************************************/
+/* History: *******************************************************************/
+
+// A history holds the last few cycles of a block so that a browser can step
+// backwards and forwards through them without rerunning the model. Each frame
+// holds the cycle's messages and, for each buffer whose contents changed, the
+// change: the elements removed and added after those that were unchanged at
+// the start of the buffer, and before those that were unchanged at the end.
+// Adding or deleting an element is then a single small delta. Frames are kept
+// in a ring of window cycles, so memory is bounded however long the block.
+//
+// Stepping back undoes deltas in the model itself, and stepping forward again
+// (with oos_history_step/2) redoes them until the newest frame is reached,
+// after which the model runs as normal. Task data and the random number
+// generator are never rewound, but neither is changed while moving through
+// the history, so a model returned to the newest frame continues exactly as
+// it would have. If the model is changed by other means (reset, run or moved
+// to the next block) the history is discarded on its next use.
+
+typedef struct oos_history_delta {
+    int id;
+    int prefix;                         /* Unchanged elements at the start */
+    TimestampedClauseList *removed;
+    TimestampedClauseList *added;
+    struct oos_history_delta *next;
+} OosHistoryDelta;
+
+typedef struct oos_history_frame {
+    int block;
+    int cycle;
+    Boolean stopped;
+    MessageList *messages;
+    OosHistoryDelta *deltas;            /* From the previous frame to this one */
+} OosHistoryFrame;
+
+struct oos_history {
+    OosHistoryFrame *frame;
+    int window;
+    int first;                          /* Position of the oldest frame in the ring */
+    int frames;
+    int current;                        /* The frame the model is in (0 = oldest) */
+    long cycles;                        /* gv->counters.cycles at the newest frame */
+};
+
+#define HISTORY_FRAME(H, I)    (&((H)->frame[((H)->first + (I)) % (H)->window]))
+
+static MessageList *message_list_copy(MessageList *messages)
+{
+    MessageList *copy = NULL, **last = &copy;
+
+    for (; messages != NULL; messages = messages->next) {
+        if ((*last = (MessageList *)malloc(sizeof(MessageList))) == NULL) {
+            break;
+        }
+        **last = *messages;
+        (*last)->content = pl_clause_copy(messages->content);
+        (*last)->next = NULL;
+        last = &((*last)->next);
+    }
+    return(copy);
+}
+
+static Boolean timestamped_clause_equal(TimestampedClauseList *a, TimestampedClauseList *b)
+{
+    return((a->timestamp == b->timestamp) && (a->activation == b->activation) && pl_clause_compare(a->head, b->head));
+}
+
+static TimestampedClauseList *timestamped_clause_list_splice(TimestampedClauseList *list, int prefix, int remove, TimestampedClauseList *insert)
+{
+    // Replace remove elements after the first prefix with a copy of insert
+
+    TimestampedClauseList **link = &list, *tmp;
+
+    while ((prefix-- > 0) && (*link != NULL)) {
+        link = &((*link)->tail);
+    }
+    while ((remove-- > 0) && (*link != NULL)) {
+        tmp = *link;
+        *link = tmp->tail;
+        tmp->tail = NULL;
+        timestamped_clause_list_free(tmp);
+    }
+    if ((tmp = timestamped_clause_list_copy(insert)) != NULL) {
+        TimestampedClauseList *last = tmp;
+        while (last->tail != NULL) {
+            last = last->tail;
+        }
+        last->tail = *link;
+        *link = tmp;
+    }
+    return(list);
+}
+
+static OosHistoryDelta *oos_history_delta_create(int id, TimestampedClauseList *old, TimestampedClauseList *new)
+{
+    // The change from old to new, or NULL if there is none. old is consumed.
+
+    TimestampedClauseList **a, **b, *tmp;
+    OosHistoryDelta *delta;
+    int n, m, i, prefix = 0, suffix = 0;
+
+    n = timestamped_clause_list_length(old);
+    m = timestamped_clause_list_length(new);
+    a = (TimestampedClauseList **)malloc((n + 1) * sizeof(TimestampedClauseList *));
+    b = (TimestampedClauseList **)malloc((m + 1) * sizeof(TimestampedClauseList *));
+    if ((a == NULL) || (b == NULL) || ((delta = (OosHistoryDelta *)malloc(sizeof(OosHistoryDelta))) == NULL)) {
+        free(a);
+        free(b);
+        timestamped_clause_list_free(old);
+        return(NULL);
+    }
+    for (i = 0, tmp = old; tmp != NULL; tmp = tmp->tail) {
+        a[i++] = tmp;
+    }
+    for (i = 0, tmp = new; tmp != NULL; tmp = tmp->tail) {
+        b[i++] = tmp;
+    }
+    while ((prefix < MIN(n, m)) && timestamped_clause_equal(a[prefix], b[prefix])) {
+        prefix++;
+    }
+    while ((prefix + suffix < MIN(n, m)) && timestamped_clause_equal(a[n - suffix - 1], b[m - suffix - 1])) {
+        suffix++;
+    }
+
+    if ((prefix == n) && (prefix == m)) {
+        free(delta);
+        delta = NULL;
+    }
+    else {
+        /* The removed elements are cut from old, the added copied from new: */
+        delta->id = id;
+        delta->prefix = prefix;
+        delta->next = NULL;
+        delta->removed = NULL;
+        if (n - suffix > prefix) {
+            delta->removed = a[prefix];
+            a[n - suffix - 1]->tail = NULL;
+            if (prefix > 0) {
+                a[prefix - 1]->tail = (suffix > 0) ? a[n - suffix] : NULL;
+            }
+            else {
+                old = (suffix > 0) ? a[n - suffix] : NULL;
+            }
+        }
+        delta->added = NULL;
+        if (m - suffix > prefix) {
+            tmp = b[m - suffix - 1]->tail;
+            b[m - suffix - 1]->tail = NULL;
+            delta->added = timestamped_clause_list_copy(b[prefix]);
+            b[m - suffix - 1]->tail = tmp;
+        }
+    }
+    timestamped_clause_list_free(old);
+    free(a);
+    free(b);
+    return(delta);
+}
+
+static void oos_history_frame_deltas_free(OosHistoryFrame *frame)
+{
+    while (frame->deltas != NULL) {
+        OosHistoryDelta *next = frame->deltas->next;
+        timestamped_clause_list_free(frame->deltas->removed);
+        timestamped_clause_list_free(frame->deltas->added);
+        free(frame->deltas);
+        frame->deltas = next;
+    }
+}
+
+static OosHistoryFrame *oos_history_frame_push(OosVars *gv, OosHistory *history)
+{
+    // A new newest frame for the model's current state, without deltas. The
+    // oldest frame is dropped if the ring is full, and the deltas of the one
+    // that replaces it are freed, as it is now the oldest and can't be undone.
+
+    OosHistoryFrame *frame;
+
+    if (history->frames == history->window) {
+        frame = HISTORY_FRAME(history, 0);
+        message_list_free(frame->messages);
+        oos_history_frame_deltas_free(frame);
+        history->first = (history->first + 1) % history->window;
+        history->frames--;
+        oos_history_frame_deltas_free(HISTORY_FRAME(history, 0));
+    }
+    frame = HISTORY_FRAME(history, history->frames);
+    frame->block = gv->block;
+    frame->cycle = gv->cycle;
+    frame->stopped = gv->stopped;
+    frame->messages = message_list_copy(gv->messages);
+    frame->deltas = NULL;
+    history->current = history->frames++;
+    history->cycles = gv->counters.cycles;
+    return(frame);
+}
+
+static void oos_history_frame_show(OosVars *gv, OosHistoryFrame *frame)
+{
+    gv->block = frame->block;
+    gv->cycle = frame->cycle;
+    gv->stopped = frame->stopped;
+    oos_messages_free(gv);
+    gv->messages = message_list_copy(frame->messages);
+}
+
+static void oos_history_undo(OosVars *gv, OosHistory *history)
+{
+    // Move the model from the current frame to the one before
+
+    OosHistoryDelta *delta;
+    BoxList *this;
+
+    for (delta = HISTORY_FRAME(history, history->current)->deltas; delta != NULL; delta = delta->next) {
+        if ((this = oos_locate_box_ptr(gv, delta->id)) != NULL) {
+            this->content = timestamped_clause_list_splice(this->content, delta->prefix, timestamped_clause_list_length(delta->added), delta->removed);
+        }
+    }
+    history->current--;
+    oos_history_frame_show(gv, HISTORY_FRAME(history, history->current));
+}
+
+static void oos_history_redo(OosVars *gv, OosHistory *history)
+{
+    // Move the model from the current frame to the one after
+
+    OosHistoryDelta *delta;
+    BoxList *this;
+
+    history->current++;
+    for (delta = HISTORY_FRAME(history, history->current)->deltas; delta != NULL; delta = delta->next) {
+        if ((this = oos_locate_box_ptr(gv, delta->id)) != NULL) {
+            this->content = timestamped_clause_list_splice(this->content, delta->prefix, timestamped_clause_list_length(delta->removed), delta->added);
+        }
+    }
+    oos_history_frame_show(gv, HISTORY_FRAME(history, history->current));
+}
+
+static Boolean oos_history_valid(OosVars *gv, OosHistory *history)
+{
+    // Discard the history if the model has moved on without it
+
+    OosHistoryFrame *frame;
+
+    if (history->frames > 0) {
+        frame = HISTORY_FRAME(history, history->current);
+        if ((frame->block != gv->block) || (frame->cycle != gv->cycle) || (history->cycles != gv->counters.cycles)) {
+            oos_history_clear(history);
+        }
+    }
+    return(history->frames > 0);
+}
+
+/*----------------------------------------------------------------------------*/
+
+OosHistory *oos_history_create(int window)
+{
+    // A history of (at most) the last window cycles
+
+    OosHistory *history;
+
+    if ((history = (OosHistory *)malloc(sizeof(OosHistory))) == NULL) {
+        return(NULL);
+    }
+    history->window = MAX(window, 2);
+    if ((history->frame = (OosHistoryFrame *)calloc(history->window, sizeof(OosHistoryFrame))) == NULL) {
+        free(history);
+        return(NULL);
+    }
+    history->first = 0;
+    history->frames = 0;
+    history->current = 0;
+    history->cycles = 0;
+    return(history);
+}
+
+void oos_history_clear(OosHistory *history)
+{
+    int i;
+
+    for (i = 0; i < history->frames; i++) {
+        OosHistoryFrame *frame = HISTORY_FRAME(history, i);
+        message_list_free(frame->messages);
+        frame->messages = NULL;
+        oos_history_frame_deltas_free(frame);
+    }
+    history->first = 0;
+    history->frames = 0;
+    history->current = 0;
+}
+
+void oos_history_free(OosHistory *history)
+{
+    if (history != NULL) {
+        oos_history_clear(history);
+        free(history->frame);
+        free(history);
+    }
+}
+
+Boolean oos_history_step(OosVars *gv, OosHistory *history)
+{
+    // As oos_step/1, but if the model has been stepped back the next frame of
+    // the history is redone instead, and otherwise the cycle is recorded
+
+    TimestampedClauseList **before;
+    OosHistoryFrame *frame;
+    OosHistoryDelta *delta, **last;
+    BoxList *tmp;
+    Boolean result;
+    int i, n = 0;
+
+    if (oos_history_valid(gv, history) && (history->current < history->frames - 1)) {
+        oos_history_redo(gv, history);
+        return(!gv->stopped);
+    }
+    else if (history->frames == 0) {
+        oos_history_frame_push(gv, history);
+    }
+
+    for (tmp = gv->components; tmp != NULL; tmp = tmp->next) {
+        n++;
+    }
+    if ((before = (TimestampedClauseList **)malloc((n + 1) * sizeof(TimestampedClauseList *))) == NULL) {
+        oos_history_clear(history);
+        return(oos_step(gv));
+    }
+    for (i = 0, tmp = gv->components; tmp != NULL; tmp = tmp->next, i++) {
+        before[i] = (tmp->bt == BOX_BUFFER) ? timestamped_clause_list_copy(tmp->content) : NULL;
+    }
+
+    result = oos_step(gv);
+
+    frame = oos_history_frame_push(gv, history);
+    last = &(frame->deltas);
+    for (i = 0, tmp = gv->components; tmp != NULL; tmp = tmp->next, i++) {
+        if ((tmp->bt == BOX_BUFFER) && ((delta = oos_history_delta_create(tmp->id, before[i], tmp->content)) != NULL)) {
+            *last = delta;
+            last = &(delta->next);
+        }
+    }
+    free(before);
+    return(result);
+}
+
+Boolean oos_history_back(OosVars *gv, OosHistory *history)
+{
+    // Step the model back one cycle. FALSE if it is at the oldest frame.
+
+    if (!oos_history_valid(gv, history) || (history->current == 0)) {
+        return(FALSE);
+    }
+    oos_history_undo(gv, history);
+    return(TRUE);
+}
+
+Boolean oos_history_goto(OosVars *gv, OosHistory *history, int cycle)
+{
+    // Move the model to the given cycle, if it is in the history
+
+    int k;
+
+    if (!oos_history_valid(gv, history)) {
+        return(FALSE);
+    }
+    for (k = 0; (k < history->frames) && (HISTORY_FRAME(history, k)->cycle != cycle); k++);
+    if (k == history->frames) {
+        return(FALSE);
+    }
+    while (history->current > k) {
+        oos_history_undo(gv, history);
+    }
+    while (history->current < k) {
+        oos_history_redo(gv, history);
+    }
+    return(TRUE);
+}
+
+int oos_history_first_cycle(OosHistory *history)
+{
+    return((history->frames > 0) ? HISTORY_FRAME(history, 0)->cycle : -1);
+}
+
+int oos_history_last_cycle(OosHistory *history)
+{
+    return((history->frames > 0) ? HISTORY_FRAME(history, history->frames - 1)->cycle : -1);
+}
+
 /******************************************************************************/
 /* EXTRANEOUS FUNCTIONS (SHOULD BE DEFINED ELSEWHERE) *************************/
 
@@ -55,6 +55,52 @@ typedef struct message_list {
     struct message_list *next;
 } MessageList;
 
+typedef struct oos_counters {
+    long cycles;                /* Cycles run (by oos_step/1)                  */
+    long blocks;                /* Blocks completed (by oos_step_block/1)      */
+    long block_cycles_max;      /* Most cycles taken by any one block          */
+    long messages[MT_MAX];      /* Messages created, by type                   */
+    long unify_calls;           /* Calls to unify_terms/2, including recursive */
+    long clause_allocations;    /* Clauses allocated and freed in oos_step/1   */
+    long clause_frees;
+    long evictions;             /* Buffer elements lost to decay               */
+} OosCounters;
+
+typedef struct oos_box_counters {
+    long match_calls;           /* Matches attempted against a buffer          */
+    long match_hits;            /* ... and those that succeeded                */
+    long messages_sent;         /* Messages created with the box as source     */
+    long evictions;             /* Elements of a buffer lost to decay          */
+} OosBoxCounters;
+
+/* Profiling (compile everything with -DOOS_PROFILE): the time taken by each  */
+/* process's output function and by each phase of each buffer's update.       */
+
+typedef enum oos_profile_phase {
+    OOS_PHASE_OUTPUT, OOS_PHASE_CLEAR, OOS_PHASE_DELETE, OOS_PHASE_ADD, OOS_PHASE_ACTIVATE, OOS_PHASE_DECAY, OOS_PHASE_MAX
+} OosProfilePhase;
+
+extern char *oos_profile_phase_name[OOS_PHASE_MAX];
+
+#define OOS_PROFILE_BUCKETS 32      /* Bucket i: durations of [2^i, 2^(i+1)) ns */
+
+typedef struct oos_phase_profile {
+    long calls;
+    long total_ns;
+    long max_ns;
+    long histogram[OOS_PROFILE_BUCKETS];
+} OosPhaseProfile;
+
+typedef struct oos_snapshot {
+    unsigned char *data;
+    size_t length;
+    size_t capacity;
+    size_t position;
+} OosSnapshot;
+
+typedef struct oos_replay OosReplay;
+typedef struct oos_history OosHistory;
+
 typedef struct oos_vars {
     int cycle;
     int block;
@@ -67,6 +113,13 @@ typedef struct oos_vars {
     struct arrow_list *arrows;
     struct annotation_list *annotations;
     struct message_list *messages;
+    struct box_list *sender;    /* The process whose output function is running */
+    /* Optional hooks for saving/restoring task_data in snapshots: */
+    void (*task_data_save)(struct oos_vars *, OosSnapshot *);
+    Boolean (*task_data_restore)(struct oos_vars *, OosSnapshot *);
+    OosCounters counters;
+    struct oos_trace *trace;    /* Non-NULL while a trace is being written */
+    struct oos_record *record;  /* Non-NULL while the run is being recorded */
 } OosVars;
 
 typedef struct annotation_list {
@@ -105,6 +158,10 @@ typedef struct box_list {
     BufferExcessProp excess_capacity;
     BufferAccessProp access;
     TimestampedClauseList *content;
+    OosBoxCounters counters;
+#ifdef OOS_PROFILE
+    OosPhaseProfile profile[OOS_PHASE_MAX];
+#endif
     struct box_list *next;
 } BoxList;
 
@@ -117,6 +174,7 @@ extern ArrowList       *oos_arrow_create(OosVars *gv, VertexStyle vs, LineStyle
 extern BoxList         *oos_process_create(OosVars *gv, char *name, int id, double x, double y, void (*output_function)(OosVars *));
 extern BoxList         *oos_buffer_create(OosVars *gv, char *name, int id, double x, double y, BufferDecayProp decay, int decay_constant, BufferCapacityProp capacity, int capacity_constant, BufferExcessProp excess_capacity, BufferAccessProp access);
 extern void             oos_buffer_create_element(OosVars *gv, int box_id, char *element, double activation);
+extern Boolean          oos_buffer_set_decay(OosVars *gv, int box_id, BufferDecayProp decay, int decay_constant);
 extern OosVars         *oos_globals_create();
 extern void             oos_messages_free(OosVars *gv);
 extern void             oos_model_free(OosVars *gv);
@@ -126,15 +184,66 @@ extern void             oos_dump(OosVars *gv, Boolean state);
 
 extern char *oos_box_name(OosVars *gv, int id);
 
+extern ClauseType  *unify_terms(ClauseType *template, ClauseType *term);
+
 extern Boolean      oos_match(OosVars *gv, int id, ClauseType *template);
 extern Boolean      oos_match_above_threshold(OosVars *gv, int id, ClauseType *template, double threshold);
 extern void         oos_message_create(OosVars *gv, MessageType mt, int source, int target, ClauseType *content);
 
 extern Boolean      oos_step(OosVars *gv);
 extern void         oos_step_block(OosVars *gv);
+extern void         oos_model_reset(OosVars *gv);
 extern void         oos_initialise_trial(OosVars *gv);
 extern void         oos_initialise_session(OosVars *gv, int trials_per_subject, int subjects_per_experiment);
 
 extern TimestampedClauseList  *oos_buffer_get_contents(OosVars *gv, int id);
 
+extern void         oos_counters_reset(OosVars *gv);
+extern void         oos_counters_print(FILE *fp, OosVars *gv);
+extern void         oos_counters_print_json(FILE *fp, OosVars *gv);
+
+extern Boolean      oos_trace_open(OosVars *gv, const char *filename, int tid);
+extern Boolean      oos_trace_open_from_environment(OosVars *gv, int tid);
+extern void         oos_trace_close(OosVars *gv);
+
+extern Boolean      oos_record_open(OosVars *gv, const char *filename);
+extern Boolean      oos_record_open_from_environment(OosVars *gv, int tid);
+extern void         oos_record_close(OosVars *gv);
+extern OosReplay   *oos_replay_open(const char *filename);
+extern int          oos_replay_blocks(OosReplay *replay);
+extern Boolean      oos_replay_block(OosVars *gv, OosReplay *replay, int k);
+extern Boolean      oos_replay_step(OosVars *gv, OosReplay *replay);
+extern int          oos_replay_mismatches(OosReplay *replay);
+extern void         oos_replay_close(OosReplay *replay);
+
+extern OosHistory  *oos_history_create(int window);
+extern void         oos_history_clear(OosHistory *history);
+extern void         oos_history_free(OosHistory *history);
+extern Boolean      oos_history_step(OosVars *gv, OosHistory *history);
+extern Boolean      oos_history_back(OosVars *gv, OosHistory *history);
+extern Boolean      oos_history_goto(OosVars *gv, OosHistory *history, int cycle);
+extern int          oos_history_first_cycle(OosHistory *history);
+extern int          oos_history_last_cycle(OosHistory *history);
+
+#ifdef OOS_PROFILE
+extern void         oos_profile_reset(OosVars *gv);
+extern void         oos_profile_print(FILE *fp, OosVars *gv);
+#endif
+
+extern OosSnapshot *oos_snapshot_create(OosVars *gv);
+extern Boolean      oos_snapshot_restore(OosVars *gv, OosSnapshot *snapshot);
+extern void         oos_snapshot_free(OosSnapshot *snapshot);
+extern Boolean      oos_snapshot_write_to_file(OosSnapshot *snapshot, const char *filename);
+extern OosSnapshot *oos_snapshot_read_from_file(const char *filename);
+extern OosVars     *oos_globals_clone(OosVars *gv);
+
+extern void         oos_snapshot_put_bytes(OosSnapshot *snapshot, const void *data, size_t n);
+extern void         oos_snapshot_put_int(OosSnapshot *snapshot, int i);
+extern void         oos_snapshot_put_long(OosSnapshot *snapshot, long l);
+extern void         oos_snapshot_put_double(OosSnapshot *snapshot, double d);
+extern Boolean      oos_snapshot_get_bytes(OosSnapshot *snapshot, void *data, size_t n);
+extern Boolean      oos_snapshot_get_int(OosSnapshot *snapshot, int *i);
+extern Boolean      oos_snapshot_get_long(OosSnapshot *snapshot, long *l);
+extern Boolean      oos_snapshot_get_double(OosSnapshot *snapshot, double *d);
+
 #endif
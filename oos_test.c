@@ -1,5 +1,9 @@
 
+#include <string.h>
 #include "oos.h"
+#include "rng.h"
+#include "rng_defaults.h"
+#include "lib_math.h"
 
 extern int oos_count_buffer_elements(OosVars *gv, int id);
 
@@ -27,8 +31,8 @@ static void test_initialise(OosVars *gv, BufferDecayProp decay)
     oos_messages_free(gv);
     oos_components_free(gv);
 
-    oos_buffer_create(gv, "Test Buffer", MY_BUFFER, decay, 40, BUFFER_CAPACITY_UNLIMITED, 0, BUFFER_EXCESS_IGNORE, BUFFER_ACCESS_RANDOM);
-    oos_process_create(gv, "Test Process", MY_PROCESS, my_process_output);
+    oos_buffer_create(gv, "Test Buffer", MY_BUFFER, 0.5, 0.5, decay, 40, BUFFER_CAPACITY_UNLIMITED, 0, BUFFER_EXCESS_IGNORE, BUFFER_ACCESS_RANDOM);
+    oos_process_create(gv, "Test Process", MY_PROCESS, 0.5, 0.2, my_process_output);
 
     gv->name = string_copy("Test Model");
     gv->stopped = FALSE;
@@ -70,20 +74,149 @@ void test_run(OosVars *gv)
     }
 }
 
+/******************************************************************************/
+/* Snapshots: a model restored from a snapshot (or cloned, or resumed from a  */
+/* checkpoint) must continue exactly as the original did.                     */
+
+#define SNAPSHOT_CYCLES 300
+#define CHECKPOINT_FILE "oos_test.checkpoint"
+
+static Boolean snapshot_equal(OosSnapshot *s1, OosSnapshot *s2)
+{
+    return((s1->length == s2->length) && (memcmp(s1->data, s2->data, s1->length) == 0));
+}
+
+static OosSnapshot *snapshot_after_cycles(OosVars *gv, int cycles)
+{
+    while ((cycles-- > 0) && oos_step(gv));
+    return(oos_snapshot_create(gv));
+}
+
+static Boolean responses_equal(RngData *d1, RngData *d2, int subjects)
+{
+    int i;
+
+    for (i = 0; i < subjects; i++) {
+        if ((d1->subject[i].n != d2->subject[i].n) || (memcmp(d1->subject[i].response, d2->subject[i].response, MAX_TRIALS * sizeof(int)) != 0)) {
+            return(FALSE);
+        }
+    }
+    return(TRUE);
+}
+
+static int test_snapshot(OosVars *gv)
+{
+    // Returns the number of failures
+
+    OosSnapshot *start, *expected, *actual, *bad;
+    RngParameters p = pars;
+    RngData *reference;
+    OosVars *copy;
+    int failures = 0;
+
+    random_seed(1);
+    rng_model_create(gv, &p, FALSE);
+    oos_initialise_trial(gv);
+    rng_initialise_subject(gv);
+    start = snapshot_after_cycles(gv, 200);
+    expected = snapshot_after_cycles(gv, SNAPSHOT_CYCLES);
+
+    /* Restore and continue: */
+    if (!oos_snapshot_restore(gv, start)) {
+        fprintf(stdout, "FAILED: Cannot restore snapshot\n");
+        failures++;
+    }
+    actual = snapshot_after_cycles(gv, SNAPSHOT_CYCLES);
+    if (!snapshot_equal(expected, actual)) {
+        fprintf(stdout, "FAILED: Restored model diverges from the original\n");
+        failures++;
+    }
+    oos_snapshot_free(actual);
+
+    /* Clone and continue: */
+    oos_snapshot_restore(gv, start);
+    if ((copy = oos_globals_clone(gv)) == NULL) {
+        fprintf(stdout, "FAILED: Cannot clone model\n");
+        failures++;
+    }
+    else {
+        actual = snapshot_after_cycles(copy, SNAPSHOT_CYCLES);
+        if (!snapshot_equal(expected, actual)) {
+            fprintf(stdout, "FAILED: Cloned model diverges from the original\n");
+            failures++;
+        }
+        oos_snapshot_free(actual);
+        rng_globals_destroy((RngData *)copy->task_data);
+        oos_globals_destroy(copy);
+    }
+
+    /* A truncated snapshot must be refused without changing the model: */
+    oos_snapshot_restore(gv, start);
+    bad = oos_snapshot_create(gv);
+    bad->length -= 8;
+    if (oos_snapshot_restore(gv, bad)) {
+        fprintf(stdout, "FAILED: Truncated snapshot restored\n");
+        failures++;
+    }
+    actual = snapshot_after_cycles(gv, SNAPSHOT_CYCLES);
+    if (!snapshot_equal(expected, actual)) {
+        fprintf(stdout, "FAILED: Failed restore changed the model\n");
+        failures++;
+    }
+    oos_snapshot_free(actual);
+    oos_snapshot_free(bad);
+    oos_snapshot_free(expected);
+    oos_snapshot_free(start);
+
+    /* A checkpointed run resumed part way through must match a plain run: */
+    p.seed = 1;
+    p.sample_size = 6;
+    rng_model_reset(gv, &p);
+    rng_run(gv);
+    if ((reference = (RngData *)malloc(sizeof(RngData))) != NULL) {
+        *reference = *((RngData *)gv->task_data);
+        rng_model_reset(gv, &p);
+        gv->subjects_per_experiment = 3;
+        rng_run(gv);
+        gv->subjects_per_experiment = p.sample_size;
+        start = oos_snapshot_create(gv);
+        oos_snapshot_write_to_file(start, CHECKPOINT_FILE);
+        oos_snapshot_free(start);
+        rng_model_reset(gv, &p);
+        rng_run_checkpointed(gv, CHECKPOINT_FILE, 2);
+        if ((gv->block != p.sample_size) || !responses_equal(reference, (RngData *)gv->task_data, p.sample_size)) {
+            fprintf(stdout, "FAILED: Resumed checkpointed run differs from a plain run\n");
+            failures++;
+        }
+        free(reference);
+    }
+    rng_globals_destroy((RngData *)gv->task_data);
+    gv->task_data = NULL;
+    oos_model_free(gv);
+    oos_messages_free(gv);
+
+    fprintf(stdout, "Snapshot tests: %s\n", (failures == 0) ? "passed" : "FAILED");
+    return(failures);
+}
+
 /******************************************************************************/
 
 int main(int argc, char **argv)
 {
     OosVars *gv;
+    int failures = 0;
 
     if ((gv = oos_globals_create()) == NULL) {
         fprintf(stdout, "ABORTING: Cannot allocate global variable space\n");
     }
     else {
-        test_run(gv);
+        failures = test_snapshot(gv);
+        if ((argc < 2) || (strcmp(argv[1], "snapshot") != 0)) {
+            test_run(gv);
+        }
         oos_globals_destroy(gv);
     }
-    exit(1);
+    exit(failures > 0 ? 2 : 1);
 }
 
 /******************************************************************************/
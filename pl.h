@@ -86,12 +86,17 @@ typedef struct clause {
 
 /* Global variables defined in pl_scan.c: */
 
-extern int             pl_context_char_count;
-extern char           *pl_context_filename;
-extern int             pl_context_line_count;
+extern __thread int    pl_context_char_count;
+extern __thread char  *pl_context_filename;
+extern __thread int    pl_context_line_count;
 
 /* From pl_misc.c: */
 
+extern __thread long pl_clause_allocations;
+extern __thread long pl_clause_frees;
+
+extern ClauseType *pl_clause_allocate();
+extern void        pl_clause_release(ClauseType *clause);
 extern void        pl_clause_free(ClauseType *clause);
 extern ClauseType *pl_clause_copy(ClauseType *clause);
 extern int         pl_clause_embed(ClauseType *clause, const char *functor);
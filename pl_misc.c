@@ -53,15 +53,42 @@
 #include <stdarg.h>
 
 #define WB_LENGTH 256
-char warning_buffer[WB_LENGTH];
+__thread char warning_buffer[WB_LENGTH];
 
 #ifdef MALLOC_CHECK
-#include "../lib/zmalloc.h"
+#include "zmalloc.h"
 #endif
 
 /******************************************************************************/
 /***************** Operations on/returning Clause structures ******************/
 
+/* Allocate a Clause: --------------------------------------------------------*/
+
+/* Clauses allocated and freed by this thread (see oos_counters_print/2):     */
+
+__thread long pl_clause_allocations = 0;
+__thread long pl_clause_frees = 0;
+
+ClauseType *pl_clause_allocate()
+{
+    ClauseType *clause;
+
+    if ((clause = (ClauseType *) malloc(sizeof(ClauseType))) != NULL) {
+        pl_clause_allocations++;
+    }
+    return(clause);
+}
+
+/* Free a Clause node, but not its functor or arguments: ---------------------*/
+
+void pl_clause_release(ClauseType *clause)
+{
+    if (clause != NULL) {
+        free(clause);
+        pl_clause_frees++;
+    }
+}
+
 /* Free a Clause: ------------------------------------------------------------*/
 
 void pl_clause_free(ClauseType *clause)
@@ -71,7 +98,7 @@ void pl_clause_free(ClauseType *clause)
         if (pl_functor(clause) != NULL) {
             pl_functor_free(clause);
         }
-        free(clause);
+        pl_clause_release(clause);
     }
 }
 
@@ -86,7 +113,7 @@ ClauseType *pl_clause_copy(ClauseType *clause)
     if (clause == NULL) {
         return(NULL);
     }
-    else if ((copy = (ClauseType *) malloc(sizeof(ClauseType))) == NULL) {
+    else if ((copy = pl_clause_allocate()) == NULL) {
         return(NULL);          // error: failed malloc
     }
     else {
@@ -98,7 +125,7 @@ ClauseType *pl_clause_copy(ClauseType *clause)
             pl_functor_set(copy, NULL);
         }
         else if ((str = string_new(1 + strlen(pl_functor(clause)))) == NULL) {
-            free(copy);
+            pl_clause_release(copy);
             return(NULL);      // error: failed malloc
         }
         else {
@@ -138,16 +165,16 @@ int pl_clause_embed(ClauseType *clause, const char *functor)
     ClauseList *arguments;
     char *copy_of_functor;
 
-    if ((new = (ClauseType *) malloc(sizeof(ClauseType))) == NULL) {
+    if ((new = pl_clause_allocate()) == NULL) {
         return(FALSE);         // error: failed_malloc
     }
     else if ((arguments = (ClauseList *) malloc(sizeof(ClauseList))) == NULL) {
-        free(new);
+        pl_clause_release(new);
         return(FALSE);         // error: failed_malloc
     }
     else if ((copy_of_functor = string_copy(functor)) == NULL) {
         free(arguments);
-        free(new);
+        pl_clause_release(new);
         return(FALSE);         // error: failed_malloc
     }
     else {
@@ -269,7 +296,7 @@ int pl_clause_compare(ClauseType *clause1, ClauseType *clause2)
 ClauseType *pl_clause_from_list(ClauseList *input)
 {
     if (input == NULL) {
-        ClauseType *empty = (ClauseType *) malloc(sizeof(ClauseType));
+        ClauseType *empty = pl_clause_allocate();
         if (empty == NULL) {
             return(NULL);      // error: failed malloc
         }
@@ -292,11 +319,11 @@ ClauseType *pl_clause_from_list(ClauseList *input)
 
 ClauseType *pl_clause_make_from_string(char *string)
 {
-    ClauseType *clause = (ClauseType *) malloc(sizeof(ClauseType));
+    ClauseType *clause = pl_clause_allocate();
 
     if (clause != NULL) {
         if (sscan_clause(string, clause) == 0) {
-            free(clause);
+            pl_clause_release(clause);
             clause = NULL;
         }
     }
@@ -504,7 +531,7 @@ ClauseList *pl_clause_list_read_from_file(char *filename, ClauseList *declaratio
         return(NULL);
     }
     else {
-        ClauseType *clause = (ClauseType *) malloc(sizeof(ClauseType));
+        ClauseType *clause = pl_clause_allocate();
         ClauseList tmp = { NULL, NULL };
         ClauseList *list = &tmp;
 
@@ -533,12 +560,12 @@ ClauseList *pl_clause_list_read_from_file(char *filename, ClauseList *declaratio
                 *error = ERROR_MALLOC_FAILED;
                 pl_clause_free(clause);
             }
-            if ((clause = (ClauseType *) malloc(sizeof(ClauseType))) == NULL) {
+            if ((clause = pl_clause_allocate()) == NULL) {
                 *error = ERROR_MALLOC_FAILED;
             }
         }
         if (clause != NULL) {
-            free(clause);
+            pl_clause_release(clause);
         }
         pl_context_filename = tmp_file;
         pl_context_line_count = tmp_line;
@@ -605,7 +632,7 @@ ClauseType *pl_list_assemble(ClauseType *head, ClauseType *tail)
 {
     ClauseType *list;
 
-    if ((list = (ClauseType *) malloc(sizeof(ClauseType))) == NULL) {
+    if ((list = pl_clause_allocate()) == NULL) {
         return(NULL);
     }
     else if (pl_clause_build(list, COMPLEX, string_copy("."), 2, head, tail)) {
@@ -635,7 +662,7 @@ ClauseType *pl_list_append(ClauseType *current_list, ClauseType *tail)
         pl_integer_set(current_list, pl_integer(tail));
         pl_double_set(current_list, pl_double(tail));
         pl_arguments_set(current_list, pl_arguments(tail));
-        free(tail);
+        pl_clause_release(tail);
         return(current_list);
     }
 }
@@ -661,7 +688,7 @@ int pl_list_add_to_tail(ClauseType *list, ClauseType *new_element)
             free(args);
             return(FALSE);     // error: failed malloc
         }
-        else if ((new = (ClauseType *) malloc(sizeof(ClauseType))) == NULL) {
+        else if ((new = pl_clause_allocate()) == NULL) {
             free(args->tail);
             free(args);
             return(FALSE);     // error: failed malloc
@@ -714,7 +741,7 @@ int pl_list_delete_head(ClauseType *list)
         pl_integer_set(list, pl_integer(next));
         pl_double_set(list, pl_double(next));
         pl_arguments_set(list, pl_arguments(next));
-        free(next);
+        pl_clause_release(next);
 
         /* and return success */
 
@@ -851,7 +878,7 @@ void pl_arg_set_to_int(ClauseType *clause, int arg, long val)
 {
     ClauseType *tmp;
 
-    if ((tmp = (ClauseType *) malloc(sizeof(ClauseType))) != NULL) {
+    if ((tmp = pl_clause_allocate()) != NULL) {
         pl_clause_build(tmp, INT_NUMBER, val);
         pl_arg_set(clause, arg, tmp);
     }
@@ -861,7 +888,7 @@ void pl_arg_set_to_real(ClauseType *clause, int arg, double val)
 {
     ClauseType *tmp;
 
-    if ((tmp = (ClauseType *) malloc(sizeof(ClauseType))) != NULL) {
+    if ((tmp = pl_clause_allocate()) != NULL) {
         pl_clause_build(tmp, REAL_NUMBER, val);
         pl_arg_set(clause, arg, tmp);
     }
@@ -871,7 +898,7 @@ void pl_arg_set_to_string(ClauseType *clause, int arg, char *string)
 {
     ClauseType *tmp;
 
-    if ((tmp = (ClauseType *) malloc(sizeof(ClauseType))) != NULL) {
+    if ((tmp = pl_clause_allocate()) != NULL) {
         pl_clause_build(tmp, STRING, string_copy(string));
         pl_arg_set(clause, arg, tmp);
     }
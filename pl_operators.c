@@ -40,7 +40,7 @@
 #define PATHNAME_LENGTH 256
 
 #ifdef MALLOC_CHECK
-#include "../lib/zmalloc.h"
+#include "zmalloc.h"
 #endif
 
 /******** Local type defs: ****************************************************/
@@ -52,7 +52,7 @@ typedef struct operator_table {
 
 /******** Local variables: ****************************************************/
 
-static OperatorTable *operator_list = NULL;
+static __thread OperatorTable *operator_list = NULL;   /* Per thread */
 
 /******************************************************************************/
 /******** Routines for Manipulating Operators: ********************************/
@@ -44,7 +44,7 @@
 #include <stdarg.h>
 
 #ifdef MALLOC_CHECK
-#include "../lib/zmalloc.h"
+#include "zmalloc.h"
 #endif
 
 /******** External procedures: ************************************************/
@@ -190,20 +190,20 @@ static int fparse_list(FILE *fp, Token *current, ClauseType *answer)
         lib_error_report(ERROR_MALLOC_FAILED, "while building list");
         pl_clause_build(answer, EMPTY_LIST);
     }
-    else if ((arguments->head = (ClauseType *)malloc(sizeof(ClauseType))) == NULL) {
+    else if ((arguments->head = pl_clause_allocate()) == NULL) {
         lib_error_report(ERROR_MALLOC_FAILED, "while creating list head");
         free(arguments);
         pl_clause_build(answer, EMPTY_LIST);
     }
     else if ((arguments->tail = (ClauseList *)malloc(sizeof(ClauseList))) == NULL) {
         lib_error_report(ERROR_MALLOC_FAILED, "while creating list tail");
-        free(arguments->head);
+        pl_clause_release(arguments->head);
         free(arguments);
         pl_clause_build(answer, EMPTY_LIST);
     }
-    else if ((arguments->tail->head = (ClauseType *)malloc(sizeof(ClauseType))) == NULL) {
+    else if ((arguments->tail->head = pl_clause_allocate()) == NULL) {
         lib_error_report(ERROR_MALLOC_FAILED, "while creating list tail's head");
-        free(arguments->head);
+        pl_clause_release(arguments->head);
         free(arguments->tail);
         free(arguments);
         pl_clause_build(answer, EMPTY_LIST);
@@ -247,20 +247,20 @@ static int sparse_list(char *s, Token *current, ClauseType *answer)
         lib_error_report(ERROR_MALLOC_FAILED, "while building list");
         pl_clause_build(answer, EMPTY_LIST);
     }
-    else if ((arguments->head = (ClauseType *)malloc(sizeof(ClauseType))) == NULL) {
+    else if ((arguments->head = pl_clause_allocate()) == NULL) {
         lib_error_report(ERROR_MALLOC_FAILED, "while creating list head");
         free(arguments);
         pl_clause_build(answer, EMPTY_LIST);
     }
     else if ((arguments->tail = (ClauseList *)malloc(sizeof(ClauseList))) == NULL) {
         lib_error_report(ERROR_MALLOC_FAILED, "while creating list tail");
-        free(arguments->head);
+        pl_clause_release(arguments->head);
         free(arguments);
         pl_clause_build(answer, EMPTY_LIST);
     }
-    else if ((arguments->tail->head = (ClauseType *)malloc(sizeof(ClauseType))) == NULL) {
+    else if ((arguments->tail->head = pl_clause_allocate()) == NULL) {
         lib_error_report(ERROR_MALLOC_FAILED, "while creating list tail's head");
-        free(arguments->head);
+        pl_clause_release(arguments->head);
         free(arguments->tail);
         free(arguments);
         pl_clause_build(answer, EMPTY_LIST);
@@ -308,7 +308,7 @@ static int fparse_arguments(FILE *fp, Token *current, ClauseList **list)
     if ((*list = (ClauseList *)malloc(sizeof(ClauseList))) == NULL) {
         lib_error_report(ERROR_MALLOC_FAILED, "while building argument list");
     }
-    else if (((*list)->head = (ClauseType *)malloc(sizeof(ClauseType))) == NULL) {
+    else if (((*list)->head = pl_clause_allocate()) == NULL) {
         lib_error_report(ERROR_MALLOC_FAILED, "while building argument list head");
         free(*list);
         *list = NULL;
@@ -336,7 +336,7 @@ static int sparse_arguments(char *s, Token *current, ClauseList **list)
     if ((*list = (ClauseList *)malloc(sizeof(ClauseList))) == NULL) {
         lib_error_report(ERROR_MALLOC_FAILED, "while building argument list");
     }
-    else if (((*list)->head = (ClauseType *)malloc(sizeof(ClauseType))) == NULL) {
+    else if (((*list)->head = pl_clause_allocate()) == NULL) {
         lib_error_report(ERROR_MALLOC_FAILED, "while building argument list head");
         free(*list);
         *list = NULL;
@@ -642,7 +642,7 @@ static int fparse_term(FILE *fp, Token *current, char *message, int n, ClauseTyp
     OperatorType *op;
     int m = 0, j = 0;
 
-    if ((subterm  = (ClauseType *)malloc(sizeof(ClauseType))) == NULL) {
+    if ((subterm  = pl_clause_allocate()) == NULL) {
         lib_error_report(ERROR_MALLOC_FAILED, "while building subterm");
     }
     else if ((op = lookup_operator(current, PREFIX)) != NULL) {
@@ -651,7 +651,7 @@ static int fparse_term(FILE *fp, Token *current, char *message, int n, ClauseTyp
         j += fscan_token(fp, current);
         if ((op->op_type == FY) && (op->op_precedence <= n) && (potential_subterm(current, op->op_precedence))) {
             ClauseType *arg;
-            if ((arg  = (ClauseType *)malloc(sizeof(ClauseType))) == NULL) {
+            if ((arg  = pl_clause_allocate()) == NULL) {
                 lib_error_report(ERROR_MALLOC_FAILED, "while building FY argument");
             }
             else {
@@ -662,7 +662,7 @@ static int fparse_term(FILE *fp, Token *current, char *message, int n, ClauseTyp
         }
 	else if ((op->op_type == FX) && (op->op_precedence <= n) && (potential_subterm(current, op->op_precedence-1))) {
             ClauseType *arg;
-            if ((arg  = (ClauseType *)malloc(sizeof(ClauseType))) == NULL) {
+            if ((arg  = pl_clause_allocate()) == NULL) {
                 lib_error_report(ERROR_MALLOC_FAILED, "while building FX argument");
             }
             else {
@@ -702,7 +702,7 @@ static int sparse_term(char *s, Token *current, char *message, int n, ClauseType
     OperatorType *op;
     int m = 0, j = 0;
 
-    if ((subterm  = (ClauseType *)malloc(sizeof(ClauseType))) == NULL) {
+    if ((subterm  = pl_clause_allocate()) == NULL) {
         lib_error_report(ERROR_MALLOC_FAILED, "while building subterm");
     }
     else if ((op = lookup_operator(current, PREFIX)) != NULL) {
@@ -711,7 +711,7 @@ static int sparse_term(char *s, Token *current, char *message, int n, ClauseType
         j += sscan_token(&s[j], current);
 	if ((op->op_type == FY) && (op->op_precedence <= n) && (potential_subterm(current, op->op_precedence))) {
             ClauseType *arg;
-            if ((arg  = (ClauseType *)malloc(sizeof(ClauseType))) == NULL) {
+            if ((arg  = pl_clause_allocate()) == NULL) {
                 lib_error_report(ERROR_MALLOC_FAILED, "while building FY argument");
             }
             else {
@@ -722,7 +722,7 @@ static int sparse_term(char *s, Token *current, char *message, int n, ClauseType
         }
 	else if ((op->op_type == FX) && (op->op_precedence <= n) && (potential_subterm(current, op->op_precedence-1))) {
             ClauseType *arg;
-            if ((arg  = (ClauseType *)malloc(sizeof(ClauseType))) == NULL) {
+            if ((arg  = pl_clause_allocate()) == NULL) {
                 lib_error_report(ERROR_MALLOC_FAILED, "while building FX argument");
             }
             else {
@@ -789,7 +789,7 @@ static int fparse_post_base_term(FILE *fp, ClauseType *pre_term, Token *current,
         j += fscan_token(fp, current);
     }
     else if (((op = lookup_operator_in_term(current, INFIX)) != NULL) && (op->op_type == YFX) && ((p = op->op_precedence) >= m) && (p <= n)) {
-        if ((post_term = (ClauseType *)malloc(sizeof(ClauseType))) == NULL) {
+        if ((post_term = pl_clause_allocate()) == NULL) {
             lib_error_report(ERROR_MALLOC_FAILED, "while building post-term");
         }
         else {
@@ -799,7 +799,7 @@ static int fparse_post_base_term(FILE *fp, ClauseType *pre_term, Token *current,
         }
     }
     else if (((op = lookup_operator_in_term(current, INFIX)) != NULL) && (op->op_type == XFX) && ((p = op->op_precedence) > m) && (p <= n)) {
-        if ((post_term = (ClauseType *)malloc(sizeof(ClauseType))) == NULL) {
+        if ((post_term = pl_clause_allocate()) == NULL) {
             lib_error_report(ERROR_MALLOC_FAILED, "while building XFX term");
         }
         else {
@@ -809,7 +809,7 @@ static int fparse_post_base_term(FILE *fp, ClauseType *pre_term, Token *current,
         }
     }
     else if (((op = lookup_operator_in_term(current, INFIX)) != NULL) && (op->op_type == XFY) && ((p = op->op_precedence) > m) && (p <= n)) {
-        if ((post_term = (ClauseType *)malloc(sizeof(ClauseType))) == NULL) {
+        if ((post_term = pl_clause_allocate()) == NULL) {
             lib_error_report(ERROR_MALLOC_FAILED, "while building XFY term");
         }
         else {
@@ -825,11 +825,11 @@ static int fparse_post_base_term(FILE *fp, ClauseType *pre_term, Token *current,
         pl_integer_set(answer, pl_integer(pre_term));
         pl_double_set(answer, pl_double(pre_term));
         pl_arguments_set(answer, pl_arguments(pre_term));
-        free(pre_term);
+        pl_clause_release(pre_term);
 
         return(j);
     }
-    if ((term = (ClauseType *)malloc(sizeof(ClauseType))) == NULL) {
+    if ((term = pl_clause_allocate()) == NULL) {
         lib_error_report(ERROR_MALLOC_FAILED, "while building term");
     }
     else {
@@ -859,7 +859,7 @@ static int sparse_post_base_term(char *s, ClauseType *pre_term, Token *current,
         j += sscan_token(&s[j], current);
     }
     else if (((op = lookup_operator_in_term(current, INFIX)) != NULL) && (op->op_type == YFX) && ((p = op->op_precedence) >= m) && (p <= n)) {
-        if ((post_term = (ClauseType *)malloc(sizeof(ClauseType))) == NULL) {
+        if ((post_term = pl_clause_allocate()) == NULL) {
             lib_error_report(ERROR_MALLOC_FAILED, "while building post-term");
         }
         else {
@@ -869,7 +869,7 @@ static int sparse_post_base_term(char *s, ClauseType *pre_term, Token *current,
         }
     }
     else if (((op = lookup_operator_in_term(current, INFIX)) != NULL) && (op->op_type == XFX) && ((p = op->op_precedence) > m) && (p <= n)) {
-        if ((post_term = (ClauseType *)malloc(sizeof(ClauseType))) == NULL) {
+        if ((post_term = pl_clause_allocate()) == NULL) {
             lib_error_report(ERROR_MALLOC_FAILED, "while building XFX term");
         }
         else {
@@ -879,7 +879,7 @@ static int sparse_post_base_term(char *s, ClauseType *pre_term, Token *current,
         }
     }
     else if (((op = lookup_operator_in_term(current, INFIX)) != NULL) && (op->op_type == XFY) && ((p = op->op_precedence) > m) && (p <= n)) {
-        if ((post_term = (ClauseType *)malloc(sizeof(ClauseType))) == NULL) {
+        if ((post_term = pl_clause_allocate()) == NULL) {
             lib_error_report(ERROR_MALLOC_FAILED, "while building XFY term");
         }
         else {
@@ -895,10 +895,10 @@ static int sparse_post_base_term(char *s, ClauseType *pre_term, Token *current,
         pl_integer_set(answer, pl_integer(pre_term));
         pl_double_set(answer, pl_double(pre_term));
         pl_arguments_set(answer, pl_arguments(pre_term));
-        free(pre_term);
+        pl_clause_release(pre_term);
         return(j);
     }
-    if ((term = (ClauseType *)malloc(sizeof(ClauseType))) == NULL) {
+    if ((term = pl_clause_allocate()) == NULL) {
         lib_error_report(ERROR_MALLOC_FAILED, "while building term");
     }
     else {
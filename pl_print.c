@@ -51,7 +51,7 @@
 #define FALSE   0
 
 #ifdef MALLOC_CHECK
-#include "../lib/zmalloc.h"
+#include "zmalloc.h"
 #endif
 
 /******************************************************************************/
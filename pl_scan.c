@@ -65,22 +65,24 @@
 extern void pl_error_syntax(char *error_message);
 
 #ifdef MALLOC_CHECK
-#include "../lib/zmalloc.h"
+#include "zmalloc.h"
 #endif
 
 /******** Static and external variables: **************************************/
 
-static int prev_line_count;
-static int prev_char_count;
-int pl_context_line_count;
-int pl_context_char_count;
-char *pl_context_filename;
+/* Scanner state is per thread, so models can be parsed and run in parallel:  */
+
+static __thread int prev_line_count;
+static __thread int prev_char_count;
+__thread int pl_context_line_count;
+__thread int pl_context_char_count;
+__thread char *pl_context_filename;
 
 /******************************************************************************/
 /******** Report a syntax error: **********************************************/
 /******************************************************************************/
 
-static char error_buffer[512];
+static __thread char error_buffer[512];
 
 void fsyntax_error(char *error)
 {
@@ -788,7 +790,7 @@ int fscan_token(FILE *fp, Token *symbol)
 {
     /* It is assumed that token points to preallocated space... */
 
-    static char look_ahead = '\0';
+    static __thread char look_ahead = '\0';
     TypeOfToken token_type;
     int c;
     int j = 0;
@@ -12,11 +12,14 @@ int main(int argc, char **argv)
         fprintf(stdout, "ABORTING: Cannot allocate global variable space\n");
     }
     else {
-        rng_create(gv, &pars);
+        rng_model_create(gv, &pars, FALSE);
+        oos_trace_open_from_environment(gv, 0);
+        oos_record_open_from_environment(gv, 0);
         rng_initialise_subject(gv);
         rng_run(gv);
         rng_analyse_group_data((RngData *)gv->task_data);
         rng_print_group_data_analysis(stdout, (RngData *)gv->task_data);
+        oos_counters_print(stdout, gv);
         rng_globals_destroy((RngData *)gv->task_data);
         oos_globals_destroy(gv);
     }
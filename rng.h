@@ -15,6 +15,10 @@
 #define MAX_TRIALS  500
 #define SCHEMA_SET_SIZE 11
 
+// Increase RNG_MODEL_VERSION whenever a change to the model changes the
+// subjects it simulates, so results saved by the old model are not reused
+#define RNG_MODEL_VERSION 2
+
 typedef struct rng_scores {
     double r1;
     double r2;
@@ -45,6 +49,7 @@ typedef struct rng_parameters {
     double monitoring_efficiency;
     double individual_variability;
     int    sample_size;
+    long   seed;            /* Non-zero for common random numbers (see rng_run/1) */
 } RngParameters;
 
 typedef struct rng_subject_data {
@@ -58,20 +63,46 @@ typedef struct rng_data {
     RngSubjectData subject[MAX_SUBJECTS];
     RngGroupData   group;
     double         strengths[SCHEMA_SET_SIZE];
+    int            subject_base;    /* Number of the first subject, for common random numbers */
 } RngData;
 
+typedef struct rng_group_sums {
+    RngScores sum;
+    RngScores ssq;
+    int n;
+} RngGroupSums;
+
+typedef struct rng_evaluation {
+    double  fit;            /* Estimated fit, as rng_data_calculate_fit/2     */
+    double  lower;          /* Confidence interval for the fit                */
+    double  upper;
+    int     n;              /* Number of subjects the estimate is based on    */
+    int     simulated;      /* Number of them simulated by this evaluation    */
+    Boolean rejected;       /* Stopped early as clearly worse than incumbent  */
+} RngEvaluation;
+
 extern RngGroupData subject_ctl, subject_ds, subject_2b, subject_gng;
 
 extern void rng_analyse_group_data(RngData *task_data);
+extern void rng_group_sums_initialise(RngGroupSums *sums);
+extern void rng_group_sums_add(RngGroupSums *sums, RngScores *scores);
+extern void rng_group_sums_to_group_data(RngGroupSums *sums, RngGroupData *group);
 extern void rng_print_group_data_analysis(FILE *fp, RngData *task_data);
 extern void rng_print_scores(FILE *fp, RngScores *scores);
 extern void rng_print_subject_sequence(FILE *fp, RngSubjectData *subject);
 extern void rng_analyse_subject_responses(FILE *fp, RngSubjectData *subject, int num_trials);
+extern void rng_score_subject_data(RngSubjectData *subject, int trials);
+extern int select_from_probability_distribution(double weights[SCHEMA_SET_SIZE], double temperature);
 extern Boolean rng_create(OosVars *gv, RngParameters *pars);
+extern Boolean rng_model_create(OosVars *gv, RngParameters *pars, Boolean diagram);
+extern Boolean rng_model_reset(OosVars *gv, RngParameters *pars);
 extern void rng_initialise_subject(OosVars *gv);
 extern void rng_globals_destroy(RngData *task_data);
 extern void rng_run(OosVars *gv);
+extern void rng_run_checkpointed(OosVars *gv, char *filename, int interval);
 extern void rng_scores_convert_to_z(RngGroupData *raw_data, RngGroupData *baseline, RngGroupData *z_scores);
-extern double rng_data_calculate_fit(RngGroupData *data, RngGroupData *model);
+extern double rng_data_calculate_fit(RngGroupData *model, RngGroupData *data);
+extern double rng_evaluate(OosVars *gv, RngParameters *pars, RngGroupData *target, double incumbent, RngEvaluation *evaluation);
+extern double rng_evaluate_continue(OosVars *gv, RngParameters *pars, RngGroupData *target, double incumbent, RngGroupSums *sums, RngEvaluation *evaluation);
 
 #endif
@@ -1,4 +1,5 @@
 
+#include <string.h>
 #include "rng.h"
 
 RngGroupData subject_ctl = {{0.96236, 45.63603, 84.88786, 0.30043, 0.21936, 0.01361, 0.25861, 0.13139, 0.73342, 9.71256, 8.80556, {0.01361, 0.14778, 0.11639, 0.10556, 0.11333, 0.13139, 0.09056, 0.08778, 0.08278, 0.11083}},
@@ -52,7 +53,7 @@ double calculate_mean(int list[], int i)
     return(sum / (double) i);
 }
 
-static void rng_score_subject_data(RngSubjectData *subject, int trials)
+void rng_score_subject_data(RngSubjectData *subject, int trials)
 {
     /* Read a data file and return the various RNG dvs. */
     /* Also return misses (times participant failed to generate a response) */
@@ -354,6 +355,57 @@ void rng_analyse_group_data(RngData *task_data)
 
 }
 
+/*----------------------------------------------------------------------------*/
+/* Running sums of subject scores, so group data can be accumulated over runs */
+
+#define SCORES_LENGTH   (sizeof(RngScores) / sizeof(double))
+
+void rng_group_sums_initialise(RngGroupSums *sums)
+{
+    memset(sums, 0, sizeof(RngGroupSums));
+}
+
+void rng_group_sums_add(RngGroupSums *sums, RngScores *scores)
+{
+    // RngScores is all doubles, so treat it as an array of them:
+
+    double *x = (double *) scores;
+    double *sum = (double *) &(sums->sum);
+    double *ssq = (double *) &(sums->ssq);
+    int k;
+
+    for (k = 0; k < SCORES_LENGTH; k++) {
+        sum[k] += x[k];
+        ssq[k] += x[k] * x[k];
+    }
+    sums->n++;
+}
+
+void rng_group_sums_to_group_data(RngGroupSums *sums, RngGroupData *group)
+{
+    // As rng_analyse_group_data/1: means are set only if n > 0, and standard
+    // deviations only if n > 1
+
+    double *sum = (double *) &(sums->sum);
+    double *ssq = (double *) &(sums->ssq);
+    double *mean = (double *) &(group->mean);
+    double *sd = (double *) &(group->sd);
+    double n = (double) sums->n;
+    int k;
+
+    group->n = sums->n;
+    for (k = 0; k < SCORES_LENGTH; k++) {
+        if (sums->n > 0) {
+            mean[k] = sum[k] / n;
+        }
+        if (sums->n > 1) {
+            sd[k] = sqrt(MAX(ssq[k] - (sum[k]*sum[k] / n), 0.0) / (n - 1));
+        }
+    }
+}
+
+/*----------------------------------------------------------------------------*/
+
 void rng_print_group_data_analysis(FILE *fp, RngData *task_data)
 {
     if (fp != NULL) {
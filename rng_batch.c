@@ -0,0 +1,319 @@
+/* Run a batch of model configurations, listed in a manifest, in one process */
+
+#include <string.h>
+#include <ctype.h>
+#include "rng.h"
+#include "rng_defaults.h"
+#include "lib_math.h"
+#include "lib_thread.h"
+
+/******************************************************************************/
+/* The manifest:
+
+One job per line, as whitespace-separated key=value pairs. Blank lines and
+lines starting with # are ignored. Any parameter not given takes its value
+from rng_defaults.h. For example:
+
+  wm_decay_rate=30 monitoring_efficiency=0.65 sample_size=360 seed=1 target=ctl output=ctl_30.txt
+
+Keys are the RngParameters fields (wm_decay_rate, wm_update_efficiency,
+selection_temperature, switch_rate, monitoring_method, monitoring_efficiency,
+individual_variability, sample_size, seed), plus:
+
+  target    Dataset to report the fit to: ctl, ds, 2b or gng (default none)
+  output    File for the job's results (default BATCH_<line>.txt)
+
+The model variant is selected by monitoring_method. A non-zero seed makes a
+job reproducible (see rng_run/1).
+
+One model is built for each worker thread (all on the main thread, before the
+workers start), and the worker resets it for each job it takes, so model
+construction is paid once per worker rather than once per job.
+
+The runner exits with status 2 if any job failed, so a script can detect a
+bad batch.
+
+*******************************************************************************/
+
+#define MANIFEST_FILE   "BATCH.manifest"
+#define LINE_LENGTH     1024
+#define PATH_LENGTH     256
+
+typedef struct batch_job {
+    int            line;
+    RngParameters  pars;
+    RngGroupData  *target;
+    char          *target_name;
+    char           output[PATH_LENGTH];
+    double         fit;
+    Boolean        done;
+} BatchJob;
+
+typedef struct batch {
+    BatchJob      *job;
+    int            n;
+    volatile int   next;
+    unsigned long  seed;
+    OosVars       *gv[THREAD_MAX];
+} Batch;
+
+/******************************************************************************/
+
+static Boolean parse_long(const char *text, long *value)
+{
+    char *end;
+
+    *value = strtol(text, &end, 10);
+    return((end != text) && (*end == '\0'));
+}
+
+static Boolean parse_double(const char *text, double *value)
+{
+    char *end;
+
+    *value = strtod(text, &end);
+    return((end != text) && (*end == '\0'));
+}
+
+static Boolean batch_job_set(BatchJob *job, const char *key, const char *value)
+{
+    // Set one field of the job; FALSE if the key or value is not valid
+
+    long l;
+
+    if (strcmp(key, "wm_decay_rate") == 0) {
+        if (!parse_long(value, &l) || (l < 1)) {
+            return(FALSE);
+        }
+        job->pars.wm_decay_rate = (int) l;
+        return(TRUE);
+    }
+    else if (strcmp(key, "wm_update_efficiency") == 0) {
+        return(parse_double(value, &(job->pars.wm_update_efficiency)));
+    }
+    else if (strcmp(key, "selection_temperature") == 0) {
+        return(parse_double(value, &(job->pars.selection_temperature)));
+    }
+    else if (strcmp(key, "switch_rate") == 0) {
+        return(parse_double(value, &(job->pars.switch_rate)));
+    }
+    else if (strcmp(key, "monitoring_method") == 0) {
+        if (!parse_long(value, &l) || (l < 0)) {
+            return(FALSE);
+        }
+        job->pars.monitoring_method = (int) l;
+        return(TRUE);
+    }
+    else if (strcmp(key, "monitoring_efficiency") == 0) {
+        return(parse_double(value, &(job->pars.monitoring_efficiency)));
+    }
+    else if (strcmp(key, "individual_variability") == 0) {
+        return(parse_double(value, &(job->pars.individual_variability)) && (job->pars.individual_variability >= 0.0));
+    }
+    else if (strcmp(key, "sample_size") == 0) {
+        if (!parse_long(value, &l) || (l < 1) || (l > MAX_SUBJECTS)) {
+            return(FALSE);
+        }
+        job->pars.sample_size = (int) l;
+        return(TRUE);
+    }
+    else if (strcmp(key, "seed") == 0) {
+        return(parse_long(value, &(job->pars.seed)));
+    }
+    else if (strcmp(key, "target") == 0) {
+        if (strcmp(value, "ctl") == 0) {
+            job->target = &subject_ctl;
+        }
+        else if (strcmp(value, "ds") == 0) {
+            job->target = &subject_ds;
+        }
+        else if (strcmp(value, "2b") == 0) {
+            job->target = &subject_2b;
+        }
+        else if (strcmp(value, "gng") == 0) {
+            job->target = &subject_gng;
+        }
+        else {
+            return(FALSE);
+        }
+        free(job->target_name);
+        job->target_name = string_copy(value);
+        return(TRUE);
+    }
+    else if (strcmp(key, "output") == 0) {
+        g_snprintf(job->output, PATH_LENGTH, "%s", value);
+        return(value[0] != '\0');
+    }
+    else {
+        return(FALSE);
+    }
+}
+
+static Boolean batch_job_parse(BatchJob *job, char *buffer, int line)
+{
+    // Parse one manifest line. The buffer is modified.
+
+    char *token, *value, *save = NULL;
+
+    job->line = line;
+    job->pars = pars;
+    job->target = NULL;
+    job->target_name = NULL;
+    job->fit = 0.0;
+    job->done = FALSE;
+    g_snprintf(job->output, PATH_LENGTH, "BATCH_%d.txt", line);
+
+    for (token = strtok_r(buffer, " \t\r\n", &save); token != NULL; token = strtok_r(NULL, " \t\r\n", &save)) {
+        if ((value = strchr(token, '=')) == NULL) {
+            fprintf(stdout, "WARNING: Manifest line %d: expected key=value, found \"%s\"\n", line, token);
+            return(FALSE);
+        }
+        *value++ = '\0';
+        if (!batch_job_set(job, token, value)) {
+            fprintf(stdout, "WARNING: Manifest line %d: invalid %s \"%s\"\n", line, token, value);
+            return(FALSE);
+        }
+    }
+    return(TRUE);
+}
+
+static int batch_read_manifest(const char *filename, BatchJob **jobs)
+{
+    // Returns the number of valid jobs (invalid lines are reported and
+    // skipped), or -1 if the manifest cannot be read
+
+    char buffer[LINE_LENGTH];
+    BatchJob *job = NULL, *tmp;
+    int n = 0, capacity = 0, line = 0;
+    FILE *fp;
+    char *c;
+
+    if ((fp = fopen(filename, "r")) == NULL) {
+        fprintf(stdout, "WARNING: Cannot read manifest %s\n", filename);
+        return(-1);
+    }
+    while (fgets(buffer, LINE_LENGTH, fp) != NULL) {
+        line++;
+        for (c = buffer; isspace((int) *c); c++);
+        if ((*c == '\0') || (*c == '#')) {
+            continue;
+        }
+        if (n == capacity) {
+            capacity = (capacity == 0) ? 64 : 2 * capacity;
+            if ((tmp = (BatchJob *)realloc(job, capacity * sizeof(BatchJob))) == NULL) {
+                fprintf(stdout, "WARNING: Out of memory reading manifest %s\n", filename);
+                break;
+            }
+            job = tmp;
+        }
+        if (batch_job_parse(&job[n], c, line)) {
+            n++;
+        }
+        else {
+            free(job[n].target_name);
+        }
+    }
+    fclose(fp);
+    *jobs = job;
+    return(n);
+}
+
+/******************************************************************************/
+
+static void batch_job_run(OosVars *gv, BatchJob *job)
+{
+    RngData *task_data;
+    FILE *fp;
+
+    rng_model_reset(gv, &(job->pars));
+    rng_run(gv);
+    task_data = (RngData *)gv->task_data;
+    rng_analyse_group_data(task_data);
+
+    if (job->target != NULL) {
+        job->fit = rng_data_calculate_fit(&(task_data->group), job->target);
+    }
+    if ((fp = fopen(job->output, "w")) == NULL) {
+        fprintf(stdout, "WARNING: Cannot write %s (manifest line %d)\n", job->output, job->line);
+        return;
+    }
+    fprintf(fp, "Parameters: [Decay: %d, Update: %5.3f, Temperature: %5.3f, Switch: %5.3f, Method: %d, Monitoring: %5.3f, Variability: %5.3f]\n", job->pars.wm_decay_rate, job->pars.wm_update_efficiency, job->pars.selection_temperature, job->pars.switch_rate, job->pars.monitoring_method, job->pars.monitoring_efficiency, job->pars.individual_variability);
+    fprintf(fp, "Subjects: %d; Seed: %ld\n", task_data->group.n, job->pars.seed);
+    if (job->target != NULL) {
+        fprintf(fp, "Fit to %s: %f\n", job->target_name, job->fit);
+    }
+    fprintf(fp, "\n");
+    rng_print_group_data_analysis(fp, task_data);
+    fclose(fp);
+    job->done = TRUE;
+}
+
+static void batch_worker(int thread_id, void *data)
+{
+    Batch *batch = (Batch *)data;
+    int i;
+
+    /* Jobs without a seed draw from the thread's own stream: */
+    random_seed(batch->seed + thread_id);
+    while ((i = thread_claim(&(batch->next))) < batch->n) {
+        batch_job_run(batch->gv[thread_id], &(batch->job[i]));
+        if (batch->job[i].target != NULL) {
+            fprintf(stdout, "Line %4d: %s (fit to %s: %f)\n", batch->job[i].line, batch->job[i].output, batch->job[i].target_name, batch->job[i].fit);
+        }
+        else {
+            fprintf(stdout, "Line %4d: %s\n", batch->job[i].line, batch->job[i].output);
+        }
+    }
+}
+
+/******************************************************************************/
+
+int main(int argc, char **argv)
+{
+    static Batch batch;
+    char *manifest = (argc > 1) ? argv[1] : MANIFEST_FILE;
+    int i, n_threads, failed = 0;
+
+    if ((batch.n = batch_read_manifest(manifest, &(batch.job))) <= 0) {
+        fprintf(stdout, "ABORTING: No jobs to run in %s\n", manifest);
+        exit(1);
+    }
+
+    n_threads = MIN(thread_count(), batch.n);
+    fprintf(stdout, "Running %d jobs from %s with %d threads\n", batch.n, manifest, n_threads);
+
+    for (i = 0; i < n_threads; i++) {
+        if ((batch.gv[i] = oos_globals_create()) == NULL) {
+            fprintf(stdout, "ABORTING: Cannot allocate global variable space\n");
+            break;
+        }
+        else if (!rng_model_create(batch.gv[i], &pars, FALSE)) {
+            fprintf(stdout, "ABORTING: Cannot create RNG\n");
+            break;
+        }
+        oos_trace_open_from_environment(batch.gv[i], i);
+    }
+    if (i == n_threads) {
+        batch.seed = (unsigned long) random_integer(0, 1 << 30);
+        batch.next = 0;
+        thread_parallel_run(n_threads, batch_worker, &batch);
+    }
+
+    for (i = 0; i < batch.n; i++) {
+        failed += (batch.job[i].done ? 0 : 1);
+        free(batch.job[i].target_name);
+    }
+    if (failed > 0) {
+        fprintf(stdout, "WARNING: %d of %d jobs failed\n", failed, batch.n);
+    }
+    for (i = 0; i < n_threads; i++) {
+        if (batch.gv[i] != NULL) {
+            rng_globals_destroy((RngData *)batch.gv[i]->task_data);
+            oos_globals_destroy(batch.gv[i]);
+        }
+    }
+    free(batch.job);
+    exit(failed > 0 ? 2 : 1);
+}
+
+/******************************************************************************/
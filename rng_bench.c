@@ -0,0 +1,290 @@
+/* Micro-benchmarks of the term layer, the OOS engine and the RNG model */
+
+#include <string.h>
+#include <time.h>
+#include "rng.h"
+#include "rng_defaults.h"
+#include "lib_math.h"
+
+// Each benchmark is run for at least BENCH_MIN_TIME seconds, BENCH_REPEATS
+// times, and the fastest repeat is reported (the minimum is the least noisy
+// estimate of the true cost). The random number generator is reseeded with
+// BENCH_SEED before every repeat, so each repeat does the same work.
+//
+// With glibc, allocations are counted by replacing malloc() and friends with
+// versions that count calls before passing them on to glibc's __libc_*
+// functions. This counts allocations made anywhere in the process, glib
+// included. Other C libraries have no such entry points, so there only
+// clauses are counted, with the term layer's own counter.
+
+#define BENCH_MIN_TIME  0.2
+#define BENCH_REPEATS   5
+#define BENCH_SEED      1234
+
+/******************************************************************************/
+/* Counting allocations: ******************************************************/
+
+#ifdef __GLIBC__
+
+#define ALLOCATIONS_LABEL "Allocations"
+
+#ifdef MALLOC_CHECK
+#undef malloc
+#undef calloc
+#undef realloc
+#undef free
+#endif
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void  __libc_free(void *ptr);
+
+static long allocations = 0;
+
+void *malloc(size_t size)
+{
+    allocations++;
+    return(__libc_malloc(size));
+}
+
+void *calloc(size_t n, size_t size)
+{
+    allocations++;
+    return(__libc_calloc(n, size));
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    allocations++;
+    return(__libc_realloc(ptr, size));
+}
+
+void free(void *ptr)
+{
+    __libc_free(ptr);
+}
+
+static long bench_allocations()
+{
+    return(allocations);
+}
+
+#else
+
+#define ALLOCATIONS_LABEL "Clause allocations"
+
+static long bench_allocations()
+{
+    return(pl_clause_allocations);
+}
+
+#endif
+
+/******************************************************************************/
+/* The harness: ***************************************************************/
+
+typedef struct bench_state {
+    OosVars       *gv;
+    ClauseType    *clause;
+    ClauseType    *template;
+    RngSubjectData subject;
+    double         weights[SCHEMA_SET_SIZE];
+} BenchState;
+
+static double bench_clock()
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return(t.tv_sec + t.tv_nsec * 1e-9);
+}
+
+static void bench_run(char *name, void (*function)(BenchState *, long), BenchState *state)
+{
+    double best_ns = DBL_MAX, best_allocs = 0.0;
+    long iterations = 1;
+    int r;
+
+    /* Find an iteration count that takes at least BENCH_MIN_TIME: */
+    for (;;) {
+        double start = bench_clock();
+        random_seed(BENCH_SEED);
+        function(state, iterations);
+        if (bench_clock() - start >= BENCH_MIN_TIME) {
+            break;
+        }
+        iterations *= 2;
+    }
+    for (r = 0; r < BENCH_REPEATS; r++) {
+        double start, elapsed;
+        long before = bench_allocations();
+
+        random_seed(BENCH_SEED);
+        start = bench_clock();
+        function(state, iterations);
+        elapsed = bench_clock() - start;
+        if (elapsed * 1e9 / iterations < best_ns) {
+            best_ns = elapsed * 1e9 / iterations;
+            best_allocs = (bench_allocations() - before) / (double) iterations;
+        }
+    }
+    fprintf(stdout, "%-40s %12.1f ns/op %10.2f allocs/op\n", name, best_ns, best_allocs);
+}
+
+/******************************************************************************/
+/* The benchmarks: ************************************************************/
+
+static void bench_clause_make_from_string(BenchState *state, long n)
+{
+    long i;
+
+    for (i = 0; i < n; i++) {
+        pl_clause_free(pl_clause_make_from_string("response(7, schema(plus_one, selected))."));
+    }
+}
+
+static void bench_clause_copy_free(BenchState *state, long n)
+{
+    long i;
+
+    for (i = 0; i < n; i++) {
+        pl_clause_free(pl_clause_copy(state->clause));
+    }
+}
+
+static void bench_unify_terms(BenchState *state, long n)
+{
+    long i;
+
+    for (i = 0; i < n; i++) {
+        pl_clause_free(unify_terms(state->template, state->clause));
+    }
+}
+
+static void bench_oos_match(BenchState *state, long n)
+{
+    long i;
+
+    for (i = 0; i < n; i++) {
+        oos_match(state->gv, 1, state->template);
+    }
+}
+
+static void bench_oos_step(BenchState *state, long n)
+{
+    // One op is one cycle of the RNG model. Subjects are started as rng_run/1
+    // does, and the experiment is restarted when all subjects are done. The
+    // group size is kept up to date as rng_run/1 does, so that
+    // rng_model_reset/2 clears the responses of every subject.
+
+    RngData *task_data = (RngData *)state->gv->task_data;
+    long i;
+
+    for (i = 0; i < n; i++) {
+        if (!oos_step(state->gv)) {
+            oos_step_block(state->gv);
+            task_data->group.n = state->gv->block;
+            if (state->gv->block >= state->gv->subjects_per_experiment) {
+                rng_model_reset(state->gv, &pars);
+            }
+            oos_initialise_trial(state->gv);
+            rng_initialise_subject(state->gv);
+        }
+    }
+}
+
+static void bench_select_from_probability_distribution(BenchState *state, long n)
+{
+    long i;
+
+    for (i = 0; i < n; i++) {
+        select_from_probability_distribution(state->weights, 1.0);
+    }
+}
+
+static void bench_rng_score_subject_data(BenchState *state, long n)
+{
+    long i;
+
+    for (i = 0; i < n; i++) {
+        rng_score_subject_data(&(state->subject), state->subject.n);
+    }
+}
+
+/******************************************************************************/
+
+static void bench_oos_match_buffers(BenchState *state)
+{
+    // A buffer of size items, item(0) ... item(size-1), searched for the
+    // middle item under each access mode
+
+    static char *access_name[] = {"random", "lifo", "fifo"};
+    int sizes[] = {1, 10, 100, 1000};
+    char buffer[64];
+    int s, a, k;
+
+    for (s = 0; s < 4; s++) {
+        for (a = BUFFER_ACCESS_RANDOM; a <= BUFFER_ACCESS_FIFO; a++) {
+            state->gv = oos_globals_create();
+            oos_buffer_create(state->gv, "Buffer", 1, 0.5, 0.5, BUFFER_DECAY_NONE, 0, BUFFER_CAPACITY_UNLIMITED, 0, BUFFER_EXCESS_IGNORE, (BufferAccessProp) a);
+            for (k = 0; k < sizes[s]; k++) {
+                g_snprintf(buffer, 64, "item(%d).", k);
+                oos_buffer_create_element(state->gv, 1, buffer, 1.0);
+            }
+            g_snprintf(buffer, 64, "item(%d).", sizes[s] / 2);
+            state->template = pl_clause_make_from_string(buffer);
+            g_snprintf(buffer, 64, "oos_match (%d, %s)", sizes[s], access_name[a]);
+            bench_run(buffer, bench_oos_match, state);
+            pl_clause_free(state->template);
+            oos_globals_destroy(state->gv);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    static BenchState state;
+    RngData *task_data;
+    int i;
+
+    fprintf(stdout, "%-40s %15s %20s\n", "Benchmark", "Time", ALLOCATIONS_LABEL);
+
+    /* The term layer: */
+    state.clause = pl_clause_make_from_string("response(7, schema(plus_one, selected)).");
+    state.template = pl_clause_make_from_string("response(X, schema(Y, selected)).");
+    bench_run("pl_clause_make_from_string", bench_clause_make_from_string, &state);
+    bench_run("pl_clause_copy + pl_clause_free", bench_clause_copy_free, &state);
+    bench_run("unify_terms", bench_unify_terms, &state);
+    pl_clause_free(state.template);
+    pl_clause_free(state.clause);
+
+    /* Buffer matching: */
+    bench_oos_match_buffers(&state);
+
+    /* The RNG model: */
+    state.gv = oos_globals_create();
+    random_seed(BENCH_SEED);
+    rng_model_create(state.gv, &pars, FALSE);
+    oos_initialise_trial(state.gv);
+    rng_initialise_subject(state.gv);
+    bench_run("oos_step (RNG model)", bench_oos_step, &state);
+
+    /* A typical subject's responses, for scoring: */
+    rng_model_reset(state.gv, &pars);
+    state.gv->subjects_per_experiment = 1;
+    rng_run(state.gv);
+    task_data = (RngData *)state.gv->task_data;
+    state.subject = task_data->subject[0];
+    for (i = 0; i < SCHEMA_SET_SIZE; i++) {
+        state.weights[i] = task_data->strengths[i];
+    }
+    bench_run("select_from_probability_distribution", bench_select_from_probability_distribution, &state);
+    bench_run("rng_score_subject_data", bench_rng_score_subject_data, &state);
+
+    rng_globals_destroy(task_data);
+    oos_globals_destroy(state.gv);
+    exit(1);
+}
+
+/******************************************************************************/
@@ -0,0 +1,216 @@
+/* A cache of simulated subjects for each parameter tuple evaluated */
+
+#include <string.h>
+#include "rng_cache.h"
+
+/******************************************************************************/
+
+static int64_t cache_quantise(double x)
+{
+    return((int64_t) llround(x / CACHE_QUANTUM));
+}
+
+static void cache_key_set(RngCacheKey *key, OosVars *gv, RngParameters *pars)
+{
+    // sample_size is not part of the key: it limits how many subjects are
+    // simulated in one evaluation, but does not affect their scores.
+
+    key->wm_decay_rate = pars->wm_decay_rate;
+    key->wm_update_efficiency = cache_quantise(pars->wm_update_efficiency);
+    key->selection_temperature = cache_quantise(pars->selection_temperature);
+    key->switch_rate = cache_quantise(pars->switch_rate);
+    key->monitoring_method = pars->monitoring_method;
+    key->monitoring_efficiency = cache_quantise(pars->monitoring_efficiency);
+    key->individual_variability = cache_quantise(pars->individual_variability);
+    key->seed = pars->seed;
+    key->trials_per_subject = gv->trials_per_subject;
+}
+
+static guint cache_key_hash(gconstpointer key)
+{
+    // FNV-1a over the bytes of the key (which has no padding)
+
+    const unsigned char *p = (const unsigned char *) key;
+    guint h = 2166136261u;
+    int i;
+
+    for (i = 0; i < sizeof(RngCacheKey); i++) {
+        h = (h ^ p[i]) * 16777619u;
+    }
+    return(h);
+}
+
+static gboolean cache_key_equal(gconstpointer a, gconstpointer b)
+{
+    return(memcmp(a, b, sizeof(RngCacheKey)) == 0);
+}
+
+static RngCacheEntry *cache_entry_add(RngCache *cache, RngCacheKey *key)
+{
+    RngCacheEntry *entry;
+
+    if ((entry = (RngCacheEntry *)malloc(sizeof(RngCacheEntry))) != NULL) {
+        entry->key = *key;
+        rng_group_sums_initialise(&(entry->sums));
+        g_hash_table_insert(cache->table, &(entry->key), entry);
+    }
+    return(entry);
+}
+
+/******************************************************************************/
+
+RngCache *rng_cache_create()
+{
+    RngCache *cache;
+
+    if ((cache = (RngCache *)malloc(sizeof(RngCache))) != NULL) {
+        cache->table = g_hash_table_new_full(cache_key_hash, cache_key_equal, NULL, free);
+        cache->hits = 0;
+        cache->misses = 0;
+    }
+    return(cache);
+}
+
+void rng_cache_free(RngCache *cache)
+{
+    if (cache != NULL) {
+        g_hash_table_destroy(cache->table);
+        free(cache);
+    }
+}
+
+RngGroupSums *rng_cache_lookup(RngCache *cache, OosVars *gv, RngParameters *pars)
+{
+    // Return the sums for the parameters, adding an empty entry if there is
+    // none. Returns NULL only if memory is exhausted.
+
+    RngCacheEntry *entry;
+    RngCacheKey key;
+
+    cache_key_set(&key, gv, pars);
+    if ((entry = (RngCacheEntry *)g_hash_table_lookup(cache->table, &key)) == NULL) {
+        entry = cache_entry_add(cache, &key);
+    }
+    return(entry == NULL ? NULL : &(entry->sums));
+}
+
+double rng_cache_evaluate(RngCache *cache, OosVars *gv, RngParameters *pars, RngGroupData *target, double incumbent, RngEvaluation *evaluation)
+{
+    // As rng_evaluate/5, but continuing from (and adding to) any subjects
+    // already simulated with the parameters
+
+    RngGroupSums *sums;
+
+    if ((cache == NULL) || ((sums = rng_cache_lookup(cache, gv, pars)) == NULL)) {
+        return(rng_evaluate(gv, pars, target, incumbent, evaluation));
+    }
+    if (sums->n > 0) {
+        cache->hits++;
+    }
+    else {
+        cache->misses++;
+    }
+    return(rng_evaluate_continue(gv, pars, target, incumbent, sums, evaluation));
+}
+
+/******************************************************************************/
+
+RngCache *rng_cache_read_from_file(const char *filename)
+{
+    // Returns an empty cache if the file does not exist or was made by another
+    // version of the model, and NULL if it exists but cannot be read.
+
+    RngCacheHeader header;
+    RngCacheEntry entry;
+    RngCache *cache;
+    FILE *fp;
+    long i;
+
+    if ((cache = rng_cache_create()) == NULL) {
+        return(NULL);
+    }
+    if ((fp = fopen(filename, "rb")) == NULL) {
+        return(cache);
+    }
+    if ((fread(&header, sizeof(RngCacheHeader), 1, fp) != 1) || (strncmp(header.magic, CACHE_MAGIC, 8) != 0)) {
+        fprintf(stdout, "WARNING: %s is not a fit cache file\n", filename);
+    }
+    else if ((header.version != CACHE_VERSION) || (header.entry_size != sizeof(RngCacheEntry))) {
+        fprintf(stdout, "WARNING: Fit cache file %s has an incompatible format\n", filename);
+    }
+    else if (header.model_version != RNG_MODEL_VERSION) {
+        fprintf(stdout, "WARNING: Fit cache file %s is from model version %d; ignoring it\n", filename, (int) header.model_version);
+        fclose(fp);
+        return(cache);
+    }
+    else {
+        for (i = 0; i < header.entries; i++) {
+            RngCacheEntry *copy;
+
+            if (fread(&entry, sizeof(RngCacheEntry), 1, fp) != 1) {
+                fprintf(stdout, "WARNING: Fit cache file %s is truncated\n", filename);
+                break;
+            }
+            if ((copy = cache_entry_add(cache, &(entry.key))) != NULL) {
+                copy->sums = entry.sums;
+            }
+        }
+        if (i == header.entries) {
+            fclose(fp);
+            return(cache);
+        }
+    }
+    fclose(fp);
+    rng_cache_free(cache);
+    return(NULL);
+}
+
+static void cache_entry_write(gpointer key, gpointer value, gpointer data)
+{
+    FILE **fp = (FILE **) data;
+
+    if ((*fp != NULL) && (fwrite(value, sizeof(RngCacheEntry), 1, *fp) != 1)) {
+        fclose(*fp);
+        *fp = NULL;
+    }
+}
+
+Boolean rng_cache_write_to_file(RngCache *cache, const char *filename)
+{
+    // The cache is written to a temporary file which is then renamed, so an
+    // interrupted write never destroys the previous copy.
+
+    RngCacheHeader header;
+    char tmp_file[1024];
+    Boolean ok;
+    FILE *fp;
+
+    memset(&header, 0, sizeof(RngCacheHeader));
+    strncpy(header.magic, CACHE_MAGIC, 8);
+    header.version = CACHE_VERSION;
+    header.entry_size = sizeof(RngCacheEntry);
+    header.model_version = RNG_MODEL_VERSION;
+    header.entries = g_hash_table_size(cache->table);
+
+    g_snprintf(tmp_file, 1024, "%s.tmp", filename);
+    if ((fp = fopen(tmp_file, "wb")) == NULL) {
+        fprintf(stdout, "WARNING: Cannot open %s for writing\n", tmp_file);
+        return(FALSE);
+    }
+    if (fwrite(&header, sizeof(RngCacheHeader), 1, fp) != 1) {
+        fclose(fp);
+        fp = NULL;
+    }
+    else {
+        g_hash_table_foreach(cache->table, cache_entry_write, &fp);
+    }
+    ok = (fp != NULL) && (fclose(fp) == 0);
+    ok = ok && (rename(tmp_file, filename) == 0);
+    if (!ok) {
+        fprintf(stdout, "WARNING: Failed to write fit cache %s\n", filename);
+        remove(tmp_file);
+    }
+    return(ok);
+}
+
+/******************************************************************************/
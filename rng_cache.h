@@ -0,0 +1,73 @@
+#ifndef _rng_cache_h_
+
+#define _rng_cache_h_
+
+#include <stdint.h>
+#include "rng.h"
+
+/******************************************************************************/
+/* Fitness memoisation:
+
+The cache maps a parameter tuple to the running sums of the scores of every
+subject simulated with those parameters. The sums are independent of the
+target, so one cache serves any target. Real-valued parameters are quantised
+to CACHE_QUANTUM before lookup, so values that differ only by rounding error
+(e.g. a gradient descent step taken and then reversed) share an entry.
+
+Re-evaluating a cached tuple continues from the cached subjects, so a tuple
+that survives many generations of a search (an elite) accumulates subjects
+and its fit estimate becomes steadily more precise. With common random
+numbers the seed is part of the key, and the new subjects are numbered on
+from the cached ones (see rng_evaluate_continue/6). The number of trials per
+subject is also part of the key, as the scores depend on it.
+
+A cache file is a fixed header followed by the entries, in native byte order.
+The header records the version of the model that simulated the subjects, and
+a file from any other version is ignored.
+
+*******************************************************************************/
+
+#define CACHE_MAGIC             "RNGCACH"
+#define CACHE_VERSION           2
+#define CACHE_QUANTUM           1e-6
+
+typedef struct rng_cache_key {
+    int64_t  wm_decay_rate;
+    int64_t  wm_update_efficiency;          /* All doubles are quantised      */
+    int64_t  selection_temperature;
+    int64_t  switch_rate;
+    int64_t  monitoring_method;
+    int64_t  monitoring_efficiency;
+    int64_t  individual_variability;
+    int64_t  seed;
+    int64_t  trials_per_subject;
+} RngCacheKey;
+
+typedef struct rng_cache_entry {
+    RngCacheKey  key;
+    RngGroupSums sums;
+} RngCacheEntry;
+
+typedef struct rng_cache_header {
+    char     magic[8];
+    int32_t  version;
+    int32_t  entry_size;
+    int32_t  model_version;         /* RNG_MODEL_VERSION                */
+    int32_t  reserved;
+    int64_t  entries;
+} RngCacheHeader;
+
+typedef struct rng_cache {
+    GHashTable *table;
+    long        hits;               /* Evaluations that started from cached subjects */
+    long        misses;
+} RngCache;
+
+extern RngCache      *rng_cache_create();
+extern void           rng_cache_free(RngCache *cache);
+extern RngGroupSums  *rng_cache_lookup(RngCache *cache, OosVars *gv, RngParameters *pars);
+extern double         rng_cache_evaluate(RngCache *cache, OosVars *gv, RngParameters *pars, RngGroupData *target, double incumbent, RngEvaluation *evaluation);
+extern RngCache      *rng_cache_read_from_file(const char *filename);
+extern Boolean        rng_cache_write_to_file(RngCache *cache, const char *filename);
+
+#endif
@@ -47,16 +47,15 @@ int main(int argc, char **argv)
             do {
                 RngData *task_data;
 
-                rng_create(gv, &pars);
+                rng_model_reset(gv, &pars);
                 rng_initialise_subject(gv);
                 rng_run(gv);
                 task_data = (RngData *)gv->task_data;
                 rng_analyse_group_data(task_data);
                 fit_max = rng_data_calculate_fit(&(task_data->group), &subject_ctl);
-                rng_globals_destroy(task_data);
-                gv->task_data = NULL;
             } while (server_next_hit(pid) > 0);
         }
+        rng_globals_destroy((RngData *)gv->task_data);
     }
     oos_globals_destroy(gv);
     server_free();
@@ -6,6 +6,7 @@
 //    double monitoring_efficiency;
 //    double individual_variability;
 //    int    sample_size;
+//    long   seed;
 
 //RngParameters pars = {15, 1.00, 1.00, 1.00, 0, 1.00, 0.50, 36};
 RngParameters pars = {30, 1.00, 1.00, 1.00, 0, 0.65, 0.50, 36};
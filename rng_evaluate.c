@@ -0,0 +1,115 @@
+/* Evaluate the fit of a set of parameters with as few subjects as possible */
+
+#include <string.h>
+#include "rng.h"
+
+// Subjects are simulated EVALUATE_BATCH at a time, up to the sample size in
+// the parameters. After each batch the standard error of each group mean is
+// used to put a confidence interval (of +/- EVALUATE_Z standard errors) on the
+// fit. Simulation stops when the interval is narrower than +/-
+// EVALUATE_PRECISION, or the candidate is clearly worse than the incumbent.
+// (With subject sds similar to the target's, 360 subjects give about +/- 0.10.)
+
+#define EVALUATE_BATCH          12
+#define EVALUATE_MIN_SUBJECTS   24
+#define EVALUATE_Z              2.0
+#define EVALUATE_PRECISION      0.10
+
+/******************************************************************************/
+
+static void evaluate_term(double target_mean, double target_sd, double mean, double sd, int n, double *fit, double *lower, double *upper, double *precision)
+{
+    // One DV's contribution to the fit (see rng_data_calculate_fit/2), with
+    // its confidence interval. The fit is the largest such term.
+
+    double d = fabs(target_mean - mean);
+    double e = EVALUATE_Z * sd / sqrt((double) n);
+
+    *fit = MAX(*fit, d / target_sd);
+    *lower = MAX(*lower, MAX(d - e, 0.0) / target_sd);
+    *upper = MAX(*upper, (d + e) / target_sd);
+    *precision = MAX(*precision, e / target_sd);
+}
+
+static void evaluate_sums(RngGroupData *target, RngGroupSums *sums, double incumbent, RngEvaluation *e, double *precision)
+{
+    RngGroupData group;
+
+    memset(&group, 0, sizeof(RngGroupData));
+    rng_group_sums_to_group_data(sums, &group);
+
+    e->n = group.n;
+    e->fit = e->lower = e->upper = 0.0;
+    *precision = 0.0;
+    evaluate_term(target->mean.r1, target->sd.r1, group.mean.r1, group.sd.r1, e->n, &e->fit, &e->lower, &e->upper, precision);
+    evaluate_term(target->mean.rng, target->sd.rng, group.mean.rng, group.sd.rng, e->n, &e->fit, &e->lower, &e->upper, precision);
+    evaluate_term(target->mean.tpi, target->sd.tpi, group.mean.tpi, group.sd.tpi, e->n, &e->fit, &e->lower, &e->upper, precision);
+    evaluate_term(target->mean.oa, target->sd.oa, group.mean.oa, group.sd.oa, e->n, &e->fit, &e->lower, &e->upper, precision);
+    evaluate_term(target->mean.aa, target->sd.aa, group.mean.aa, group.sd.aa, e->n, &e->fit, &e->lower, &e->upper, precision);
+    evaluate_term(target->mean.rr, target->sd.rr, group.mean.rr, group.sd.rr, e->n, &e->fit, &e->lower, &e->upper, precision);
+    e->rejected = (e->lower > incumbent);
+}
+
+double rng_evaluate(OosVars *gv, RngParameters *pars, RngGroupData *target, double incumbent, RngEvaluation *evaluation)
+{
+    // Return the fit of the parameters to the target, simulating only as many
+    // subjects as needed. A candidate whose fit is certainly worse (larger)
+    // than incumbent is rejected early; pass DBL_MAX if there is none.
+    // evaluation (if not NULL) is filled in with the details. On return the
+    // group data in the task data are for the subjects the fit is based on.
+
+    RngGroupSums sums;
+
+    rng_group_sums_initialise(&sums);
+    return(rng_evaluate_continue(gv, pars, target, incumbent, &sums, evaluation));
+}
+
+double rng_evaluate_continue(OosVars *gv, RngParameters *pars, RngGroupData *target, double incumbent, RngGroupSums *sums, RngEvaluation *evaluation)
+{
+    // As rng_evaluate/5, but starting from the subjects already summed in
+    // sums (e.g. from an earlier evaluation of the same parameters), to which
+    // the subjects simulated now are added. If sums already meet the stopping
+    // rule nothing is simulated. Otherwise up to the sample size of new
+    // subjects are simulated, numbered on from those in sums so that with
+    // common random numbers they are new subjects and not repeats. The group
+    // data are for all the subjects in sums, simulated now or not.
+
+    RngEvaluation e;
+    RngData *task_data;
+    double precision;
+    int max_subjects, first, i, n0 = sums->n;
+
+    rng_model_reset(gv, pars);
+    task_data = (RngData *)gv->task_data;
+    task_data->subject_base = sums->n;
+    max_subjects = MIN(gv->subjects_per_experiment, MAX_SUBJECTS);
+
+    memset(&e, 0, sizeof(RngEvaluation));
+    while (TRUE) {
+        if (sums->n > 0) {
+            evaluate_sums(target, sums, incumbent, &e, &precision);
+            if ((e.n >= EVALUATE_MIN_SUBJECTS) && (e.rejected || (precision <= EVALUATE_PRECISION))) {
+                break;
+            }
+        }
+        if (gv->block >= max_subjects) {
+            break;
+        }
+        first = gv->block;
+        gv->subjects_per_experiment = MIN(gv->block + EVALUATE_BATCH, max_subjects);
+        rng_run(gv);
+        for (i = first; i < gv->block; i++) {
+            rng_group_sums_add(sums, &(task_data->subject[i].scores));
+        }
+    }
+    memset(&(task_data->group), 0, sizeof(RngGroupData));
+    rng_group_sums_to_group_data(sums, &(task_data->group));
+    e.simulated = sums->n - n0;
+
+    if (evaluation != NULL) {
+        *evaluation = e;
+    }
+    return(e.fit);
+}
+
+/******************************************************************************/
@@ -215,7 +215,7 @@ static void ga_print_statistics(int generation)
 
 static double rng_model_fit(OosVars *gv, RngParameters *pars)
 {
-    rng_create(gv, pars);
+    rng_model_reset(gv, pars);
     rng_initialise_subject(gv);
     rng_run(gv);
     rng_analyse_group_data((RngData *)gv->task_data);
@@ -233,6 +233,9 @@ int main(int argc, char **argv)
     if ((gv = oos_globals_create()) == NULL) {
         fprintf(stdout, "ABORTING: Cannot allocate global variable space\n");
     }
+    else if (!rng_model_create(gv, &pars, FALSE)) {
+        fprintf(stdout, "ABORTING: Cannot create RNG\n");
+    }
     else {
         fp = fopen(LOG_FILE, "w"); fclose(fp);
         for (generation = 0; generation < GENERATION_MAX; generation++) {
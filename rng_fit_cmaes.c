@@ -0,0 +1,428 @@
+/* Use CMA-ES (covariance matrix adaptation) to find best fitting parameters */
+
+#include <string.h>
+#include "rng.h"
+#include "rng_defaults.h"
+#include "lib_math.h"
+#include "lib_thread.h"
+
+// CMA-ES samples each generation from a multivariate normal distribution,
+// then moves the mean towards the best candidates and adapts the covariance
+// (and overall step size) to the directions in which progress was made. Only
+// the rank order of fits is used, so it copes well with a noisy objective.
+// The search is over the free parameters, each mapped onto [0, 1]; see
+// Hansen (2016), "The CMA evolution strategy: A tutorial", arXiv:1604.00772.
+
+#define GENERATION_MAX  100
+#define POPULATION_SIZE 12          /* Default for 5 dimensions is 8; more helps with noise */
+#define DIMENSIONS      5
+#define SIGMA_INITIAL   0.3
+#define SIGMA_MIN       1e-3        /* Stop when steps are smaller than this */
+#define BOUND_PENALTY   10.0
+
+typedef enum cmaes_dimension {
+    CMAES_WMD, CMAES_WMU, CMAES_TEMP, CMAES_SWR, CMAES_ME
+} CmaesDimension;
+
+static double dimension_min[DIMENSIONS] = { 1.0, 0.0, 0.0, 0.0, 0.0};
+static double dimension_max[DIMENSIONS] = {40.0, 1.0, 2.0, 1.0, 1.0};
+
+// Select one log file and the corresponding data file:
+
+// #define LOG_FILE "FIT_CMAES_CTRL.log"
+// #define LOG_FILE "FIT_CMAES_DS.log"
+// #define LOG_FILE "FIT_CMAES_2B.log"
+#define LOG_FILE "FIT_CMAES_GNG.log"
+
+//static RngGroupData *SUBJECT_DATA = &subject_ctl;
+// static RngGroupData *SUBJECT_DATA = &subject_ds;
+// static RngGroupData *SUBJECT_DATA = &subject_2b;
+static RngGroupData *SUBJECT_DATA = &subject_gng;
+
+// If defined, all candidates in a generation are run with the same random
+// numbers (a fresh seed each generation), so they are ranked on equal terms:
+#define COMMON_RANDOM_NUMBERS
+
+typedef struct cmaes_state {
+    double mean[DIMENSIONS];
+    double sigma;
+    double pc[DIMENSIONS];                  /* Evolution path for C          */
+    double ps[DIMENSIONS];                  /* Evolution path for sigma      */
+    double C[DIMENSIONS][DIMENSIONS];       /* Covariance matrix             */
+    double B[DIMENSIONS][DIMENSIONS];       /* Eigenvectors of C (columns)   */
+    double D[DIMENSIONS];                   /* Square roots of eigenvalues   */
+    double weight[POPULATION_SIZE];
+    int    mu;
+    double mueff, cc, cs, c1, cmu, damps, chiN;
+    int    evaluations;
+} CmaesState;
+
+typedef struct cmaes_job {
+    OosVars       *gv[THREAD_MAX];
+    RngParameters  pars[POPULATION_SIZE];
+    double         fit[POPULATION_SIZE];
+    int            subjects[POPULATION_SIZE];
+    volatile int   next;
+} CmaesJob;
+
+static double x[POPULATION_SIZE][DIMENSIONS];          /* Candidates        */
+static double para_fit[POPULATION_SIZE];               /* Penalised fits    */
+
+/******************************************************************************/
+
+static void jacobi_eigen(double a[DIMENSIONS][DIMENSIONS], double v[DIMENSIONS][DIMENSIONS], double *d)
+{
+    // Eigen-decomposition of a symmetric matrix by Jacobi rotations. a is
+    // destroyed; eigenvalues are returned in d and eigenvectors in the
+    // columns of v. With only DIMENSIONS rows this is plenty fast enough.
+
+    int i, j, k, p, q, sweep;
+
+    for (i = 0; i < DIMENSIONS; i++) {
+        for (j = 0; j < DIMENSIONS; j++) {
+            v[i][j] = (i == j) ? 1.0 : 0.0;
+        }
+    }
+    for (sweep = 0; sweep < 50; sweep++) {
+        double off = 0.0;
+
+        for (p = 0; p < DIMENSIONS; p++) {
+            for (q = p + 1; q < DIMENSIONS; q++) {
+                off += a[p][q] * a[p][q];
+            }
+        }
+        if (off < 1e-30) {
+            break;
+        }
+        for (p = 0; p < DIMENSIONS; p++) {
+            for (q = p + 1; q < DIMENSIONS; q++) {
+                double theta, t, c, s;
+
+                if (fabs(a[p][q]) < 1e-300) {
+                    continue;
+                }
+                theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+                t = ((theta >= 0) ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+                c = 1.0 / sqrt(t * t + 1.0);
+                s = t * c;
+                for (k = 0; k < DIMENSIONS; k++) {
+                    double akp = a[k][p], akq = a[k][q];
+                    a[k][p] = c * akp - s * akq;
+                    a[k][q] = s * akp + c * akq;
+                }
+                for (k = 0; k < DIMENSIONS; k++) {
+                    double apk = a[p][k], aqk = a[q][k];
+                    a[p][k] = c * apk - s * aqk;
+                    a[q][k] = s * apk + c * aqk;
+                }
+                for (k = 0; k < DIMENSIONS; k++) {
+                    double vkp = v[k][p], vkq = v[k][q];
+                    v[k][p] = c * vkp - s * vkq;
+                    v[k][q] = s * vkp + c * vkq;
+                }
+            }
+        }
+    }
+    for (i = 0; i < DIMENSIONS; i++) {
+        d[i] = a[i][i];
+    }
+}
+
+/******************************************************************************/
+
+static void cmaes_decompose(CmaesState *state)
+{
+    double a[DIMENSIONS][DIMENSIONS];
+    int i;
+
+    memcpy(a, state->C, sizeof(a));
+    jacobi_eigen(a, state->B, state->D);
+    for (i = 0; i < DIMENSIONS; i++) {
+        state->D[i] = sqrt(MAX(state->D[i], 1e-20));
+    }
+}
+
+static void cmaes_initialise(CmaesState *state, double *mean)
+{
+    double n = DIMENSIONS, sum = 0.0, ssq = 0.0;
+    int i, j;
+
+    /* Strategy parameters, as recommended by Hansen (2016): */
+    state->mu = POPULATION_SIZE / 2;
+    for (i = 0; i < state->mu; i++) {
+        state->weight[i] = log(state->mu + 0.5) - log(i + 1.0);
+        sum += state->weight[i];
+    }
+    for (i = 0; i < state->mu; i++) {
+        state->weight[i] /= sum;
+        ssq += state->weight[i] * state->weight[i];
+    }
+    state->mueff = 1.0 / ssq;
+    state->cc = (4.0 + state->mueff / n) / (n + 4.0 + 2.0 * state->mueff / n);
+    state->cs = (state->mueff + 2.0) / (n + state->mueff + 5.0);
+    state->c1 = 2.0 / ((n + 1.3) * (n + 1.3) + state->mueff);
+    state->cmu = MIN(1.0 - state->c1, 2.0 * (state->mueff - 2.0 + 1.0 / state->mueff) / ((n + 2.0) * (n + 2.0) + state->mueff));
+    state->damps = 1.0 + 2.0 * MAX(0.0, sqrt((state->mueff - 1.0) / (n + 1.0)) - 1.0) + state->cs;
+    state->chiN = sqrt(n) * (1.0 - 1.0 / (4.0 * n) + 1.0 / (21.0 * n * n));
+
+    /* Initial distribution: */
+    for (i = 0; i < DIMENSIONS; i++) {
+        state->mean[i] = mean[i];
+        state->pc[i] = 0.0;
+        state->ps[i] = 0.0;
+        for (j = 0; j < DIMENSIONS; j++) {
+            state->C[i][j] = (i == j) ? 1.0 : 0.0;
+        }
+    }
+    state->sigma = SIGMA_INITIAL;
+    state->evaluations = 0;
+    cmaes_decompose(state);
+}
+
+static void cmaes_sample(CmaesState *state)
+{
+    // x = mean + sigma * B * D * z, with z ~ N(0, I)
+
+    double z[DIMENSIONS];
+    int k, i, j;
+
+    for (k = 0; k < POPULATION_SIZE; k++) {
+        for (j = 0; j < DIMENSIONS; j++) {
+            z[j] = state->D[j] * random_normal(0.0, 1.0);
+        }
+        for (i = 0; i < DIMENSIONS; i++) {
+            double y = 0.0;
+            for (j = 0; j < DIMENSIONS; j++) {
+                y += state->B[i][j] * z[j];
+            }
+            x[k][i] = state->mean[i] + state->sigma * y;
+        }
+    }
+}
+
+static void cmaes_update(CmaesState *state, int *order)
+{
+    // Move the distribution towards the best mu candidates (in order[])
+
+    double old_mean[DIMENSIONS], step[DIMENSIONS], white[DIMENSIONS];
+    double y[POPULATION_SIZE][DIMENSIONS];
+    double norm = 0.0, hsig;
+    int i, j, k;
+
+    state->evaluations += POPULATION_SIZE;
+
+    for (i = 0; i < DIMENSIONS; i++) {
+        old_mean[i] = state->mean[i];
+        state->mean[i] = 0.0;
+        for (k = 0; k < state->mu; k++) {
+            state->mean[i] += state->weight[k] * x[order[k]][i];
+        }
+        step[i] = (state->mean[i] - old_mean[i]) / state->sigma;
+    }
+
+    /* C^-1/2 * step = B * D^-1 * B' * step: */
+    for (j = 0; j < DIMENSIONS; j++) {
+        double s = 0.0;
+        for (i = 0; i < DIMENSIONS; i++) {
+            s += state->B[i][j] * step[i];
+        }
+        white[j] = s / state->D[j];
+    }
+    for (i = 0; i < DIMENSIONS; i++) {
+        double s = 0.0;
+        for (j = 0; j < DIMENSIONS; j++) {
+            s += state->B[i][j] * white[j];
+        }
+        state->ps[i] = (1.0 - state->cs) * state->ps[i] + sqrt(state->cs * (2.0 - state->cs) * state->mueff) * s;
+        norm += state->ps[i] * state->ps[i];
+    }
+    norm = sqrt(norm);
+    hsig = (norm / sqrt(1.0 - pow(1.0 - state->cs, 2.0 * state->evaluations / POPULATION_SIZE)) / state->chiN) < (1.4 + 2.0 / (DIMENSIONS + 1.0)) ? 1.0 : 0.0;
+    for (i = 0; i < DIMENSIONS; i++) {
+        state->pc[i] = (1.0 - state->cc) * state->pc[i] + hsig * sqrt(state->cc * (2.0 - state->cc) * state->mueff) * step[i];
+    }
+
+    /* Rank-one and rank-mu updates of the covariance matrix: */
+    for (k = 0; k < state->mu; k++) {
+        for (i = 0; i < DIMENSIONS; i++) {
+            y[k][i] = (x[order[k]][i] - old_mean[i]) / state->sigma;
+        }
+    }
+    for (i = 0; i < DIMENSIONS; i++) {
+        for (j = 0; j < DIMENSIONS; j++) {
+            double rank_mu = 0.0;
+            for (k = 0; k < state->mu; k++) {
+                rank_mu += state->weight[k] * y[k][i] * y[k][j];
+            }
+            state->C[i][j] = (1.0 - state->c1 - state->cmu) * state->C[i][j]
+                + state->c1 * (state->pc[i] * state->pc[j] + (1.0 - hsig) * state->cc * (2.0 - state->cc) * state->C[i][j])
+                + state->cmu * rank_mu;
+        }
+    }
+
+    state->sigma *= exp((state->cs / state->damps) * (norm / state->chiN - 1.0));
+    cmaes_decompose(state);
+}
+
+/******************************************************************************/
+
+static void parameters_to_point(RngParameters *candidate, double *u)
+{
+    int i;
+
+    u[CMAES_WMD] = candidate->wm_decay_rate;
+    u[CMAES_WMU] = candidate->wm_update_efficiency;
+    u[CMAES_TEMP] = candidate->selection_temperature;
+    u[CMAES_SWR] = candidate->switch_rate;
+    u[CMAES_ME] = candidate->monitoring_efficiency;
+    for (i = 0; i < DIMENSIONS; i++) {
+        u[i] = (u[i] - dimension_min[i]) / (dimension_max[i] - dimension_min[i]);
+    }
+}
+
+static double point_to_parameters(double *u, RngParameters *candidate)
+{
+    // Candidates outside [0, 1] are evaluated at the nearest point inside it.
+    // Returns a penalty, proportional to the squared distance moved, which is
+    // added to the fit so the distribution is drawn back into bounds. Other
+    // parameters are the defaults.
+
+    double v[DIMENSIONS], penalty = 0.0;
+    int i;
+
+    for (i = 0; i < DIMENSIONS; i++) {
+        double c = MIN(MAX(u[i], 0.0), 1.0);
+        penalty += (u[i] - c) * (u[i] - c);
+        v[i] = dimension_min[i] + c * (dimension_max[i] - dimension_min[i]);
+    }
+    *candidate = pars;
+    candidate->wm_decay_rate = (int) floor(v[CMAES_WMD] + 0.5);
+    candidate->wm_update_efficiency = v[CMAES_WMU];
+    candidate->selection_temperature = v[CMAES_TEMP];
+    candidate->switch_rate = v[CMAES_SWR];
+    candidate->monitoring_efficiency = v[CMAES_ME];
+    candidate->sample_size = pars.sample_size * 10;    /* Up to 360, as GA */
+    return(BOUND_PENALTY * penalty);
+}
+
+/******************************************************************************/
+
+static void cmaes_evaluate_thread(int thread_id, void *data)
+{
+    // Each thread has its own model, and takes candidates one at a time
+    // (evaluations vary a lot in length). The thread's random state is
+    // restored afterwards, so the caller's sampling is not disturbed.
+
+    CmaesJob *job = (CmaesJob *)data;
+    RngEvaluation evaluation;
+    RandomState state;
+    int i;
+
+    random_state_get(&state);
+    while ((i = thread_claim(&(job->next))) < POPULATION_SIZE) {
+        job->fit[i] = rng_evaluate(job->gv[thread_id], &(job->pars[i]), SUBJECT_DATA, DBL_MAX, &evaluation);
+        job->subjects[i] = evaluation.simulated;
+    }
+    random_state_set(&state);
+}
+
+static void cmaes_sort_by_fit(int *order)
+{
+    /* Insertion sort of the candidate indices by (penalised) fit: */
+
+    int i, j;
+
+    for (i = 0; i < POPULATION_SIZE; i++) {
+        int k = i;
+        for (j = i; (j > 0) && (para_fit[order[j-1]] > para_fit[k]); j--) {
+            order[j] = order[j-1];
+        }
+        order[j] = k;
+    }
+}
+
+static void cmaes_print_statistics(int generation, CmaesState *state, RngParameters *best, double best_fit, int subjects)
+{
+    // Report the best candidate of the generation. (With a noisy objective
+    // the best single estimate is optimistic: the distribution mean, reported
+    // at the end, is the better final estimate.)
+
+    FILE *fp;
+
+    fprintf(stdout, "%4d: %f [DR: %3d; SR: %4.2f; ST: %4.2f; ME: %4.2f; UE: %4.2f] (sigma %5.3f; %d subjects)\n", generation, best_fit, best->wm_decay_rate, best->switch_rate, best->selection_temperature, best->monitoring_efficiency, best->wm_update_efficiency, state->sigma, subjects);
+
+    fp = fopen(LOG_FILE, "a");
+    if (fp != NULL) {
+        fprintf(fp, "%4d: %f", generation, best_fit);
+        fprintf(fp, " [Decay: %4d, Switch: %5.3f, Temperature: %5.3f, Monitoring: %5.3f, Updating: %6.3f]", best->wm_decay_rate, best->switch_rate, best->selection_temperature, best->monitoring_efficiency, best->wm_update_efficiency);
+        fprintf(fp, " sigma %f\n", state->sigma);
+        fclose(fp);
+    }
+}
+
+/******************************************************************************/
+
+int main(int argc, char **argv)
+{
+    static CmaesJob job;
+    CmaesState state;
+    RngParameters best;
+    double u[DIMENSIONS];
+    int order[POPULATION_SIZE];
+    int generation, i, n_threads;
+    FILE *fp;
+
+    n_threads = MIN(thread_count(), POPULATION_SIZE);
+    fprintf(stdout, "Running CMA-ES (%d threads); Output to %s\n", n_threads, LOG_FILE);
+
+    for (i = 0; i < n_threads; i++) {
+        if ((job.gv[i] = oos_globals_create()) == NULL) {
+            fprintf(stdout, "ABORTING: Cannot allocate global variable space\n");
+            break;
+        }
+        else if (!rng_model_create(job.gv[i], &pars, FALSE)) {
+            fprintf(stdout, "ABORTING: Cannot create RNG\n");
+            break;
+        }
+        oos_trace_open_from_environment(job.gv[i], i);
+    }
+    if (i == n_threads) {
+        parameters_to_point(&pars, u);
+        cmaes_initialise(&state, u);
+
+        fp = fopen(LOG_FILE, "w"); fclose(fp);
+        for (generation = 0; (generation < GENERATION_MAX) && (state.sigma > SIGMA_MIN); generation++) {
+            double penalty[POPULATION_SIZE];
+            int subjects = 0;
+
+            cmaes_sample(&state);
+            for (i = 0; i < POPULATION_SIZE; i++) {
+                penalty[i] = point_to_parameters(x[i], &(job.pars[i]));
+#ifdef COMMON_RANDOM_NUMBERS
+                job.pars[i].seed = generation + 1;
+#endif
+            }
+            job.next = 0;
+            thread_parallel_run(n_threads, cmaes_evaluate_thread, &job);
+
+            for (i = 0; i < POPULATION_SIZE; i++) {
+                para_fit[i] = job.fit[i] + penalty[i];
+                subjects += job.subjects[i];
+            }
+            cmaes_sort_by_fit(order);
+            cmaes_update(&state, order);
+
+            /* Append this generation's results to the log file: */
+            cmaes_print_statistics(generation, &state, &(job.pars[order[0]]), job.fit[order[0]], subjects);
+        }
+        point_to_parameters(state.mean, &best);
+        fprintf(stdout, "Final mean: [DR: %3d; SR: %4.2f; ST: %4.2f; ME: %4.2f; UE: %4.2f]\n", best.wm_decay_rate, best.switch_rate, best.selection_temperature, best.monitoring_efficiency, best.wm_update_efficiency);
+    }
+    for (i = 0; i < n_threads; i++) {
+        if (job.gv[i] != NULL) {
+            rng_globals_destroy((RngData *)job.gv[i]->task_data);
+            oos_globals_destroy(job.gv[i]);
+        }
+    }
+    exit(1);
+}
@@ -2,14 +2,19 @@
 
 #include "rng.h"
 #include "rng_defaults.h"
+#include "rng_surrogate.h"
+#include "rng_cache.h"
 #include "lib_math.h"
+#include "lib_thread.h"
+#include <pthread.h>
 
 #define GENERATION_MAX  100
 #define POPULATION_SIZE 60
 
-static RngParameters para_pop[POPULATION_SIZE];
-static double para_fit[POPULATION_SIZE];
-static int generation = 0;
+/* Each thread (i.e. each island, see below) has its own population: */
+static __thread RngParameters para_pop[POPULATION_SIZE];
+static __thread double para_fit[POPULATION_SIZE];
+static __thread char island_label[16] = "";
 
 #define MIN_WM_DECAY  1
 #define MAX_WM_DECAY 40
@@ -28,6 +33,43 @@ static int generation = 0;
 // static RngGroupData *SUBJECT_DATA = &subject_2b;
 static RngGroupData *SUBJECT_DATA = &subject_gng;
 
+// If defined, a surrogate model fitted to the parameter scan (if there is one)
+// is used to skip simulating candidates that cannot reach the top 25%:
+#define SURROGATE_SCREENING
+
+// If defined, all candidates in a generation are run with the same random
+// numbers (a fresh seed each generation), so they are compared on equal terms:
+#define COMMON_RANDOM_NUMBERS
+
+// If defined, the subjects simulated for each candidate are cached (and saved
+// to this file after each generation). A candidate seen before, such as an
+// elite, continues from its cached subjects, so its fit is known more
+// precisely each time it is evaluated. Cached subjects are only reused with
+// the same seed, so with common random numbers the seed is then held for
+// FITNESS_CACHE_EPOCH generations rather than changed every generation. The
+// longer the epoch, the more an elite's fit is refined, but the more
+// selection can favour candidates that happen to suit one sample of subjects,
+// so the seed is still changed between epochs:
+#define FITNESS_CACHE "FIT_GA.cache"
+#define FITNESS_CACHE_EPOCH 10
+
+static RngCache *fit_cache = NULL;
+
+// If defined, ISLANDS populations evolve in parallel threads (each of
+// POPULATION_SIZE, with the usual operators). Every MIGRATION_INTERVAL
+// generations each island sends copies of its best MIGRANTS individuals to
+// its neighbours: the next island in a ring, or every other island. Migrants
+// replace the receiver's worst individuals when it next sorts its population.
+// Islands never wait for each other. The fitness cache is not used (it is not
+// shared between threads).
+//#define ISLANDS 4
+
+typedef enum island_topology {ISLAND_RING, ISLAND_FULL} IslandTopology;
+
+#define ISLAND_TOPOLOGY     ISLAND_RING
+#define MIGRATION_INTERVAL  5
+#define MIGRANTS            3
+
 /******************************************************************************/
 
 double clip(double low, double high, double x)
@@ -53,6 +95,7 @@ static void generate_new_individual_within_range(int i)
     para_pop[i].monitoring_efficiency = random_uniform(0.1, 1.0);
     para_pop[i].individual_variability = pars.individual_variability; // Default
     para_pop[i].sample_size = pars.sample_size * 10; // Ensure good quality sampling
+    para_pop[i].seed = pars.seed;
 }
 
 static void ga_generate_seed_population()
@@ -112,6 +155,7 @@ static void ga_generate_next_generation()
         para_pop[i].selection_temperature = para_pop[m].selection_temperature;
         para_pop[i].individual_variability = para_pop[n].individual_variability;
         para_pop[i].sample_size = para_pop[n].sample_size;
+        para_pop[i].seed = para_pop[n].seed;
     }
 
     for (i = l[1]; i < l[2]; i++) {
@@ -123,6 +167,7 @@ static void ga_generate_next_generation()
         para_pop[i].selection_temperature = clip(0.0, 1.0, random_normal(para_pop[i-l[1]].selection_temperature, 0.2));
         para_pop[i].individual_variability = para_pop[0].individual_variability;
         para_pop[i].sample_size = para_pop[0].sample_size;
+        para_pop[i].seed = para_pop[0].seed;
     }
 
     for (i = l[2]; i < POPULATION_SIZE; i++) {
@@ -203,13 +248,13 @@ static void ga_print_statistics(int generation)
     FILE *fp;
     int i;
 
-    fprintf(stdout, "%4d: %f [DR: %3d; SR: %4.2f; ST: %4.2f; ME: %4.2f; UE: %4.2f]\n", generation, para_fit[0], para_pop[0].wm_decay_rate, para_pop[0].switch_rate, para_pop[0].selection_temperature, para_pop[0].monitoring_efficiency, para_pop[0].wm_update_efficiency);
+    fprintf(stdout, "%s%4d: %f [DR: %3d; SR: %4.2f; ST: %4.2f; ME: %4.2f; UE: %4.2f]\n", island_label, generation, para_fit[0], para_pop[0].wm_decay_rate, para_pop[0].switch_rate, para_pop[0].selection_temperature, para_pop[0].monitoring_efficiency, para_pop[0].wm_update_efficiency);
 
     fp = fopen(LOG_FILE, "a");
     if (fp != NULL) {
 // Print the best 3 individuals:
         for (i = 0; i < 3; i++) {
-            fprintf(fp, "%4d %3d: %f", generation, i, para_fit[i]);
+            fprintf(fp, "%s%4d %3d: %f", island_label, generation, i, para_fit[i]);
             fprintf(fp, " [Decay: %4d, Switch: %5.3f, Monitoring: %5.3f, Updating: %6.3f]\n", para_pop[i].wm_decay_rate, para_pop[i].switch_rate, para_pop[i].monitoring_efficiency, para_pop[i].wm_update_efficiency);
 	}
 // Print all individuals
@@ -223,48 +268,224 @@ static void ga_print_statistics(int generation)
 
 /******************************************************************************/
 
-static double rng_model_fit(OosVars *gv, RngParameters *pars)
+static double rng_model_fit(OosVars *gv, RngParameters *pars, double incumbent, int *subjects)
 {
-    rng_create(gv, pars);
-    rng_initialise_subject(gv);
-    rng_run(gv);
-    rng_analyse_group_data((RngData *)gv->task_data);
-    return(rng_data_calculate_fit(&((RngData *)gv->task_data)->group, SUBJECT_DATA));
+    RngEvaluation evaluation;
+
+    rng_cache_evaluate(fit_cache, gv, pars, SUBJECT_DATA, incumbent, &evaluation);
+    *subjects += evaluation.simulated;
+    return(evaluation.fit);
 }
 
 /******************************************************************************/
 
-int main(int argc, char **argv)
+static void ga_evaluate_generation(OosVars *gv, RngSurrogate *surrogate, int generation, int *screened, int *subjects)
+{
+    /* The fit needed to be among the best 25% of the last generation: */
+    double cutoff = (generation > 0) ? para_fit[(int) (POPULATION_SIZE * 0.25) - 1] : DBL_MAX;
+    int i;
+
+    *screened = 0;
+    *subjects = 0;
+    ga_generate_population(generation);
+    for (i = 0; i < POPULATION_SIZE; i++) {
+#ifdef COMMON_RANDOM_NUMBERS
+        /* Cached subjects are only reused with the same seed (and islands have no cache): */
+        para_pop[i].seed = (fit_cache != NULL) ? 1 + generation / FITNESS_CACHE_EPOCH : generation + 1;
+#endif
+        if ((surrogate != NULL) && (i >= POPULATION_SIZE * 0.25) && (rng_surrogate_fit_bound(surrogate, &para_pop[i], SUBJECT_DATA) > cutoff)) {
+            /* Hopeless according to the surrogate; don't simulate */
+            para_fit[i] = DBL_MAX;
+            (*screened)++;
+            continue;
+        }
+        /* Simulation stops early for candidates that clearly won't make the cut: */
+        para_fit[i] = rng_model_fit(gv, &para_pop[i], cutoff, subjects);
+
+//        fprintf(stdout, "%4d %3d: %f", generation, i, para_fit[i]);
+//        fprintf(stdout, " [Decay: %4d, Monitoring: %5.3f, Updating: %6.3f]\n", para_pop[i].wm_decay_rate, para_pop[i].monitoring_efficiency, para_pop[i].wm_update_efficiency);
+    }
+    ga_sort_by_fit();
+}
+
+static void ga_report_generation(RngSurrogate *surrogate, int generation, int screened, int subjects)
+{
+    /* Append this generation's results to the log file: */
+    ga_print_statistics(generation);
+    if (surrogate != NULL) {
+        fprintf(stdout, "%s      (%d of %d candidates screened out by the surrogate)\n", island_label, screened, POPULATION_SIZE);
+    }
+    fprintf(stdout, "%s      (%d subjects simulated)\n", island_label, subjects);
+#ifdef FITNESS_CACHE
+    if (fit_cache != NULL) {
+        fprintf(stdout, "      (%ld of %ld evaluations continued from the cache)\n", fit_cache->hits, fit_cache->hits + fit_cache->misses);
+        rng_cache_write_to_file(fit_cache, FITNESS_CACHE);
+    }
+#endif
+}
+
+/******************************************************************************/
+
+#ifdef ISLANDS
+
+typedef struct island_mailbox {
+    pthread_mutex_t lock;
+    RngParameters   pars[MIGRANTS * ISLANDS];
+    double          fit[MIGRANTS * ISLANDS];
+    int             count;
+} IslandMailbox;
+
+typedef struct island_job {
+    RngSurrogate   *surrogate;
+    unsigned long   seed;
+    IslandMailbox   mailbox[ISLANDS];
+} IslandJob;
+
+static void island_emigrate(IslandJob *job, int island)
+{
+    // Post copies of the island's best individuals to its neighbours' mailboxes
+
+    IslandMailbox *mailbox;
+    int k, i;
+
+    for (k = 1; k < ISLANDS; k++) {
+        if ((ISLAND_TOPOLOGY == ISLAND_RING) && (k > 1)) {
+            break;
+        }
+        mailbox = &(job->mailbox[(island + k) % ISLANDS]);
+        pthread_mutex_lock(&(mailbox->lock));
+        for (i = 0; (i < MIGRANTS) && (mailbox->count < MIGRANTS * ISLANDS); i++) {
+            mailbox->pars[mailbox->count] = para_pop[i];
+            mailbox->fit[mailbox->count] = para_fit[i];
+            mailbox->count++;
+        }
+        pthread_mutex_unlock(&(mailbox->lock));
+    }
+}
+
+static int island_immigrate(IslandJob *job, int island)
+{
+    // Replace the island's worst individuals with any migrants that have
+    // arrived, and re-sort the population. Returns the number of migrants.
+
+    IslandMailbox *mailbox = &(job->mailbox[island]);
+    int i, n;
+
+    pthread_mutex_lock(&(mailbox->lock));
+    n = mailbox->count;
+    for (i = 0; i < n; i++) {
+        para_pop[POPULATION_SIZE - 1 - i] = mailbox->pars[i];
+        para_fit[POPULATION_SIZE - 1 - i] = mailbox->fit[i];
+    }
+    mailbox->count = 0;
+    pthread_mutex_unlock(&(mailbox->lock));
+
+    if (n > 0) {
+        ga_sort_by_fit();
+    }
+    return(n);
+}
+
+static void island_run(int island, void *data)
 {
+    IslandJob *job = (IslandJob *)data;
+    int generation, screened, subjects;
     OosVars *gv;
+
+    g_snprintf(island_label, 16, "[%d] ", island);
+
+    if ((gv = oos_globals_create()) == NULL) {
+        fprintf(stdout, "%sABORTING: Cannot allocate global variable space\n", island_label);
+    }
+    else if (!rng_model_create(gv, &pars, FALSE)) {
+        fprintf(stdout, "%sABORTING: Cannot create RNG\n", island_label);
+    }
+    else {
+        /* After oos_globals_create/0, which seeds from the time: */
+        random_seed(job->seed + island);
+        oos_trace_open_from_environment(gv, island);
+        for (generation = 0; generation < GENERATION_MAX; generation++) {
+            ga_evaluate_generation(gv, job->surrogate, generation, &screened, &subjects);
+            island_immigrate(job, island);
+            ga_report_generation(job->surrogate, generation, screened, subjects);
+            if ((generation + 1) % MIGRATION_INTERVAL == 0) {
+                island_emigrate(job, island);
+            }
+        }
+        rng_globals_destroy((RngData *)gv->task_data);
+    }
+    if (gv != NULL) {
+        oos_globals_destroy(gv);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    static IslandJob job;
     FILE *fp;
     int i;
 
+    fprintf(stdout, "Running Genetic Algorithm on %d islands; Output to %s\n", ISLANDS, LOG_FILE);
+
+    random_initialise();
+    job.seed = (unsigned long) random_integer(0, 1 << 30);
+    for (i = 0; i < ISLANDS; i++) {
+        pthread_mutex_init(&(job.mailbox[i].lock), NULL);
+        job.mailbox[i].count = 0;
+    }
+#ifdef SURROGATE_SCREENING
+    job.surrogate = rng_surrogate_create_from_file(SCAN_FILE);
+#endif
+    fp = fopen(LOG_FILE, "w"); fclose(fp);
+
+    thread_parallel_run(ISLANDS, island_run, &job);
+
+    rng_surrogate_free(job.surrogate);
+    for (i = 0; i < ISLANDS; i++) {
+        pthread_mutex_destroy(&(job.mailbox[i].lock));
+    }
+    exit(1);
+}
+
+#else
+
+int main(int argc, char **argv)
+{
+    RngSurrogate *surrogate = NULL;
+    OosVars *gv;
+    FILE *fp;
+    int generation, screened, subjects;
+
     fprintf(stdout, "Running Genetic Algorithm; Output to %s\n", LOG_FILE);
 
     if ((gv = oos_globals_create()) == NULL) {
         fprintf(stdout, "ABORTING: Cannot allocate global variable space\n");
     }
+    else if (!rng_model_create(gv, &pars, FALSE)) {
+        fprintf(stdout, "ABORTING: Cannot create RNG\n");
+    }
     else {
+        oos_trace_open_from_environment(gv, 0);
+#ifdef SURROGATE_SCREENING
+        surrogate = rng_surrogate_create_from_file(SCAN_FILE);
+#endif
+#ifdef FITNESS_CACHE
+        fit_cache = rng_cache_read_from_file(FITNESS_CACHE);
+#endif
         fp = fopen(LOG_FILE, "w"); fclose(fp);
         for (generation = 0; generation < GENERATION_MAX; generation++) {
-            ga_generate_population(generation);
-            for (i = 0; i < POPULATION_SIZE; i++) {
-                para_fit[i] = rng_model_fit(gv, &para_pop[i]);
-
-//                fprintf(stdout, "%4d %3d: %f", generation, i, para_fit[i]);
-//                fprintf(stdout, " [Decay: %4d, Monitoring: %5.3f, Updating: %6.3f]\n", para_pop[i].wm_decay_rate, para_pop[i].monitoring_efficiency, para_pop[i].wm_update_efficiency);
-            }
-            ga_sort_by_fit();
-
-            /* Append this generation's results to the log file: */
-            ga_print_statistics(generation);
+            ga_evaluate_generation(gv, surrogate, generation, &screened, &subjects);
+            ga_report_generation(surrogate, generation, screened, subjects);
 	}
 
+        rng_cache_free(fit_cache);
+        rng_surrogate_free(surrogate);
         rng_globals_destroy((RngData *)gv->task_data);
         oos_globals_destroy(gv);
     }
     exit(1);
 }
 
+#endif
+
 /******************************************************************************/
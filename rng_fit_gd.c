@@ -2,6 +2,8 @@
 
 #include "rng.h"
 #include "rng_defaults.h"
+#include "rng_surrogate.h"
+#include "rng_cache.h"
 #include "lib_math.h"
 
 // GENERATION_MAX is only used in the for loop as a termination condition:
@@ -29,6 +31,56 @@ static double para_fit[POPULATION_SIZE];
 static RngGroupData *SUBJECT_DATA = &subject_2b;
 //static RngGroupData *SUBJECT_DATA = &subject_gng;
 
+// If defined, a surrogate model fitted to the parameter scan (if there is one)
+// is used to skip simulating neighbours that cannot improve on the current best:
+#define SURROGATE_SCREENING
+
+// If defined, all candidates in a generation are run with the same random
+// numbers (a fresh seed each generation), so that differences in their fit
+// reflect their parameters rather than sampling noise:
+#define COMMON_RANDOM_NUMBERS
+
+// If defined, the subjects simulated for each candidate are cached (and saved
+// to this file after each generation). A candidate seen before, such as an
+// elite, continues from its cached subjects, so its fit is known more
+// precisely each time it is evaluated. Cached subjects are only reused with
+// the same seed, so with common random numbers the seed is then held for
+// FITNESS_CACHE_EPOCH generations rather than changed every generation. The
+// longer the epoch, the more an elite's fit is refined, but the more
+// selection can favour candidates that happen to suit one sample of subjects,
+// so the seed is still changed between epochs.
+// SPSA does not use the cache (see spsa_fit/3):
+#define FITNESS_CACHE "FIT_GD.cache"
+#define FITNESS_CACHE_EPOCH 10
+
+static RngCache *fit_cache = NULL;
+
+// If defined, each iteration uses simultaneous perturbation (SPSA) instead of
+// the full neighbourhood: the seed is moved by +/- c_k grid steps along every
+// parameter at once (with random signs), and the difference in fit between
+// the two points estimates the gradient. Two evaluations per iteration rather
+// than 81. The gain a_k and perturbation c_k decay with iteration k as
+// recommended by Spall (1998). Both points are simulated with the same fixed
+// number of subjects, and the seed itself is simulated (and logged) only
+// every SPSA_EVALUATE_INTERVAL iterations and after the last:
+#define SPSA
+
+#define SPSA_A          20.0        /* Gain, in grid steps per unit of fit   */
+#define SPSA_C          2.0         /* Perturbation, in grid steps            */
+#define SPSA_STABILITY  10.0        /* About 10% of GENERATION_MAX            */
+#define SPSA_ALPHA      0.602
+#define SPSA_GAMMA      0.101
+#define SPSA_MAX_STEP   4.0         /* Largest move per iteration, in steps   */
+#define SPSA_SUBJECTS   120         /* Subjects per evaluated point           */
+#define SPSA_EVALUATE_INTERVAL 5
+
+// Grid steps of each parameter (for the neighbourhood, and as SPSA's units):
+#define WM_DECAY_RATE_STEP          2
+#define WM_UPDATE_EFFICIENCY_STEP   0.05
+#define SELECTION_TEMPERATURE_STEP  0.02
+#define SWITCH_RATE_STEP            0.05
+#define MONITORING_EFFICIENCY_STEP  0.05
+
 /******************************************************************************/
 
 double clip(double low, double high, double x)
@@ -57,18 +109,21 @@ static void gd_initialise_parameters(RngParameters *seed)
     seed->monitoring_efficiency = pars.monitoring_efficiency;
     seed->individual_variability = pars.individual_variability;
     seed->sample_size = pars.sample_size * 10;    /* Sample 360 times to get stable measures: */
+    seed->seed = pars.seed;
 }
 
+#ifndef SPSA
+
 static void gd_generate_population(RngParameters *seed)
 {
     int p0, p1, p2, p3, p4;
     int i = 0;
 
-    double wm_decay_rate_step = 2;
-    double wm_update_efficiency_step = 0.05;
-    double selection_temperature_step = 0.02;
-    double switch_rate_step = 0.05;
-    double monitoring_efficiency_step = 0.05;
+    double wm_decay_rate_step = WM_DECAY_RATE_STEP;
+    double wm_update_efficiency_step = WM_UPDATE_EFFICIENCY_STEP;
+    double selection_temperature_step = SELECTION_TEMPERATURE_STEP;
+    double switch_rate_step = SWITCH_RATE_STEP;
+    double monitoring_efficiency_step = MONITORING_EFFICIENCY_STEP;
 
 //    for (p0 = -1; p0 < 2; p0++) {
     for (p0 = 0; p0 < 1; p0++) { // WM Decay is fixed at default
@@ -84,6 +139,7 @@ static void gd_generate_population(RngParameters *seed)
                         para_pop[i].monitoring_efficiency = clip(0.0, 1.0, seed->monitoring_efficiency + p4*monitoring_efficiency_step);
                         para_pop[i].individual_variability = seed->individual_variability;
                         para_pop[i].sample_size = seed->sample_size;
+                        para_pop[i].seed = seed->seed;
                         i++;
                     }
                 }
@@ -109,6 +165,8 @@ static int gd_get_best_fit(int n)
     return(i);
 }
 
+#endif
+
 static void population_print_statistics(int generation, int i)
 {
     FILE *fp;
@@ -122,6 +180,18 @@ static void population_print_statistics(int generation, int i)
     }
 }
 
+static void gd_report_generation(int generation, int i, int screened, int subjects)
+{
+    /* Append this generation's results to the log file, if the seed's fit is known: */
+    if (para_fit[i] < DBL_MAX) {
+        population_print_statistics(generation, i);
+    }
+    if (screened > 0) {
+        fprintf(stdout, "      (%d of %d candidates screened out by the surrogate)\n", screened, POPULATION_SIZE);
+    }
+    fprintf(stdout, "      (%d subjects simulated)\n", subjects);
+}
+
 static void gd_copy_parameters(RngParameters *seed, int i)
 {
     seed->wm_decay_rate = para_pop[i].wm_decay_rate;
@@ -132,51 +202,167 @@ static void gd_copy_parameters(RngParameters *seed, int i)
     seed->monitoring_efficiency = para_pop[i].monitoring_efficiency;
     seed->individual_variability = para_pop[i].individual_variability;
     seed->sample_size = para_pop[i].sample_size;
+    seed->seed = para_pop[i].seed;
 }
 
 /******************************************************************************/
 
-static double rng_model_fit(OosVars *gv, RngParameters *pars)
+#ifndef SPSA
+
+static double rng_model_fit(OosVars *gv, RngParameters *pars, double incumbent, int *subjects)
 {
-    rng_create(gv, pars);
-    rng_initialise_subject(gv);
+    RngEvaluation evaluation;
+
+    rng_cache_evaluate(fit_cache, gv, pars, SUBJECT_DATA, incumbent, &evaluation);
+    *subjects += evaluation.simulated;
+    return(evaluation.fit);
+}
+
+#endif
+
+/******************************************************************************/
+
+#ifdef SPSA
+
+static void spsa_perturb(RngParameters *seed, int *delta, double c, RngParameters *p)
+{
+    // Move each parameter by c * delta grid steps (WM decay stays fixed)
+
+    *p = *seed;
+    p->wm_update_efficiency = clip(0.0, 1.0, seed->wm_update_efficiency + c*delta[0]*WM_UPDATE_EFFICIENCY_STEP);
+    p->selection_temperature = clip(0.0, 2.0, seed->selection_temperature + c*delta[1]*SELECTION_TEMPERATURE_STEP);
+    p->switch_rate = clip(0.0, 1.0, seed->switch_rate + c*delta[2]*SWITCH_RATE_STEP);
+    p->monitoring_efficiency = clip(0.0, 1.0, seed->monitoring_efficiency + c*delta[3]*MONITORING_EFFICIENCY_STEP);
+}
+
+static double spsa_fit(OosVars *gv, RngParameters *p, int *subjects)
+{
+    // The fit of p with exactly SPSA_SUBJECTS subjects: no early stopping and
+    // no cache, so every point SPSA compares is estimated equally precisely,
+    // and with common random numbers from the same subjects' streams.
+
+    RngParameters fixed = *p;
+    RngData *task_data;
+
+    fixed.sample_size = SPSA_SUBJECTS;
+    rng_model_reset(gv, &fixed);
     rng_run(gv);
-    rng_analyse_group_data((RngData *)gv->task_data);
-    return(rng_data_calculate_fit(&((RngData *)gv->task_data)->group, SUBJECT_DATA));
+    task_data = (RngData *)gv->task_data;
+    rng_analyse_group_data(task_data);
+    *subjects += task_data->group.n;
+    return(rng_data_calculate_fit(&(task_data->group), SUBJECT_DATA));
+}
+
+static int spsa_iterate(OosVars *gv, RngParameters *seed, int k, Boolean evaluate, int *subjects)
+{
+    // One SPSA iteration: para_pop[0] and [1] are the perturbed points, and
+    // para_pop[2] is the new seed. The seed's fit is simulated only if
+    // evaluate is TRUE, and is otherwise DBL_MAX (unknown). Returns the index
+    // of the new seed.
+
+    double a = SPSA_A / pow(k + 1 + SPSA_STABILITY, SPSA_ALPHA);
+    double c = SPSA_C / pow(k + 1, SPSA_GAMMA);
+    double g, d[4];
+    int delta[4], j;
+
+    for (j = 0; j < 4; j++) {
+        delta[j] = (random_integer(0, 2) == 0) ? -1 : 1;
+    }
+    /* With common random numbers both points share a seed, so their difference is not swamped by noise: */
+    spsa_perturb(seed, delta, c, &para_pop[0]);
+    spsa_perturb(seed, delta, -c, &para_pop[1]);
+    para_fit[0] = spsa_fit(gv, &para_pop[0], subjects);
+    para_fit[1] = spsa_fit(gv, &para_pop[1], subjects);
+
+    /* The gradient estimate is g * delta[j] (as 1/delta[j] = delta[j]): */
+    g = (para_fit[0] - para_fit[1]) / (2.0 * c);
+    for (j = 0; j < 4; j++) {
+        d[j] = clip(-SPSA_MAX_STEP, SPSA_MAX_STEP, a * g * delta[j]);
+    }
+    para_pop[2] = *seed;
+    para_pop[2].wm_update_efficiency = clip(0.0, 1.0, seed->wm_update_efficiency - d[0]*WM_UPDATE_EFFICIENCY_STEP);
+    para_pop[2].selection_temperature = clip(0.0, 2.0, seed->selection_temperature - d[1]*SELECTION_TEMPERATURE_STEP);
+    para_pop[2].switch_rate = clip(0.0, 1.0, seed->switch_rate - d[2]*SWITCH_RATE_STEP);
+    para_pop[2].monitoring_efficiency = clip(0.0, 1.0, seed->monitoring_efficiency - d[3]*MONITORING_EFFICIENCY_STEP);
+    para_fit[2] = evaluate ? spsa_fit(gv, &para_pop[2], subjects) : DBL_MAX;
+    return(2);
 }
 
+#endif
+
 /******************************************************************************/
 
 int main(int argc, char **argv)
 {
+    RngSurrogate *surrogate = NULL;
+#ifndef SPSA
+    double best = DBL_MAX;
+    double incumbent;
+#endif
     OosVars *gv;
     RngParameters seed;
     FILE *fp;
     int generation = 0;
-    int i;
+    int i, screened, subjects;
 
     fprintf(stdout, "Running Gradient Descent; Output to %s\n", LOG_FILE);
 
     if ((gv = oos_globals_create()) == NULL) {
         fprintf(stdout, "ABORTING: Cannot allocate global variable space\n");
     }
+    else if (!rng_model_create(gv, &pars, FALSE)) {
+        fprintf(stdout, "ABORTING: Cannot create RNG\n");
+    }
     else {
+        oos_trace_open_from_environment(gv, 0);
         gd_initialise_parameters(&seed);
+#if defined(SURROGATE_SCREENING) && !defined(SPSA)
+        surrogate = rng_surrogate_create_from_file(SCAN_FILE);
+#endif
+#if defined(FITNESS_CACHE) && !defined(SPSA)
+        fit_cache = rng_cache_read_from_file(FITNESS_CACHE);
+#endif
         fp = fopen(LOG_FILE, "w"); fclose(fp);
         for (generation = 0; generation < GENERATION_MAX; generation++) {
+#ifdef COMMON_RANDOM_NUMBERS
+            /* Cached subjects are only reused with the same seed: */
+            seed.seed = (fit_cache != NULL) ? 1 + generation / FITNESS_CACHE_EPOCH : generation + 1;
+#endif
+            screened = 0;
+            subjects = 0;
+#ifdef SPSA
+            i = spsa_iterate(gv, &seed, generation, ((generation + 1) % SPSA_EVALUATE_INTERVAL == 0) || (generation == GENERATION_MAX - 1), &subjects);
+#else
+            incumbent = DBL_MAX;
             gd_generate_population(&seed);
             for (i = 0; i < POPULATION_SIZE; i++) {
-                para_fit[i] = rng_model_fit(gv, &para_pop[i]);
+                /* The centre point (the current seed) is always simulated: */
+                if ((surrogate != NULL) && (i != POPULATION_SIZE / 2) && (rng_surrogate_fit_bound(surrogate, &para_pop[i], SUBJECT_DATA) > best)) {
+                    para_fit[i] = DBL_MAX;
+                    screened++;
+                    continue;
+                }
+                /* Simulation stops early if clearly worse than the best so far: */
+                para_fit[i] = rng_model_fit(gv, &para_pop[i], incumbent, &subjects);
+                incumbent = MIN(incumbent, para_fit[i]);
 fprintf(stdout, "%1d", i % 10); fflush(stdout);
             }
 fprintf(stdout, "\n");
             i = gd_get_best_fit(POPULATION_SIZE);
+            best = para_fit[i];
+#endif
 
-            /* Append this generation's results to the log file: */
-            population_print_statistics(generation, i);
+            gd_report_generation(generation, i, screened, subjects);
             gd_copy_parameters(&seed, i);
+#ifdef FITNESS_CACHE
+            if (fit_cache != NULL) {
+                rng_cache_write_to_file(fit_cache, FITNESS_CACHE);
+            }
+#endif
 	}
 
+        rng_cache_free(fit_cache);
+        rng_surrogate_free(surrogate);
         rng_globals_destroy((RngData *)gv->task_data);
         oos_globals_destroy(gv);
     }
@@ -91,7 +91,7 @@ static double strength[SCHEMA_SET_SIZE] = {0.900, 1.003, 0.985, 0.980, 0.985, 0.
 
 #ifdef DEBUG
 
-static int schema_counts[SCHEMA_SET_SIZE];
+static __thread int schema_counts[SCHEMA_SET_SIZE];
 
 static void initialise_schema_counts()
 {
@@ -126,7 +126,7 @@ static void fprint_schema_counts(FILE *fp, OosVars *gv)
 
 /******************************************************************************/
 
-static int select_from_probability_distribution(double weights[SCHEMA_SET_SIZE], double temperature)
+int select_from_probability_distribution(double weights[SCHEMA_SET_SIZE], double temperature)
 {
     // Select an element between 1 and SCHEMA_SET_SIZE at random given the weights associated
     // with those elements.
@@ -486,43 +486,16 @@ static void coordinate_list_set(CairoxPoint *coordinates, int index, double x, d
 
 #define Y_SCALE  1.25
 
-Boolean rng_create(OosVars *gv, RngParameters *pars)
-{
-    RngData *task_data;
-    CairoxPoint *coordinates;
-
-    oos_model_free(gv);
-    oos_messages_free(gv);
-
-    g_free(gv->task_data);
-
-    gv->name = string_copy("RNG");
-    gv->cycle = 0;
-    gv->block = 0;
-    gv->stopped = FALSE;
+// The decay function used for working memory (alternatives are BUFFER_DECAY_EXPONENTIAL
+// and BUFFER_DECAY_WEIBULL):
+#define WM_DECAY BUFFER_DECAY_QUADRATIC
 
-    oos_process_create(gv, "Strategy Generation", BOX_STRATEGY, 0.2, 0.1*Y_SCALE, strategy_output);
-    oos_process_create(gv, "Monitoring", BOX_MONITORING, 0.8, 0.1*Y_SCALE, monitoring_output);
-    oos_process_create(gv, "Apply Set", BOX_APPLY_SET, 0.2, 0.7*Y_SCALE, apply_set_output);
-    oos_process_create(gv, "Generate Response", BOX_GENERATE_RESPONSE, 0.8, 0.7*Y_SCALE, generate_response_output);
+static void rng_diagram_create(OosVars *gv)
+{
+    // The arrows and annotations are only needed for drawing the diagram, so
+    // headless programs need not create them.
 
-    oos_buffer_create(gv, "Schema Network", BOX_SCHEMA_NETWORK, 0.2, 0.4*Y_SCALE, 
-                                            BUFFER_DECAY_NONE, 0, 
-                                            BUFFER_CAPACITY_UNLIMITED, 0, 
-					    BUFFER_EXCESS_IGNORE, 
-					    BUFFER_ACCESS_RANDOM);
-    oos_buffer_create(gv, "Working Memory", BOX_WORKING_MEMORY, 0.8, 0.4*Y_SCALE, 
-//                                            BUFFER_DECAY_EXPONENTIAL, pars->wm_decay_rate,
-//                                            BUFFER_DECAY_WEIBULL, pars->wm_decay_rate, 
-                                            BUFFER_DECAY_QUADRATIC, pars->wm_decay_rate, 
-                                            BUFFER_CAPACITY_UNLIMITED, 0, 
-					    BUFFER_EXCESS_IGNORE, 
-					    BUFFER_ACCESS_LIFO);
-    oos_buffer_create(gv, "Response Buffer", BOX_RESPONSE_BUFFER, 0.5, 0.7*Y_SCALE, 
-                                            BUFFER_DECAY_NONE, 0, 
-					    BUFFER_CAPACITY_LIMITED, 1, 
-					    BUFFER_EXCESS_RANDOM, 
-					    BUFFER_ACCESS_RANDOM);
+    CairoxPoint *coordinates;
 
     // Strategy sends to Schema Network
     coordinates = coordinate_list_create(2);
@@ -647,6 +620,157 @@ Boolean rng_create(OosVars *gv, RngParameters *pars)
     coordinate_list_set(coordinates, 3, 0.35, 0.61*Y_SCALE);
     coordinate_list_set(coordinates, 4, 0.95, 0.61*Y_SCALE);
     oos_arrow_create(gv, VS_CURVED, LS_DASHED, AH_NONE, coordinates, 4, 1.0);
+}
+
+static void rng_task_data_initialise(RngData *task_data, RngParameters *pars)
+{
+    task_data->params.wm_decay_rate = pars->wm_decay_rate;
+    task_data->params.wm_update_efficiency = pars->wm_update_efficiency;
+    task_data->params.selection_temperature = pars->selection_temperature;
+    task_data->params.switch_rate = pars->switch_rate;
+    task_data->params.monitoring_method = pars->monitoring_method;
+    task_data->params.monitoring_efficiency = pars->monitoring_efficiency;
+    task_data->params.individual_variability = pars->individual_variability;
+    task_data->params.sample_size = pars->sample_size;
+    task_data->params.seed = pars->seed;
+    task_data->subject_base = 0;
+}
+
+/******************************************************************************/
+/* Saving and restoring task data in model snapshots: *************************/
+
+static void rng_task_data_save(OosVars *gv, OosSnapshot *snapshot)
+{
+    RngData *task_data = (RngData *)gv->task_data;
+    int i;
+
+    oos_snapshot_put_int(snapshot, task_data->params.wm_decay_rate);
+    oos_snapshot_put_double(snapshot, task_data->params.wm_update_efficiency);
+    oos_snapshot_put_double(snapshot, task_data->params.selection_temperature);
+    oos_snapshot_put_double(snapshot, task_data->params.switch_rate);
+    oos_snapshot_put_int(snapshot, task_data->params.monitoring_method);
+    oos_snapshot_put_double(snapshot, task_data->params.monitoring_efficiency);
+    oos_snapshot_put_double(snapshot, task_data->params.individual_variability);
+    oos_snapshot_put_int(snapshot, task_data->params.sample_size);
+    oos_snapshot_put_long(snapshot, task_data->params.seed);
+    oos_snapshot_put_int(snapshot, task_data->subject_base);
+    oos_snapshot_put_bytes(snapshot, task_data->strengths, SCHEMA_SET_SIZE * sizeof(double));
+    oos_snapshot_put_int(snapshot, task_data->group.n);
+
+    /* Only subjects up to and including the current one hold data: */
+    oos_snapshot_put_int(snapshot, MIN(gv->block + 1, MAX_SUBJECTS));
+    for (i = 0; (i <= gv->block) && (i < MAX_SUBJECTS); i++) {
+        RngSubjectData *subject = &(task_data->subject[i]);
+
+        oos_snapshot_put_int(snapshot, subject->n);
+        oos_snapshot_put_bytes(snapshot, subject->response, MAX_TRIALS * sizeof(int));
+        oos_snapshot_put_bytes(snapshot, &(subject->scores), sizeof(RngScores));
+    }
+}
+
+static Boolean rng_task_data_restore(OosVars *gv, OosSnapshot *snapshot)
+{
+    // Decode into a temporary copy, so the task data is unchanged if the
+    // snapshot is not valid
+
+    RngData *task_data;
+    int i, j, n;
+
+    if ((task_data = (RngData *)malloc(sizeof(RngData))) == NULL) {
+        return(FALSE);
+    }
+    if (!(oos_snapshot_get_int(snapshot, &(task_data->params.wm_decay_rate)) &&
+          oos_snapshot_get_double(snapshot, &(task_data->params.wm_update_efficiency)) &&
+          oos_snapshot_get_double(snapshot, &(task_data->params.selection_temperature)) &&
+          oos_snapshot_get_double(snapshot, &(task_data->params.switch_rate)) &&
+          oos_snapshot_get_int(snapshot, &(task_data->params.monitoring_method)) &&
+          oos_snapshot_get_double(snapshot, &(task_data->params.monitoring_efficiency)) &&
+          oos_snapshot_get_double(snapshot, &(task_data->params.individual_variability)) &&
+          oos_snapshot_get_int(snapshot, &(task_data->params.sample_size)) &&
+          oos_snapshot_get_long(snapshot, &(task_data->params.seed)) &&
+          oos_snapshot_get_int(snapshot, &(task_data->subject_base)) &&
+          oos_snapshot_get_bytes(snapshot, task_data->strengths, SCHEMA_SET_SIZE * sizeof(double)) &&
+          oos_snapshot_get_int(snapshot, &(task_data->group.n)) &&
+          oos_snapshot_get_int(snapshot, &n))) {
+        free(task_data);
+        return(FALSE);
+    }
+    for (i = 0; i < MAX_SUBJECTS; i++) {
+        RngSubjectData *subject = &(task_data->subject[i]);
+
+        if (i < n) {
+            if (!(oos_snapshot_get_int(snapshot, &(subject->n)) &&
+                  oos_snapshot_get_bytes(snapshot, subject->response, MAX_TRIALS * sizeof(int)) &&
+                  oos_snapshot_get_bytes(snapshot, &(subject->scores), sizeof(RngScores)))) {
+                free(task_data);
+                return(FALSE);
+            }
+        }
+        else {
+            subject->n = 0;
+            for (j = 0; j < MAX_TRIALS; j++) {
+                subject->response[j] = -1;
+            }
+        }
+    }
+    if (gv->task_data != NULL) {
+        *((RngData *)gv->task_data) = *task_data;
+        free(task_data);
+    }
+    else {
+        gv->task_data = (void *)task_data;
+    }
+    return(TRUE);
+}
+
+/******************************************************************************/
+
+Boolean rng_model_create(OosVars *gv, RngParameters *pars, Boolean diagram)
+{
+    // Build the model's structure (and, if requested, its diagram) from scratch.
+    // Use rng_model_reset/2 to rerun an existing model with new parameters.
+
+    RngData *task_data;
+
+    oos_model_free(gv);
+    oos_messages_free(gv);
+
+    g_free(gv->task_data);
+    gv->task_data = NULL;
+
+    g_free(gv->name);
+    gv->name = string_copy("RNG");
+    gv->cycle = 0;
+    gv->block = 0;
+    gv->stopped = FALSE;
+
+    oos_process_create(gv, "Strategy Generation", BOX_STRATEGY, 0.2, 0.1*Y_SCALE, strategy_output);
+    oos_process_create(gv, "Monitoring", BOX_MONITORING, 0.8, 0.1*Y_SCALE, monitoring_output);
+    oos_process_create(gv, "Apply Set", BOX_APPLY_SET, 0.2, 0.7*Y_SCALE, apply_set_output);
+    oos_process_create(gv, "Generate Response", BOX_GENERATE_RESPONSE, 0.8, 0.7*Y_SCALE, generate_response_output);
+
+    oos_buffer_create(gv, "Schema Network", BOX_SCHEMA_NETWORK, 0.2, 0.4*Y_SCALE, 
+                                            BUFFER_DECAY_NONE, 0, 
+                                            BUFFER_CAPACITY_UNLIMITED, 0, 
+					    BUFFER_EXCESS_IGNORE, 
+					    BUFFER_ACCESS_RANDOM);
+    oos_buffer_create(gv, "Working Memory", BOX_WORKING_MEMORY, 0.8, 0.4*Y_SCALE, 
+                                            WM_DECAY, pars->wm_decay_rate, 
+                                            BUFFER_CAPACITY_UNLIMITED, 0, 
+					    BUFFER_EXCESS_IGNORE, 
+					    BUFFER_ACCESS_LIFO);
+    oos_buffer_create(gv, "Response Buffer", BOX_RESPONSE_BUFFER, 0.5, 0.7*Y_SCALE, 
+                                            BUFFER_DECAY_NONE, 0, 
+					    BUFFER_CAPACITY_LIMITED, 1, 
+					    BUFFER_EXCESS_RANDOM, 
+					    BUFFER_ACCESS_RANDOM);
+
+    if (diagram) {
+        rng_diagram_create(gv);
+    }
+
+    gv->task_data_save = rng_task_data_save;
+    gv->task_data_restore = rng_task_data_restore;
 
     if ((task_data = (RngData *)malloc(sizeof(RngData))) != NULL) {
 	int i, j;
@@ -657,20 +781,48 @@ Boolean rng_create(OosVars *gv, RngParameters *pars)
 	    }
 	}
 	task_data->group.n = 0;
-	task_data->params.wm_decay_rate = pars->wm_decay_rate;
-	task_data->params.wm_update_efficiency = pars->wm_update_efficiency;
-	task_data->params.selection_temperature = pars->selection_temperature;
-	task_data->params.switch_rate = pars->switch_rate;
-	task_data->params.monitoring_method = pars->monitoring_method;
-	task_data->params.monitoring_efficiency = pars->monitoring_efficiency;
-	task_data->params.individual_variability = pars->individual_variability;
-	task_data->params.sample_size = pars->sample_size;
+        rng_task_data_initialise(task_data, pars);
 	gv->task_data = (void *)task_data;
+        oos_initialise_session(gv, 100, task_data->params.sample_size);
+    }
+
+    return(gv->task_data != NULL);
+}
+
+Boolean rng_create(OosVars *gv, RngParameters *pars)
+{
+    return(rng_model_create(gv, pars, TRUE));
+}
+
+Boolean rng_model_reset(OosVars *gv, RngParameters *pars)
+{
+    // Prepare an existing model for a new run with (possibly) new parameters.
+    // Only the state is reset: boxes, arrows and annotations are retained.
+
+    RngData *task_data = (RngData *)gv->task_data;
+    int i, j, used;
+
+    if ((task_data == NULL) || (gv->components == NULL)) {
+        return(rng_model_create(gv, pars, FALSE));
+    }
+
+    oos_model_reset(gv);
+    oos_buffer_set_decay(gv, BOX_WORKING_MEMORY, WM_DECAY, pars->wm_decay_rate);
+
+    /* Only subjects used by the previous run need their responses cleared: */
+    used = MIN(task_data->group.n + 1, MAX_SUBJECTS);
+    for (i = 0; i < used; i++) {
+        task_data->subject[i].n = 0;
+        for (j = 0; j < MAX_TRIALS; j++) {
+            task_data->subject[i].response[j] = -1;
+        }
     }
+    task_data->group.n = 0;
+    rng_task_data_initialise(task_data, pars);
 
     oos_initialise_session(gv, 100, task_data->params.sample_size);
 
-    return(gv->task_data != NULL);
+    return(TRUE);
 }
 
 void rng_initialise_subject(OosVars *gv)
@@ -694,7 +846,7 @@ void rng_initialise_subject(OosVars *gv)
 
 void rng_globals_destroy(RngData *task_data)
 {
-    g_free(task_data);
+    free(task_data);
 }
 
 #if DEBUG
@@ -711,10 +863,49 @@ static void rng_print_parameters(FILE *fp, RngData *task_data)
 
 /******************************************************************************/
 
+static void rng_random_stream_select(OosVars *gv, RngData *task_data, int stream)
+{
+    // Common random numbers: if the parameters include a seed, the random
+    // number generator is reseeded from (seed, subject, stream) for each
+    // subject, with separate streams for the subject's schema strengths (0)
+    // and for the trial itself (1). Runs with the same seed then simulate the
+    // same "subjects" (the strengths are identical whatever the parameters)
+    // and start each trial from the same random numbers, so that differences
+    // in their results reflect the parameters rather than sampling noise.
+    // (Reseeding every cycle was tried, but once runs diverge it aligns the
+    // draws less well than a single stream per trial.) Subjects are numbered
+    // from subject_base, so a run can continue an earlier one with new subjects.
+
+    if (task_data->params.seed != 0) {
+        random_seed(((unsigned long) task_data->params.seed * 0x9E3779B97F4A7C15UL) ^ ((unsigned long) (task_data->subject_base + gv->block) << 32) ^ (unsigned long) stream);
+    }
+}
+
+static void rng_run_subject(OosVars *gv, RngData *task_data, FILE *fp)
+{
+    // Run the current subject (gv->block) to the end of the block
+
+    RngSubjectData *subject;
+
+    oos_initialise_trial(gv);
+    rng_random_stream_select(gv, task_data, 0);
+    rng_initialise_subject(gv);
+    rng_random_stream_select(gv, task_data, 1);
+    while (oos_step(gv)) {
+#ifdef DEBUG
+        oos_dump(gv, TRUE);
+#endif
+    }
+    subject = &(task_data->subject[gv->block]);
+    rng_analyse_subject_responses(fp, subject, gv->trials_per_subject);
+    oos_step_block(gv);
+    task_data->group.n = gv->block;
+}
+
 void rng_run(OosVars *gv)
 {
     RngData *task_data;
-    RngSubjectData *subject;
+    RandomState caller_state;
     FILE *fp = NULL;
 
 #ifdef DEBUG
@@ -724,26 +915,68 @@ void rng_run(OosVars *gv)
 #ifdef DEBUG
     rng_print_parameters(stdout, task_data);
 #endif
+    /* Reseeding for common random numbers shouldn't affect the caller's stream: */
+    random_state_get(&caller_state);
     while (gv->block < gv->subjects_per_experiment) {
-	oos_initialise_trial(gv);
-	rng_initialise_subject(gv);
-	while (oos_step(gv)) {
-#ifdef DEBUG
-	    oos_dump(gv, TRUE);
-#endif
-	}
-        subject = &(task_data->subject[gv->block]);
-	rng_analyse_subject_responses(fp, subject, gv->trials_per_subject);
-	oos_step_block(gv);
-        task_data->group.n = gv->block;
+        rng_run_subject(gv, task_data, fp);
     }
 #ifdef DEBUG
     fprint_schema_counts(fp, gv);
 #endif
+    if (task_data->params.seed != 0) {
+        random_state_set(&caller_state);
+    }
+#ifdef OOS_PROFILE
+    oos_profile_print(stdout, gv);
+    oos_profile_reset(gv);
+#endif
 
     if ((fp != NULL) && (fp != stdout)) {
         fclose(fp);
     }
 }
 
+void rng_run_checkpointed(OosVars *gv, char *filename, int interval)
+{
+    // As rng_run/1, but save a snapshot to filename every interval subjects.
+    // If the file already exists the run resumes from it, so an interrupted
+    // long run can be restarted. The file is removed when the run completes.
+    // The model should be reset first: a checkpoint that cannot be restored
+    // leaves it untouched, so the run then starts from the beginning.
+
+    OosSnapshot *snapshot;
+    RngData *task_data;
+    RandomState caller_state;
+
+    random_state_get(&caller_state);
+    if ((snapshot = oos_snapshot_read_from_file(filename)) != NULL) {
+        if (!oos_snapshot_restore(gv, snapshot)) {
+            fprintf(stdout, "WARNING: Cannot resume from checkpoint %s; starting again\n", filename);
+        }
+        oos_snapshot_free(snapshot);
+    }
+    task_data = (RngData *)gv->task_data;
+
+    while (gv->block < gv->subjects_per_experiment) {
+        rng_run_subject(gv, task_data, NULL);
+
+        if ((interval > 0) && (gv->block % interval == 0) && (gv->block < gv->subjects_per_experiment)) {
+            if ((snapshot = oos_snapshot_create(gv)) != NULL) {
+                if (!oos_snapshot_write_to_file(snapshot, filename)) {
+                    fprintf(stdout, "WARNING: Failed to write checkpoint %s\n", filename);
+                }
+                oos_snapshot_free(snapshot);
+            }
+        }
+    }
+    if (task_data->params.seed != 0) {
+        random_state_set(&caller_state);
+    }
+#ifdef OOS_PROFILE
+    oos_profile_print(stdout, gv);
+    oos_profile_reset(gv);
+#endif
+    remove(filename);
+}
+
 /******************************************************************************/
@@ -0,0 +1,95 @@
+/* Replay a recorded run of the model (see oos_record_open/2) */
+
+#include "rng.h"
+#include "rng_defaults.h"
+
+/******************************************************************************/
+/* Usage: rng_replay recording [block]
+
+Record a run by setting OOS_RECORD to a file name before running it, e.g.
+
+  OOS_RECORD=run.rec ./rng
+
+With just the recording, every block is replayed and checked against the
+state recorded at its end, and the number that differ is reported: after a
+change to the buffer code, any difference means the change altered the
+model's behaviour. With a block number (counting from 0 in the order that
+blocks were recorded) that block alone is replayed, and the model's messages
+and buffer contents are printed for each cycle.
+
+Replays need no task: processes are never called. The model is built only to
+supply the boxes, so it must have been recorded from the same model.
+
+*******************************************************************************/
+
+static int replay_verify(OosVars *gv, OosReplay *replay)
+{
+    int k, cycles = 0;
+
+    for (k = 0; k < oos_replay_blocks(replay); k++) {
+        if (!oos_replay_block(gv, replay, k)) {
+            fprintf(stdout, "WARNING: Cannot start block %d of the recording\n", k);
+            continue;
+        }
+        while (oos_replay_step(gv, replay)) {
+            cycles++;
+        }
+    }
+    fprintf(stdout, "Replayed %d blocks (%d cycles): %d mismatches\n", oos_replay_blocks(replay), cycles, oos_replay_mismatches(replay));
+    return(oos_replay_mismatches(replay));
+}
+
+static void replay_dump(OosVars *gv, OosReplay *replay, int k)
+{
+    if (!oos_replay_block(gv, replay, k)) {
+        fprintf(stdout, "WARNING: No block %d in the recording (it has %d)\n", k, oos_replay_blocks(replay));
+        return;
+    }
+    oos_dump(gv, TRUE);
+    while (oos_replay_step(gv, replay)) {
+        oos_dump(gv, TRUE);
+    }
+    if (oos_replay_mismatches(replay) > 0) {
+        fprintf(stdout, "WARNING: The replay diverged from the recording\n");
+    }
+}
+
+/******************************************************************************/
+
+int main(int argc, char **argv)
+{
+    OosReplay *replay;
+    OosVars *gv;
+    int mismatches = 0;
+
+    if ((argc < 2) || (argc > 3)) {
+        fprintf(stdout, "Usage: %s recording [block]\n", argv[0]);
+        exit(1);
+    }
+    else if ((replay = oos_replay_open(argv[1])) == NULL) {
+        fprintf(stdout, "ABORTING: Cannot open recording %s\n", argv[1]);
+        exit(1);
+    }
+    else if ((gv = oos_globals_create()) == NULL) {
+        fprintf(stdout, "ABORTING: Cannot allocate global variable space\n");
+        exit(1);
+    }
+    else if (!rng_model_create(gv, &pars, FALSE)) {
+        fprintf(stdout, "ABORTING: Cannot create RNG\n");
+        exit(1);
+    }
+
+    if (argc == 3) {
+        replay_dump(gv, replay, atoi(argv[2]));
+    }
+    else {
+        mismatches = replay_verify(gv, replay);
+    }
+
+    oos_replay_close(replay);
+    rng_globals_destroy((RngData *)gv->task_data);
+    oos_globals_destroy(gv);
+    exit(mismatches > 0 ? 2 : 1);
+}
+
+/******************************************************************************/
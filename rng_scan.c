@@ -0,0 +1,576 @@
+/* Reading and writing binary parameter scan files (see rng_scan.h) */
+
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "rng_scan.h"
+
+// Number of records held in memory before they are written out:
+#define SCAN_WRITE_BUFFER  256
+
+char *scan_column_name[SCAN_COLUMNS] = {
+    "WMD", "WMU", "Temp", "SwR", "ME",
+    "R", "RNG", "RR", "AA", "OA", "TPI"
+};
+
+/******************************************************************************/
+
+static void scan_header_initialise(ScanHeader *header)
+{
+    int i;
+
+    memset(header, 0, sizeof(ScanHeader));
+    strncpy(header->magic, SCAN_MAGIC, 8);
+    header->version = SCAN_VERSION;
+    header->header_size = sizeof(ScanHeader);
+    header->columns = SCAN_COLUMNS;
+    header->parameter_columns = SCAN_PARAMETER_COLUMNS;
+    for (i = 0; i < SCAN_COLUMNS; i++) {
+        strncpy(header->column_name[i], scan_column_name[i], SCAN_COLUMN_NAME_LENGTH);
+    }
+}
+
+static Boolean scan_header_check(const char *filename, ScanHeader *header)
+{
+    ScanHeader expected;
+
+    scan_header_initialise(&expected);
+    if (memcmp(header, &expected, sizeof(ScanHeader)) != 0) {
+        fprintf(stdout, "WARNING: %s is not a scan file or has different columns\n", filename);
+        return(FALSE);
+    }
+    return(TRUE);
+}
+
+/******************************************************************************/
+
+RngScanWriter *rng_scan_writer_open(const char *filename)
+{
+    // Open a scan file for appending, writing the header if the file is new
+    // and removing any partial record from the end of an existing file
+
+    RngScanWriter *writer;
+    ScanHeader header;
+    long length;
+
+    if ((writer = (RngScanWriter *)malloc(sizeof(RngScanWriter))) == NULL) {
+        return(NULL);
+    }
+    else if ((writer->buffer = (double *)malloc(SCAN_WRITE_BUFFER * SCAN_COLUMNS * sizeof(double))) == NULL) {
+        free(writer);
+        return(NULL);
+    }
+    else if ((writer->fp = fopen(filename, "a+b")) == NULL) {
+        fprintf(stdout, "WARNING: Cannot open %s for writing\n", filename);
+        free(writer->buffer);
+        free(writer);
+        return(NULL);
+    }
+    writer->buffered = 0;
+
+    fseek(writer->fp, 0, SEEK_END);
+    length = ftell(writer->fp);
+    if (length == 0) {
+        scan_header_initialise(&header);
+        fwrite(&header, sizeof(ScanHeader), 1, writer->fp);
+    }
+    else {
+        fseek(writer->fp, 0, SEEK_SET);
+        if ((fread(&header, sizeof(ScanHeader), 1, writer->fp) != 1) || !scan_header_check(filename, &header)) {
+            fclose(writer->fp);
+            free(writer->buffer);
+            free(writer);
+            return(NULL);
+        }
+        else if ((length - sizeof(ScanHeader)) % (SCAN_COLUMNS * sizeof(double)) != 0) {
+            // Records are appended, so drop the fragment or they would all be misaligned
+            length -= (length - sizeof(ScanHeader)) % (SCAN_COLUMNS * sizeof(double));
+            fprintf(stdout, "WARNING: %s ends with a partial record, which has been removed\n", filename);
+            if (ftruncate(fileno(writer->fp), length) != 0) {
+                fprintf(stdout, "WARNING: Cannot remove the partial record from %s\n", filename);
+                fclose(writer->fp);
+                free(writer->buffer);
+                free(writer);
+                return(NULL);
+            }
+        }
+        fseek(writer->fp, 0, SEEK_END);
+    }
+    return(writer);
+}
+
+Boolean rng_scan_writer_flush(RngScanWriter *writer)
+{
+    Boolean ok;
+
+    ok = (fwrite(writer->buffer, SCAN_COLUMNS * sizeof(double), writer->buffered, writer->fp) == writer->buffered);
+    writer->buffered = 0;
+    fflush(writer->fp);
+    return(ok);
+}
+
+Boolean rng_scan_writer_append(RngScanWriter *writer, RngParameters *pars, RngGroupData *results)
+{
+    double *record = writer->buffer + writer->buffered * SCAN_COLUMNS;
+
+    record[SCAN_WMD] = pars->wm_decay_rate;
+    record[SCAN_WMU] = pars->wm_update_efficiency;
+    record[SCAN_TEMP] = pars->selection_temperature;
+    record[SCAN_SWR] = pars->switch_rate;
+    record[SCAN_ME] = pars->monitoring_efficiency;
+    record[SCAN_R] = results->mean.r1;
+    record[SCAN_RNG] = results->mean.rng;
+    record[SCAN_RR] = results->mean.rr;
+    record[SCAN_AA] = results->mean.aa;
+    record[SCAN_OA] = results->mean.oa;
+    record[SCAN_TPI] = results->mean.tpi;
+
+    if (++writer->buffered == SCAN_WRITE_BUFFER) {
+        return(rng_scan_writer_flush(writer));
+    }
+    return(TRUE);
+}
+
+void rng_scan_writer_close(RngScanWriter *writer)
+{
+    if (writer != NULL) {
+        if (!rng_scan_writer_flush(writer)) {
+            fprintf(stdout, "WARNING: Failed to write scan records\n");
+        }
+        fclose(writer->fp);
+        free(writer->buffer);
+        free(writer);
+    }
+}
+
+/******************************************************************************/
+
+RngScanFile *rng_scan_file_open(const char *filename)
+{
+    // Map a scan file into memory for reading. Returns NULL (with a warning)
+    // if the file cannot be opened or is not a scan file.
+
+    RngScanFile *file;
+    struct stat status;
+
+    if ((file = (RngScanFile *)malloc(sizeof(RngScanFile))) == NULL) {
+        return(NULL);
+    }
+    else if ((file->fd = open(filename, O_RDONLY)) < 0) {
+        fprintf(stdout, "Open failed: %s is not readable\n", filename);
+        free(file);
+        return(NULL);
+    }
+    else if ((fstat(file->fd, &status) != 0) || (status.st_size < sizeof(ScanHeader))) {
+        fprintf(stdout, "WARNING: %s is not a scan file\n", filename);
+        close(file->fd);
+        free(file);
+        return(NULL);
+    }
+
+    file->map_length = status.st_size;
+    if ((file->map = mmap(NULL, file->map_length, PROT_READ, MAP_SHARED, file->fd, 0)) == MAP_FAILED) {
+        fprintf(stdout, "WARNING: Cannot map %s into memory\n", filename);
+        close(file->fd);
+        free(file);
+        return(NULL);
+    }
+    else if (!scan_header_check(filename, (ScanHeader *)file->map)) {
+        rng_scan_file_close(file);
+        return(NULL);
+    }
+    madvise(file->map, file->map_length, MADV_SEQUENTIAL);
+    file->records = (const double *)((char *)file->map + sizeof(ScanHeader));
+    file->rows = (file->map_length - sizeof(ScanHeader)) / (SCAN_COLUMNS * sizeof(double));
+    return(file);
+}
+
+void rng_scan_file_close(RngScanFile *file)
+{
+    if (file != NULL) {
+        munmap(file->map, file->map_length);
+        close(file->fd);
+        free(file);
+    }
+}
+
+void rng_scan_record_get(RngScanFile *file, long row, RngParameters *pars, RngGroupData *results)
+{
+    // Copy one record into the parameter and result structures. Parameters
+    // that are not scanned are left unchanged. Results not saved are zeroed.
+
+    const double *record = rng_scan_record(file, row);
+
+    pars->wm_decay_rate = (int) record[SCAN_WMD];
+    pars->wm_update_efficiency = record[SCAN_WMU];
+    pars->selection_temperature = record[SCAN_TEMP];
+    pars->switch_rate = record[SCAN_SWR];
+    pars->monitoring_efficiency = record[SCAN_ME];
+
+    memset(results, 0, sizeof(RngGroupData));
+    results->mean.r1 = record[SCAN_R];
+    results->mean.rng = record[SCAN_RNG];
+    results->mean.rr = record[SCAN_RR];
+    results->mean.aa = record[SCAN_AA];
+    results->mean.oa = record[SCAN_OA];
+    results->mean.tpi = record[SCAN_TPI];
+}
+
+/******************************************************************************/
+/* Lists of best matches: *****************************************************/
+
+void rng_scan_match_list_initialise(ScanMatch *list, int k)
+{
+    int i;
+
+    for (i = 0; i < k; i++) {
+        list[i].fit = DBL_MAX;
+        list[i].row = -1;
+    }
+}
+
+void rng_scan_match_list_insert(ScanMatch *list, int k, double fit, long row)
+{
+    // Insert into a list of k matches sorted by fit (best first), dropping the
+    // worst. Ties go to the earlier row, so results don't depend on the order
+    // in which records are visited.
+
+    int i = k - 1;
+
+    if ((fit > list[i].fit) || ((fit == list[i].fit) && (row > list[i].row))) {
+        return;
+    }
+    while ((i > 0) && ((fit < list[i-1].fit) || ((fit == list[i-1].fit) && (row < list[i-1].row)))) {
+        list[i] = list[i-1];
+        i--;
+    }
+    list[i].fit = fit;
+    list[i].row = row;
+}
+
+/******************************************************************************/
+/* The scan index: ************************************************************/
+
+// The index is a static k-d tree stored implicitly: the node for records
+// [lo, hi) is at (lo + hi) / 2, with records before it no greater and records
+// after it no less on its splitting dimension. The split dimension is the one
+// with the largest spread in z-scores (relative to the whole scan), and
+// ranges of at most SCAN_INDEX_LEAF_SIZE records are searched exhaustively.
+//
+// Fit (see rng_data_calculate_fit/2) is the largest DV difference scaled by
+// the target's sd, so the distance from a query to a splitting plane is its
+// difference on that dimension scaled in the same way. Because fit is a
+// weighted maximum this allows exact (not approximate) nearest neighbours.
+
+typedef struct scan_point {
+    double dv[SCAN_DV_COLUMNS];
+    long   row;
+} ScanPoint;
+
+static void scan_point_swap(ScanPoint *points, long i, long j)
+{
+    ScanPoint tmp = points[i];
+    points[i] = points[j];
+    points[j] = tmp;
+}
+
+static void scan_points_select(ScanPoint *points, long lo, long hi, long nth, int d)
+{
+    // Partially order points[lo..hi) on dimension d so that points[nth] is
+    // where it would be in a full sort (Hoare's selection algorithm)
+
+    while (hi - lo > 1) {
+        double pivot = points[(lo + hi) / 2].dv[d];
+        long i = lo, j = hi - 1;
+
+        while (i <= j) {
+            while (points[i].dv[d] < pivot) i++;
+            while (points[j].dv[d] > pivot) j--;
+            if (i <= j) {
+                scan_point_swap(points, i++, j--);
+            }
+        }
+        if (nth <= j) {
+            hi = j + 1;
+        }
+        else if (nth >= i) {
+            lo = i;
+        }
+        else {
+            return;
+        }
+    }
+}
+
+static void scan_index_build_range(ScanPoint *points, char *split, double *sd, long lo, long hi)
+{
+    double min[SCAN_DV_COLUMNS], max[SCAN_DV_COLUMNS], spread = -1.0;
+    long i, mid;
+    int d, dim = 0;
+
+    if (hi - lo <= SCAN_INDEX_LEAF_SIZE) {
+        for (i = lo; i < hi; i++) {
+            split[i] = -1;
+        }
+        return;
+    }
+
+    for (d = 0; d < SCAN_DV_COLUMNS; d++) {
+        min[d] = DBL_MAX;
+        max[d] = -DBL_MAX;
+    }
+    for (i = lo; i < hi; i++) {
+        for (d = 0; d < SCAN_DV_COLUMNS; d++) {
+            min[d] = MIN(min[d], points[i].dv[d]);
+            max[d] = MAX(max[d], points[i].dv[d]);
+        }
+    }
+    for (d = 0; d < SCAN_DV_COLUMNS; d++) {
+        if ((max[d] - min[d]) / sd[d] > spread) {
+            spread = (max[d] - min[d]) / sd[d];
+            dim = d;
+        }
+    }
+
+    mid = (lo + hi) / 2;
+    scan_points_select(points, lo, hi, mid, dim);
+    split[mid] = dim;
+    scan_index_build_range(points, split, sd, lo, mid);
+    scan_index_build_range(points, split, sd, mid + 1, hi);
+}
+
+char *rng_scan_index_filename(const char *scan_filename)
+{
+    // The index for scan file X.dat is X.idx
+
+    char *filename, *dot;
+
+    filename = string_new(strlen(scan_filename) + 5);
+    strcpy(filename, scan_filename);
+    if ((dot = strrchr(filename, '.')) != NULL) {
+        *dot = '\0';
+    }
+    strcat(filename, ".idx");
+    return(filename);
+}
+
+Boolean rng_scan_index_build(RngScanFile *file, const char *index_filename)
+{
+    // Build an index over all records currently in the scan file. The index
+    // is written to a temporary file and then renamed over any previous one.
+
+    ScanIndexHeader header;
+    ScanPoint *points;
+    char *split, tmp_file[1024];
+    double *point;
+    Boolean ok;
+    FILE *fp;
+    long i;
+    int d;
+
+    if ((points = (ScanPoint *)malloc(MAX(file->rows, 1) * sizeof(ScanPoint))) == NULL) {
+        fprintf(stdout, "WARNING: Memory allocation failed in %s\n", __FUNCTION__);
+        return(FALSE);
+    }
+    else if ((split = (char *)malloc(MAX(file->rows, 1))) == NULL) {
+        fprintf(stdout, "WARNING: Memory allocation failed in %s\n", __FUNCTION__);
+        free(points);
+        return(FALSE);
+    }
+
+    memset(&header, 0, sizeof(ScanIndexHeader));
+    strncpy(header.magic, SCAN_INDEX_MAGIC, 8);
+    header.version = SCAN_INDEX_VERSION;
+    header.leaf_size = SCAN_INDEX_LEAF_SIZE;
+    header.rows = file->rows;
+
+    /* Gather the DVs and their mean and sd across the scan: */
+    for (i = 0; i < file->rows; i++) {
+        const double *record = rng_scan_record(file, i);
+        for (d = 0; d < SCAN_DV_COLUMNS; d++) {
+            points[i].dv[d] = record[SCAN_PARAMETER_COLUMNS + d];
+            header.mean[d] += points[i].dv[d];
+            header.sd[d] += points[i].dv[d] * points[i].dv[d];
+        }
+        points[i].row = i;
+    }
+    for (d = 0; d < SCAN_DV_COLUMNS; d++) {
+        if (file->rows > 0) {
+            header.mean[d] = header.mean[d] / file->rows;
+            header.sd[d] = sqrt(MAX(header.sd[d] / file->rows - header.mean[d] * header.mean[d], 0.0));
+        }
+        if (header.sd[d] <= 0.0) {
+            header.sd[d] = 1.0;
+        }
+    }
+
+    scan_index_build_range(points, split, header.sd, 0, file->rows);
+
+    g_snprintf(tmp_file, 1024, "%s.tmp", index_filename);
+    if ((fp = fopen(tmp_file, "wb")) == NULL) {
+        fprintf(stdout, "WARNING: Cannot open %s for writing\n", tmp_file);
+        ok = FALSE;
+    }
+    else {
+        ok = (fwrite(&header, sizeof(ScanIndexHeader), 1, fp) == 1);
+        for (i = 0; ok && (i < file->rows); i++) {
+            int64_t row = points[i].row;
+            ok = (fwrite(&row, sizeof(int64_t), 1, fp) == 1);
+        }
+        for (i = 0; ok && (i < file->rows); i++) {
+            point = points[i].dv;
+            ok = (fwrite(point, sizeof(double), SCAN_DV_COLUMNS, fp) == SCAN_DV_COLUMNS);
+        }
+        ok = ok && (fwrite(split, 1, file->rows, fp) == file->rows);
+        ok = (fclose(fp) == 0) && ok;
+        ok = ok && (rename(tmp_file, index_filename) == 0);
+        if (!ok) {
+            fprintf(stdout, "WARNING: Failed to write scan index %s\n", index_filename);
+            remove(tmp_file);
+        }
+    }
+    free(split);
+    free(points);
+    return(ok);
+}
+
+RngScanIndex *rng_scan_index_open(const char *index_filename)
+{
+    // Map an index into memory. Returns NULL if there is no (valid) index.
+
+    RngScanIndex *index;
+    struct stat status;
+    size_t expected;
+
+    if ((index = (RngScanIndex *)malloc(sizeof(RngScanIndex))) == NULL) {
+        return(NULL);
+    }
+    else if ((index->fd = open(index_filename, O_RDONLY)) < 0) {
+        free(index);
+        return(NULL);
+    }
+    else if ((fstat(index->fd, &status) != 0) || (status.st_size < sizeof(ScanIndexHeader))) {
+        close(index->fd);
+        free(index);
+        return(NULL);
+    }
+
+    index->map_length = status.st_size;
+    if ((index->map = mmap(NULL, index->map_length, PROT_READ, MAP_SHARED, index->fd, 0)) == MAP_FAILED) {
+        close(index->fd);
+        free(index);
+        return(NULL);
+    }
+    index->header = (ScanIndexHeader *)index->map;
+    expected = sizeof(ScanIndexHeader) + index->header->rows * (sizeof(int64_t) + SCAN_DV_COLUMNS * sizeof(double) + 1);
+    if ((strncmp(index->header->magic, SCAN_INDEX_MAGIC, 8) != 0) || (index->header->version != SCAN_INDEX_VERSION) || (index->header->leaf_size != SCAN_INDEX_LEAF_SIZE) || (index->map_length != expected)) {
+        fprintf(stdout, "WARNING: %s is not a valid scan index\n", index_filename);
+        rng_scan_index_close(index);
+        return(NULL);
+    }
+    index->row = (const int64_t *)((char *)index->map + sizeof(ScanIndexHeader));
+    index->point = (const double *)(index->row + index->header->rows);
+    index->split = (const char *)(index->point + index->header->rows * SCAN_DV_COLUMNS);
+    return(index);
+}
+
+void rng_scan_index_close(RngScanIndex *index)
+{
+    if (index != NULL) {
+        munmap(index->map, index->map_length);
+        close(index->fd);
+        free(index);
+    }
+}
+
+static double scan_point_fit(const double *point, double *target, double *target_sd)
+{
+    // As rng_data_calculate_fit/2, but on the DV columns of a scan record
+
+    double fit = 0.0;
+    int d;
+
+    for (d = 0; d < SCAN_DV_COLUMNS; d++) {
+        fit = MAX(fit, fabs((target[d] - point[d]) / target_sd[d]));
+    }
+    return(fit);
+}
+
+static void scan_index_search(RngScanIndex *index, long lo, long hi, double *target, double *target_sd, int k, ScanMatch *matches)
+{
+    const double *point;
+    double diff;
+    long i, mid;
+    int d;
+
+    if (hi - lo <= SCAN_INDEX_LEAF_SIZE) {
+        for (i = lo; i < hi; i++) {
+            point = index->point + i * SCAN_DV_COLUMNS;
+            rng_scan_match_list_insert(matches, k, scan_point_fit(point, target, target_sd), index->row[i]);
+        }
+        return;
+    }
+
+    mid = (lo + hi) / 2;
+    point = index->point + mid * SCAN_DV_COLUMNS;
+    rng_scan_match_list_insert(matches, k, scan_point_fit(point, target, target_sd), index->row[mid]);
+
+    /* Search the near side first, then the far side if it could hold a match: */
+    d = index->split[mid];
+    diff = (target[d] - point[d]) / target_sd[d];
+    if (diff < 0) {
+        scan_index_search(index, lo, mid, target, target_sd, k, matches);
+        if (-diff <= matches[k-1].fit) {
+            scan_index_search(index, mid + 1, hi, target, target_sd, k, matches);
+        }
+    }
+    else {
+        scan_index_search(index, mid + 1, hi, target, target_sd, k, matches);
+        if (diff <= matches[k-1].fit) {
+            scan_index_search(index, lo, mid, target, target_sd, k, matches);
+        }
+    }
+}
+
+void rng_scan_index_query(RngScanIndex *index, RngScanFile *file, RngGroupData *target, int k, ScanMatch *matches)
+{
+    // Find the k records that best fit the target, best first. Records added
+    // to the scan file since the index was built are checked exhaustively, as
+    // are all records if the index does not match the file.
+
+    double dv[SCAN_DV_COLUMNS], sd[SCAN_DV_COLUMNS];
+    long i, indexed = 0;
+
+    dv[SCAN_R - SCAN_PARAMETER_COLUMNS] = target->mean.r1;
+    dv[SCAN_RNG - SCAN_PARAMETER_COLUMNS] = target->mean.rng;
+    dv[SCAN_RR - SCAN_PARAMETER_COLUMNS] = target->mean.rr;
+    dv[SCAN_AA - SCAN_PARAMETER_COLUMNS] = target->mean.aa;
+    dv[SCAN_OA - SCAN_PARAMETER_COLUMNS] = target->mean.oa;
+    dv[SCAN_TPI - SCAN_PARAMETER_COLUMNS] = target->mean.tpi;
+    sd[SCAN_R - SCAN_PARAMETER_COLUMNS] = target->sd.r1;
+    sd[SCAN_RNG - SCAN_PARAMETER_COLUMNS] = target->sd.rng;
+    sd[SCAN_RR - SCAN_PARAMETER_COLUMNS] = target->sd.rr;
+    sd[SCAN_AA - SCAN_PARAMETER_COLUMNS] = target->sd.aa;
+    sd[SCAN_OA - SCAN_PARAMETER_COLUMNS] = target->sd.oa;
+    sd[SCAN_TPI - SCAN_PARAMETER_COLUMNS] = target->sd.tpi;
+
+    rng_scan_match_list_initialise(matches, k);
+
+    if (index != NULL) {
+        if ((index->header->rows > file->rows) || ((index->header->rows > 0) && (memcmp(index->point, rng_scan_record(file, index->row[0]) + SCAN_PARAMETER_COLUMNS, SCAN_DV_COLUMNS * sizeof(double)) != 0))) {
+            fprintf(stdout, "WARNING: Scan index is out of date; ignoring it\n");
+        }
+        else {
+            scan_index_search(index, 0, index->header->rows, dv, sd, k, matches);
+            indexed = index->header->rows;
+        }
+    }
+    for (i = indexed; i < file->rows; i++) {
+        const double *record = rng_scan_record(file, i);
+        rng_scan_match_list_insert(matches, k, scan_point_fit(record + SCAN_PARAMETER_COLUMNS, dv, sd), i);
+    }
+}
+
+/******************************************************************************/
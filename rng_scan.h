@@ -0,0 +1,111 @@
+#ifndef _rng_scan_h_
+
+#define _rng_scan_h_
+
+#include <stdint.h>
+#include "rng.h"
+
+/******************************************************************************/
+/* Binary parameter scan files:
+
+A scan file is a fixed header followed by fixed-width records, one per run.
+The header names each column, so readers can check that the file holds what
+they expect. Every column is stored as a double (in native byte order) so a
+reader can mmap the file and index records directly. Records are only ever
+appended, and a partial trailing record (e.g. from an interrupted run) is
+ignored by readers and removed by the writer before it appends more.
+
+*******************************************************************************/
+
+#define SCAN_FILE               "FIT_SCAN.dat"
+#define SCAN_MAGIC              "RNGSCAN"
+#define SCAN_VERSION            1
+#define SCAN_COLUMN_NAME_LENGTH 8
+
+typedef enum scan_column {
+    /* Parameters / IVs: */
+    SCAN_WMD, SCAN_WMU, SCAN_TEMP, SCAN_SWR, SCAN_ME,
+    /* Results / DVs: */
+    SCAN_R, SCAN_RNG, SCAN_RR, SCAN_AA, SCAN_OA, SCAN_TPI,
+    SCAN_COLUMNS
+} ScanColumn;
+
+#define SCAN_PARAMETER_COLUMNS  5
+#define SCAN_DV_COLUMNS         (SCAN_COLUMNS - SCAN_PARAMETER_COLUMNS)
+
+typedef struct scan_header {
+    char     magic[8];
+    int32_t  version;
+    int32_t  header_size;
+    int32_t  columns;
+    int32_t  parameter_columns;
+    char     column_name[SCAN_COLUMNS][SCAN_COLUMN_NAME_LENGTH];
+} ScanHeader;
+
+typedef struct rng_scan_writer {
+    FILE    *fp;
+    double  *buffer;
+    int      buffered;
+} RngScanWriter;
+
+typedef struct rng_scan_file {
+    int            fd;
+    void          *map;
+    size_t         map_length;
+    const double  *records;
+    long           rows;
+} RngScanFile;
+
+typedef struct scan_match {
+    double fit;
+    long   row;
+} ScanMatch;
+
+/* A k-d tree over the DV columns of a scan file, saved alongside it: */
+
+#define SCAN_INDEX_MAGIC        "RNGSIDX"
+#define SCAN_INDEX_VERSION      1
+#define SCAN_INDEX_LEAF_SIZE    8
+
+typedef struct scan_index_header {
+    char     magic[8];
+    int32_t  version;
+    int32_t  leaf_size;
+    int64_t  rows;
+    double   mean[SCAN_DV_COLUMNS];
+    double   sd[SCAN_DV_COLUMNS];
+} ScanIndexHeader;
+
+typedef struct rng_scan_index {
+    int              fd;
+    void            *map;
+    size_t           map_length;
+    ScanIndexHeader *header;
+    const int64_t   *row;         /* Scan record of each tree node           */
+    const double    *point;       /* DVs of each tree node                   */
+    const char      *split;       /* Splitting dimension of each tree node   */
+} RngScanIndex;
+
+extern char *scan_column_name[SCAN_COLUMNS];
+
+extern RngScanWriter *rng_scan_writer_open(const char *filename);
+extern Boolean        rng_scan_writer_append(RngScanWriter *writer, RngParameters *pars, RngGroupData *results);
+extern Boolean        rng_scan_writer_flush(RngScanWriter *writer);
+extern void           rng_scan_writer_close(RngScanWriter *writer);
+
+extern RngScanFile   *rng_scan_file_open(const char *filename);
+extern void           rng_scan_file_close(RngScanFile *file);
+extern void           rng_scan_record_get(RngScanFile *file, long row, RngParameters *pars, RngGroupData *results);
+
+extern void           rng_scan_match_list_initialise(ScanMatch *list, int k);
+extern void           rng_scan_match_list_insert(ScanMatch *list, int k, double fit, long row);
+
+extern char          *rng_scan_index_filename(const char *scan_filename);
+extern Boolean        rng_scan_index_build(RngScanFile *file, const char *index_filename);
+extern RngScanIndex  *rng_scan_index_open(const char *index_filename);
+extern void           rng_scan_index_close(RngScanIndex *index);
+extern void           rng_scan_index_query(RngScanIndex *index, RngScanFile *file, RngGroupData *target, int k, ScanMatch *matches);
+
+#define rng_scan_record(F, I)   ((F)->records + (I) * SCAN_COLUMNS)
+
+#endif
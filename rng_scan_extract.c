@@ -1,83 +1,146 @@
-/* Scan the parameter space randomly saving the DVs after each run for later screening */
+/* Find the best fitting parameters for each condition in a parameter scan file */
 
 #include "rng.h"
+#include "rng_scan.h"
 #include "rng_defaults.h"
 #include "lib_math.h"
+#include "lib_thread.h"
 
-#define LOG_FILE "FIT_SCAN.log"
+// The number of best fits reported for each target condition:
+#define TOP_K  10
 
-/******************************************************************************/
+typedef struct fit_target {
+    char         *label;
+    RngGroupData *data;
+} FitTarget;
 
-static void skip_to_eoln(FILE *fp)
-{
-    int c;
+typedef struct extract_job {
+    RngScanFile *file;
+    FitTarget   *targets;
+    int          n_targets;
+    int          n_threads;
+    ScanMatch    *best;        /* TOP_K entries per target per thread */
+} ExtractJob;
 
-    while (((c = getc(fp)) != EOF) && (c != '\n')) {
-        c = getc(fp);
-    }
-    ungetc(c, fp);
-}
-    
 /******************************************************************************/
 
-static int read_data_line(FILE *fp, RngParameters *params, RngGroupData *results)
+static void fprint_params(FILE *fp, RngParameters *p2)
 {
-    return(fscanf(fp, "%d\t%lf\t%lf\t%lf\t%lf\t%lf\t%lf\t%lf\t%lf\t%lf\t%lf\n", &params->wm_decay_rate, &params->wm_update_efficiency, &params->selection_temperature, &params->switch_rate, &params->monitoring_efficiency, &results->mean.r1, &results->mean.rng, &results->mean.rr, &results->mean.aa, &results->mean.oa, &results->mean.tpi) == 11);
+    fprintf(fp, "D: %d; U: %5.3f; T: %5.3f; S: %5.3f; M: %5.3f\n",  p2->wm_decay_rate, p2->wm_update_efficiency, p2->selection_temperature, p2->switch_rate, p2->monitoring_efficiency);
 }
 
-/******************************************************************************/
-
-static void params_copy(RngParameters *params, RngParameters *p2)
+static void extract_thread(int thread_id, void *data)
 {
-    p2->wm_decay_rate = params->wm_decay_rate;
-    p2->wm_update_efficiency = params->wm_update_efficiency;
-    p2->selection_temperature = params->selection_temperature;
-    p2->switch_rate = params->switch_rate;
-    p2->monitoring_method = params->monitoring_method;
-    p2->monitoring_efficiency = params->monitoring_efficiency;
-    p2->individual_variability = params->individual_variability;
-    p2->sample_size = params->sample_size;
+    // Scan this thread's share of the file, scoring each record against every
+    // target, so that each record is read only once
+
+    ExtractJob *job = (ExtractJob *)data;
+    ScanMatch *best = job->best + thread_id * job->n_targets * TOP_K;
+    RngParameters params;
+    RngGroupData results;
+    long i, start, end;
+    int t;
+
+    for (t = 0; t < job->n_targets; t++) {
+        rng_scan_match_list_initialise(best + t * TOP_K, TOP_K);
+    }
+    thread_range(thread_id, job->n_threads, job->file->rows, &start, &end);
+    for (i = start; i < end; i++) {
+        rng_scan_record_get(job->file, i, &params, &results);
+        for (t = 0; t < job->n_targets; t++) {
+            double f = rng_data_calculate_fit(&results, job->targets[t].data);
+            if (f < best[t * TOP_K + TOP_K - 1].fit) {
+                rng_scan_match_list_insert(best + t * TOP_K, TOP_K, f, i);
+            }
+        }
+    }
 }
 
-static void fprint_params(FILE *fp, RngParameters *p2)
+static void print_best_fits(RngScanFile *file, char *label, ScanMatch *matches)
 {
-    fprintf(fp, "D: %d; U: %5.3f; T: %5.3f; S: %5.3f; M: %5.3f\n",  p2->wm_decay_rate, p2->wm_update_efficiency, p2->selection_temperature, p2->switch_rate, p2->monitoring_efficiency);
+    RngParameters params = pars;
+    RngGroupData results;
+    int k;
+
+    fprintf(stdout, "Best fits to %s condition:\n", label);
+    for (k = 0; (k < TOP_K) && (matches[k].row >= 0); k++) {
+        rng_scan_record_get(file, matches[k].row, &params, &results);
+        fprintf(stdout, "%3d: %5.3f with ", k+1, matches[k].fit);
+        fprint_params(stdout, &params);
+    }
 }
 
-static void extract_best_fit(char *label, RngGroupData *data)
+static void extract_best_fits(RngScanFile *file, FitTarget *targets, int n_targets)
 {
-    FILE *fp;
+    // Exhaustive search: a single pass over the file, shared between threads
+
+    ExtractJob job;
+    ScanMatch merged[TOP_K];
+    int n, t, k;
 
-    /* Open the log file and skip the headings on the first line: */
-    if ((fp = fopen(LOG_FILE, "r")) == NULL) {
-        fprintf(stdout, "Open failed: %s is not readable\n", LOG_FILE);
+    job.file = file;
+    job.targets = targets;
+    job.n_targets = n_targets;
+    job.n_threads = thread_count();
+    if ((job.best = (ScanMatch *)malloc(job.n_threads * n_targets * TOP_K * sizeof(ScanMatch))) == NULL) {
+        fprintf(stdout, "WARNING: Memory allocation failed in %s\n", __FUNCTION__);
+        return;
     }
-    else {
-        double f = DBL_MAX, f2;
-        RngParameters params, p2;
-        RngGroupData results;
-    
-        skip_to_eoln(fp);
-        while (read_data_line(fp, &params, &results)) {
-            f2 = rng_data_calculate_fit(&results, data);
-            if (f2 < f) {
-                params_copy(&params, &p2);
-                f = f2;
+
+    thread_parallel_run(job.n_threads, extract_thread, &job);
+
+    for (t = 0; t < n_targets; t++) {
+        /* Merge the per-thread lists: */
+        rng_scan_match_list_initialise(merged, TOP_K);
+        for (n = 0; n < job.n_threads; n++) {
+            ScanMatch *best = job.best + (n * n_targets + t) * TOP_K;
+            for (k = 0; (k < TOP_K) && (best[k].row >= 0); k++) {
+                rng_scan_match_list_insert(merged, TOP_K, best[k].fit, best[k].row);
             }
         }
-        fclose(fp);
-        fprintf(stdout, "Best fit to %s condition is %5.3f with ", label, f);
-        fprint_params(stdout, &p2);
+        print_best_fits(file, targets[t].label, merged);
+    }
+    free(job.best);
+}
+
+static void query_best_fits(RngScanFile *file, RngScanIndex *index, FitTarget *targets, int n_targets)
+{
+    // Indexed search: see rng_scan_index_query/5
+
+    ScanMatch matches[TOP_K];
+    int t;
+
+    for (t = 0; t < n_targets; t++) {
+        rng_scan_index_query(index, file, targets[t].data, TOP_K, matches);
+        print_best_fits(file, targets[t].label, matches);
     }
 }
 
 int main(int argc, char **argv)
 {
+    FitTarget targets[] = {
+        {"Control", &subject_ctl},
+        {"DS", &subject_ds},
+        {"2B", &subject_2b},
+        {"GnG", &subject_gng}
+    };
+    RngScanIndex *index;
+    RngScanFile *file;
+    char *index_file;
 
-    extract_best_fit("Control", &subject_ctl);
-    extract_best_fit("DS", &subject_ds);
-    extract_best_fit("2B", &subject_2b);
-    extract_best_fit("GnG", &subject_gng);
+    if ((file = rng_scan_file_open(SCAN_FILE)) != NULL) {
+        /* Use the index if rng_scan_index has built one: */
+        index_file = rng_scan_index_filename(SCAN_FILE);
+        if ((index = rng_scan_index_open(index_file)) != NULL) {
+            query_best_fits(file, index, targets, sizeof(targets) / sizeof(FitTarget));
+            rng_scan_index_close(index);
+        }
+        else {
+            extract_best_fits(file, targets, sizeof(targets) / sizeof(FitTarget));
+        }
+        free(index_file);
+        rng_scan_file_close(file);
+    }
 
     exit(1);
 }
@@ -0,0 +1,24 @@
+/* Build an index over a parameter scan file for fast best-fit queries */
+
+#include "rng.h"
+#include "rng_scan.h"
+
+/******************************************************************************/
+
+int main(int argc, char **argv)
+{
+    RngScanFile *file;
+    char *index_file;
+
+    if ((file = rng_scan_file_open(SCAN_FILE)) != NULL) {
+        index_file = rng_scan_index_filename(SCAN_FILE);
+        if (rng_scan_index_build(file, index_file)) {
+            fprintf(stdout, "Indexed %ld records in %s\n", file->rows, index_file);
+        }
+        free(index_file);
+        rng_scan_file_close(file);
+    }
+    exit(1);
+}
+
+/******************************************************************************/
@@ -0,0 +1,309 @@
+/* A polynomial surrogate of the RNG model, fitted to a parameter scan */
+
+#include <string.h>
+#include "rng_surrogate.h"
+
+/******************************************************************************/
+
+static void parameters_to_vector(RngParameters *pars, double *x)
+{
+    x[SCAN_WMD] = pars->wm_decay_rate;
+    x[SCAN_WMU] = pars->wm_update_efficiency;
+    x[SCAN_TEMP] = pars->selection_temperature;
+    x[SCAN_SWR] = pars->switch_rate;
+    x[SCAN_ME] = pars->monitoring_efficiency;
+}
+
+static void group_data_to_vector(RngScores *scores, double *y)
+{
+    y[SCAN_R - SCAN_PARAMETER_COLUMNS] = scores->r1;
+    y[SCAN_RNG - SCAN_PARAMETER_COLUMNS] = scores->rng;
+    y[SCAN_RR - SCAN_PARAMETER_COLUMNS] = scores->rr;
+    y[SCAN_AA - SCAN_PARAMETER_COLUMNS] = scores->aa;
+    y[SCAN_OA - SCAN_PARAMETER_COLUMNS] = scores->oa;
+    y[SCAN_TPI - SCAN_PARAMETER_COLUMNS] = scores->tpi;
+}
+
+static void vector_to_group_data(double *y, RngScores *scores)
+{
+    scores->r1 = y[SCAN_R - SCAN_PARAMETER_COLUMNS];
+    scores->rng = y[SCAN_RNG - SCAN_PARAMETER_COLUMNS];
+    scores->rr = y[SCAN_RR - SCAN_PARAMETER_COLUMNS];
+    scores->aa = y[SCAN_AA - SCAN_PARAMETER_COLUMNS];
+    scores->oa = y[SCAN_OA - SCAN_PARAMETER_COLUMNS];
+    scores->tpi = y[SCAN_TPI - SCAN_PARAMETER_COLUMNS];
+}
+
+/*----------------------------------------------------------------------------*/
+
+static void surrogate_enumerate_terms(RngSurrogate *surrogate, int *exponent, int p, int degree)
+{
+    // Enumerate all monomials in the parameters of total degree at most degree
+
+    int e;
+
+    if (p == SCAN_PARAMETER_COLUMNS) {
+        memcpy(surrogate->exponent[surrogate->terms++], exponent, SCAN_PARAMETER_COLUMNS * sizeof(int));
+    }
+    else {
+        for (e = 0; e <= degree; e++) {
+            exponent[p] = e;
+            surrogate_enumerate_terms(surrogate, exponent, p + 1, degree - e);
+        }
+    }
+}
+
+static void surrogate_features(RngSurrogate *surrogate, const double *x, double *phi)
+{
+    double power[SCAN_PARAMETER_COLUMNS][SURROGATE_DEGREE + 1];
+    int p, e, t;
+
+    for (p = 0; p < SCAN_PARAMETER_COLUMNS; p++) {
+        double z = (x[p] - surrogate->offset[p]) * surrogate->scale[p];
+        power[p][0] = 1.0;
+        for (e = 1; e <= SURROGATE_DEGREE; e++) {
+            power[p][e] = power[p][e-1] * z;
+        }
+    }
+    for (t = 0; t < surrogate->terms; t++) {
+        phi[t] = 1.0;
+        for (p = 0; p < SCAN_PARAMETER_COLUMNS; p++) {
+            phi[t] *= power[p][surrogate->exponent[t][p]];
+        }
+    }
+}
+
+static Boolean cholesky_decompose(double a[SURROGATE_TERMS_MAX][SURROGATE_TERMS_MAX], int n)
+{
+    // In place: the lower triangle of a is replaced by L, where a = L L'
+
+    int i, j, k;
+
+    for (j = 0; j < n; j++) {
+        double d = a[j][j];
+        for (k = 0; k < j; k++) {
+            d -= a[j][k] * a[j][k];
+        }
+        if (d <= 0.0) {
+            return(FALSE);
+        }
+        a[j][j] = sqrt(d);
+        for (i = j + 1; i < n; i++) {
+            double s = a[i][j];
+            for (k = 0; k < j; k++) {
+                s -= a[i][k] * a[j][k];
+            }
+            a[i][j] = s / a[j][j];
+        }
+    }
+    return(TRUE);
+}
+
+static void cholesky_solve(double l[SURROGATE_TERMS_MAX][SURROGATE_TERMS_MAX], int n, double *b)
+{
+    // Solve L L' x = b, overwriting b with x
+
+    int i, k;
+
+    for (i = 0; i < n; i++) {
+        for (k = 0; k < i; k++) {
+            b[i] -= l[i][k] * b[k];
+        }
+        b[i] /= l[i][i];
+    }
+    for (i = n - 1; i >= 0; i--) {
+        for (k = i + 1; k < n; k++) {
+            b[i] -= l[k][i] * b[k];
+        }
+        b[i] /= l[i][i];
+    }
+}
+
+/******************************************************************************/
+
+RngSurrogate *rng_surrogate_create(RngScanFile *file)
+{
+    // Fit the surrogate to all records in a scan file. Returns NULL if there
+    // are too few records to fit it (or the fit fails).
+
+    double a[SURROGATE_TERMS_MAX][SURROGATE_TERMS_MAX];
+    double b[SCAN_DV_COLUMNS][SURROGATE_TERMS_MAX];
+    double phi[SURROGATE_TERMS_MAX], column[SURROGATE_TERMS_MAX];
+    double min[SCAN_PARAMETER_COLUMNS], max[SCAN_PARAMETER_COLUMNS];
+    int exponent[SCAN_PARAMETER_COLUMNS];
+    RngSurrogate *surrogate;
+    const double *record;
+    int p, d, i, j, n;
+    long r;
+
+    if ((surrogate = (RngSurrogate *)malloc(sizeof(RngSurrogate))) == NULL) {
+        return(NULL);
+    }
+    surrogate->n = file->rows;
+    surrogate->terms = 0;
+    surrogate_enumerate_terms(surrogate, exponent, 0, SURROGATE_DEGREE);
+    n = surrogate->terms;
+
+    if (file->rows < 2 * n) {
+        fprintf(stdout, "WARNING: Only %ld scan records: too few to fit the surrogate model\n", file->rows);
+        free(surrogate);
+        return(NULL);
+    }
+
+    /* Map each parameter's range onto [-1, 1] to keep the regression well conditioned: */
+    for (p = 0; p < SCAN_PARAMETER_COLUMNS; p++) {
+        min[p] = DBL_MAX;
+        max[p] = -DBL_MAX;
+    }
+    for (r = 0; r < file->rows; r++) {
+        record = rng_scan_record(file, r);
+        for (p = 0; p < SCAN_PARAMETER_COLUMNS; p++) {
+            min[p] = MIN(min[p], record[p]);
+            max[p] = MAX(max[p], record[p]);
+        }
+    }
+    for (p = 0; p < SCAN_PARAMETER_COLUMNS; p++) {
+        surrogate->offset[p] = (max[p] + min[p]) / 2.0;
+        surrogate->scale[p] = (max[p] > min[p]) ? 2.0 / (max[p] - min[p]) : 1.0;
+    }
+
+    /* Accumulate the normal equations, X'X b = X'y, for all DVs at once: */
+    memset(a, 0, sizeof(a));
+    memset(b, 0, sizeof(b));
+    for (r = 0; r < file->rows; r++) {
+        record = rng_scan_record(file, r);
+        surrogate_features(surrogate, record, phi);
+        for (i = 0; i < n; i++) {
+            for (j = 0; j <= i; j++) {
+                a[i][j] += phi[i] * phi[j];
+            }
+            for (d = 0; d < SCAN_DV_COLUMNS; d++) {
+                b[d][i] += phi[i] * record[SCAN_PARAMETER_COLUMNS + d];
+            }
+        }
+    }
+    /* A little ridge regularisation guards against collinear terms: */
+    for (i = 0; i < n; i++) {
+        a[i][i] *= 1.0 + 1e-9;
+    }
+    if (!cholesky_decompose(a, n)) {
+        fprintf(stdout, "WARNING: Cannot fit the surrogate model (singular normal equations)\n");
+        free(surrogate);
+        return(NULL);
+    }
+    for (d = 0; d < SCAN_DV_COLUMNS; d++) {
+        cholesky_solve(a, n, b[d]);
+        memcpy(surrogate->coefficient[d], b[d], n * sizeof(double));
+    }
+    /* (X'X)^-1, for the standard error of predictions: */
+    for (j = 0; j < n; j++) {
+        for (i = 0; i < n; i++) {
+            column[i] = (i == j) ? 1.0 : 0.0;
+        }
+        cholesky_solve(a, n, column);
+        for (i = 0; i < n; i++) {
+            surrogate->inverse[i][j] = column[i];
+        }
+    }
+
+    /* Residual variance of each DV: */
+    for (d = 0; d < SCAN_DV_COLUMNS; d++) {
+        surrogate->residual_variance[d] = 0.0;
+    }
+    for (r = 0; r < file->rows; r++) {
+        record = rng_scan_record(file, r);
+        surrogate_features(surrogate, record, phi);
+        for (d = 0; d < SCAN_DV_COLUMNS; d++) {
+            double e = record[SCAN_PARAMETER_COLUMNS + d];
+            for (i = 0; i < n; i++) {
+                e -= surrogate->coefficient[d][i] * phi[i];
+            }
+            surrogate->residual_variance[d] += e * e;
+        }
+    }
+    for (d = 0; d < SCAN_DV_COLUMNS; d++) {
+        surrogate->residual_variance[d] /= (file->rows - n);
+    }
+    return(surrogate);
+}
+
+RngSurrogate *rng_surrogate_create_from_file(const char *scan_filename)
+{
+    RngSurrogate *surrogate = NULL;
+    RngScanFile *file;
+
+    if ((file = rng_scan_file_open(scan_filename)) != NULL) {
+        surrogate = rng_surrogate_create(file);
+        rng_scan_file_close(file);
+    }
+    return(surrogate);
+}
+
+void rng_surrogate_free(RngSurrogate *surrogate)
+{
+    free(surrogate);
+}
+
+/******************************************************************************/
+
+void rng_surrogate_predict(RngSurrogate *surrogate, RngParameters *pars, RngGroupData *prediction)
+{
+    // Predicted group means are returned in prediction->mean, and the standard
+    // error of each prediction (not the between-subject sd) in prediction->sd.
+    // Only the scanned DVs (R, RNG, RR, AA, OA, TPI) are predicted.
+
+    double x[SCAN_PARAMETER_COLUMNS], phi[SURROGATE_TERMS_MAX];
+    double mean[SCAN_DV_COLUMNS], se[SCAN_DV_COLUMNS];
+    double leverage = 0.0;
+    int d, i, j;
+
+    parameters_to_vector(pars, x);
+    surrogate_features(surrogate, x, phi);
+
+    for (i = 0; i < surrogate->terms; i++) {
+        double s = 0.0;
+        for (j = 0; j < surrogate->terms; j++) {
+            s += surrogate->inverse[i][j] * phi[j];
+        }
+        leverage += phi[i] * s;
+    }
+    for (d = 0; d < SCAN_DV_COLUMNS; d++) {
+        mean[d] = 0.0;
+        for (i = 0; i < surrogate->terms; i++) {
+            mean[d] += surrogate->coefficient[d][i] * phi[i];
+        }
+        se[d] = sqrt(surrogate->residual_variance[d] * (1.0 + leverage));
+    }
+
+    memset(prediction, 0, sizeof(RngGroupData));
+    vector_to_group_data(mean, &(prediction->mean));
+    vector_to_group_data(se, &(prediction->sd));
+}
+
+double rng_surrogate_fit_bound(RngSurrogate *surrogate, RngParameters *pars, RngGroupData *target)
+{
+    // An optimistic estimate of rng_data_calculate_fit/2 for the parameters:
+    // each predicted DV is moved up to SURROGATE_MARGIN standard errors
+    // towards the target before the fit is calculated. If even this is worse
+    // than the fit required, simulating the parameters is a waste of time.
+
+    double mean[SCAN_DV_COLUMNS], se[SCAN_DV_COLUMNS];
+    double target_mean[SCAN_DV_COLUMNS], target_sd[SCAN_DV_COLUMNS];
+    double fit = 0.0;
+    RngGroupData prediction;
+    int d;
+
+    rng_surrogate_predict(surrogate, pars, &prediction);
+    group_data_to_vector(&(prediction.mean), mean);
+    group_data_to_vector(&(prediction.sd), se);
+    group_data_to_vector(&(target->mean), target_mean);
+    group_data_to_vector(&(target->sd), target_sd);
+
+    for (d = 0; d < SCAN_DV_COLUMNS; d++) {
+        double gap = fabs(target_mean[d] - mean[d]) - SURROGATE_MARGIN * se[d];
+        fit = MAX(fit, MAX(gap, 0.0) / target_sd[d]);
+    }
+    return(fit);
+}
+
+/******************************************************************************/
@@ -0,0 +1,41 @@
+#ifndef _rng_surrogate_h_
+
+#define _rng_surrogate_h_
+
+#include "rng_scan.h"
+
+/******************************************************************************/
+/* Surrogate model of the RNG model:
+
+A polynomial regression (of degree SURROGATE_DEGREE in the scanned
+parameters) fitted by least squares to a scan file, predicting the group
+mean of each DV together with the standard error of that prediction. It is
+cheap enough to evaluate before every simulation, so fitting routines can
+use it to skip candidates that are clearly hopeless.
+
+*******************************************************************************/
+
+#define SURROGATE_DEGREE      3
+#define SURROGATE_TERMS_MAX   56      /* (5 + 3)! / (5! 3!) */
+/* A candidate is only skipped if even SURROGATE_MARGIN standard errors in   */
+/* its favour would not make its fit good enough:                            */
+#define SURROGATE_MARGIN      3.0
+
+typedef struct rng_surrogate {
+    long    n;
+    int     terms;
+    int     exponent[SURROGATE_TERMS_MAX][SCAN_PARAMETER_COLUMNS];
+    double  offset[SCAN_PARAMETER_COLUMNS];
+    double  scale[SCAN_PARAMETER_COLUMNS];
+    double  coefficient[SCAN_DV_COLUMNS][SURROGATE_TERMS_MAX];
+    double  residual_variance[SCAN_DV_COLUMNS];
+    double  inverse[SURROGATE_TERMS_MAX][SURROGATE_TERMS_MAX];
+} RngSurrogate;
+
+extern RngSurrogate *rng_surrogate_create(RngScanFile *file);
+extern RngSurrogate *rng_surrogate_create_from_file(const char *scan_filename);
+extern void          rng_surrogate_free(RngSurrogate *surrogate);
+extern void          rng_surrogate_predict(RngSurrogate *surrogate, RngParameters *pars, RngGroupData *prediction);
+extern double        rng_surrogate_fit_bound(RngSurrogate *surrogate, RngParameters *pars, RngGroupData *target);
+
+#endif
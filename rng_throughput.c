@@ -0,0 +1,219 @@
+/* End-to-end throughput of the model, checked against a stored baseline */
+
+#include <string.h>
+#include "rng.h"
+#include "rng_defaults.h"
+#include "lib_math.h"
+#include "lib_file.h"
+
+/******************************************************************************/
+/* Usage: rng_throughput [baseline-file]
+
+Each regime is run through the full pipeline (model reset, rng_run/1 and
+rng_analyse_group_data/1) THROUGHPUT_RUNS times, and the following are
+reported:
+
+  subjects/s           Subjects simulated per second of user time
+  cycles/response      Processing cycles per response generated
+  peak RSS             Maximum resident set size so far, in KB
+
+Every regime uses a fixed seed, so cycles/response is deterministic and any
+change in it means the model's behaviour has changed.
+
+The results are written to THROUGHPUT_RESULTS. If the baseline file (default
+THROUGHPUT_BASELINE) exists the results are compared with it, and the program
+exits with status 2 if any regime is slower, takes more cycles per response
+or uses more memory than the baseline by more than THROUGHPUT_TOLERANCE. If it
+does not exist the results are saved as the new baseline. To accept a change
+in performance, delete the baseline and rerun.
+
+*******************************************************************************/
+
+#define THROUGHPUT_RUNS         3
+#define THROUGHPUT_SEED         1234
+#define THROUGHPUT_TOLERANCE    0.10
+#define THROUGHPUT_RESULTS      "THROUGHPUT.txt"
+#define THROUGHPUT_BASELINE     "THROUGHPUT.baseline"
+#define REGIME_MAX              16
+#define NAME_LENGTH             64
+
+typedef struct throughput_regime {
+    char          *name;
+    RngParameters  pars;
+    int            trials;
+} ThroughputRegime;
+
+typedef struct throughput_result {
+    char   name[NAME_LENGTH];
+    double subjects_per_second;
+    double cycles_per_response;
+    int    peak_rss;
+} ThroughputResult;
+
+/******************************************************************************/
+
+static void throughput_regimes_create(ThroughputRegime *regime)
+{
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        regime[i].pars = pars;
+        regime[i].pars.seed = THROUGHPUT_SEED;
+        regime[i].trials = 100;
+    }
+    regime[0].name = "default";
+    regime[1].name = "high_monitoring";
+    regime[1].pars.monitoring_efficiency = 0.95;
+    regime[2].name = "slow_decay";
+    regime[2].pars.wm_decay_rate = 60;
+    regime[3].name = "trials_500";
+    regime[3].trials = MAX_TRIALS;
+}
+
+static void throughput_regime_run(OosVars *gv, ThroughputRegime *regime, ThroughputResult *result)
+{
+    // Subjects are run one at a time so that each one's cycle count (left in
+    // gv->cycle by rng_run/1) can be added up
+
+    RngData *task_data = (RngData *)gv->task_data;
+    long cycles = 0, responses = 0, subjects = 0;
+    int r, i, n, start;
+
+    start = usertime();
+    for (r = 0; r < THROUGHPUT_RUNS; r++) {
+        rng_model_reset(gv, &(regime->pars));
+        gv->trials_per_subject = regime->trials;
+        n = gv->subjects_per_experiment;
+        for (i = 0; i < n; i++) {
+            gv->subjects_per_experiment = i + 1;
+            rng_run(gv);
+            cycles += gv->cycle;
+            responses += task_data->subject[i].n;
+        }
+        rng_analyse_group_data(task_data);
+        subjects += n;
+    }
+
+    g_snprintf(result->name, NAME_LENGTH, "%s", regime->name);
+    result->subjects_per_second = subjects * 1000.0 / MAX(usertime() - start, 1);
+    result->cycles_per_response = cycles / (double) MAX(responses, 1);
+    result->peak_rss = memory_stats();
+}
+
+/******************************************************************************/
+
+static void throughput_results_print(FILE *fp, ThroughputResult *result, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        fprintf(fp, "%-20s %12.2f %12.4f %10d\n", result[i].name, result[i].subjects_per_second, result[i].cycles_per_response, result[i].peak_rss);
+    }
+}
+
+static Boolean throughput_results_write(char *filename, ThroughputResult *result, int n)
+{
+    FILE *fp;
+
+    if ((fp = fopen(filename, "w")) == NULL) {
+        fprintf(stdout, "WARNING: Cannot write %s\n", filename);
+        return(FALSE);
+    }
+    throughput_results_print(fp, result, n);
+    fclose(fp);
+    return(TRUE);
+}
+
+static int throughput_results_read(char *filename, ThroughputResult *result)
+{
+    // Returns the number of regimes read, or -1 if the file cannot be opened
+
+    char buffer[256];
+    FILE *fp;
+    int n = 0;
+
+    if ((fp = fopen(filename, "r")) == NULL) {
+        return(-1);
+    }
+    while ((n < REGIME_MAX) && (fgets(buffer, 256, fp) != NULL)) {
+        if (sscanf(buffer, "%63s %lf %lf %d", result[n].name, &(result[n].subjects_per_second), &(result[n].cycles_per_response), &(result[n].peak_rss)) == 4) {
+            n++;
+        }
+    }
+    fclose(fp);
+    return(n);
+}
+
+static int throughput_results_compare(ThroughputResult *result, int n, ThroughputResult *baseline, int m)
+{
+    // Returns the number of regressions beyond THROUGHPUT_TOLERANCE
+
+    int i, j, regressions = 0;
+
+    for (i = 0; i < n; i++) {
+        for (j = 0; (j < m) && (strcmp(result[i].name, baseline[j].name) != 0); j++);
+        if (j == m) {
+            fprintf(stdout, "WARNING: Regime %s is not in the baseline\n", result[i].name);
+            continue;
+        }
+        if (result[i].subjects_per_second < baseline[j].subjects_per_second * (1.0 - THROUGHPUT_TOLERANCE)) {
+            fprintf(stdout, "REGRESSION: %s: %.2f subjects/s (baseline %.2f)\n", result[i].name, result[i].subjects_per_second, baseline[j].subjects_per_second);
+            regressions++;
+        }
+        if (result[i].cycles_per_response > baseline[j].cycles_per_response * (1.0 + THROUGHPUT_TOLERANCE)) {
+            fprintf(stdout, "REGRESSION: %s: %.4f cycles/response (baseline %.4f)\n", result[i].name, result[i].cycles_per_response, baseline[j].cycles_per_response);
+            regressions++;
+        }
+        if (result[i].peak_rss > baseline[j].peak_rss * (1.0 + THROUGHPUT_TOLERANCE)) {
+            fprintf(stdout, "REGRESSION: %s: %d KB peak RSS (baseline %d KB)\n", result[i].name, result[i].peak_rss, baseline[j].peak_rss);
+            regressions++;
+        }
+    }
+    return(regressions);
+}
+
+/******************************************************************************/
+
+int main(int argc, char **argv)
+{
+    static ThroughputRegime regime[REGIME_MAX];
+    static ThroughputResult result[REGIME_MAX], baseline[REGIME_MAX];
+    char *baseline_file = (argc > 1) ? argv[1] : THROUGHPUT_BASELINE;
+    int i, n = 4, m, regressions = 0;
+    OosVars *gv;
+
+    if ((gv = oos_globals_create()) == NULL) {
+        fprintf(stdout, "ABORTING: Cannot allocate global variable space\n");
+        exit(1);
+    }
+    else if (!rng_model_create(gv, &pars, FALSE)) {
+        fprintf(stdout, "ABORTING: Cannot create RNG\n");
+        exit(1);
+    }
+
+    throughput_regimes_create(regime);
+    fprintf(stdout, "%-20s %12s %12s %10s\n", "Regime", "Subjects/s", "Cycles/resp", "Peak KB");
+    for (i = 0; i < n; i++) {
+        throughput_regime_run(gv, &regime[i], &result[i]);
+        throughput_results_print(stdout, &result[i], 1);
+    }
+    throughput_results_write(THROUGHPUT_RESULTS, result, n);
+
+    if ((m = throughput_results_read(baseline_file, baseline)) < 0) {
+        if (throughput_results_write(baseline_file, result, n)) {
+            fprintf(stdout, "No baseline found: results saved as %s\n", baseline_file);
+        }
+    }
+    else if ((regressions = throughput_results_compare(result, n, baseline, m)) == 0) {
+        fprintf(stdout, "No regressions against %s (tolerance %.0f%%)\n", baseline_file, 100 * THROUGHPUT_TOLERANCE);
+    }
+    else {
+        fprintf(stdout, "FAILED: %d regression(s) against %s\n", regressions, baseline_file);
+    }
+
+    rng_globals_destroy((RngData *)gv->task_data);
+    oos_globals_destroy(gv);
+    exit(regressions > 0 ? 2 : 1);
+}
+
+/******************************************************************************/
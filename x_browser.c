@@ -8,6 +8,8 @@
 #define LINE_SEP 20
 #define BAR_SIZE 400
 
+static Boolean browser_scale_updating = FALSE;
+
 /******************************************************************************/
 
 void browser_draw_cairo(cairo_t *cr, OosVars *gv, int width, int height)
@@ -98,6 +100,32 @@ void browser_draw_cairo(cairo_t *cr, OosVars *gv, int width, int height)
 
 /******************************************************************************/
 
+static void browser_scale_update(XGlobals *globals)
+{
+    // Set the scale to the cycles in the history. Setting it emits a
+    // value-changed signal, which is ignored while we are doing so.
+
+    int first, last;
+
+    if ((globals->browser_scale == NULL) || (globals->history == NULL) || (globals->gv == NULL)) {
+        return;
+    }
+    first = oos_history_first_cycle(globals->history);
+    last = oos_history_last_cycle(globals->history);
+    browser_scale_updating = TRUE;
+    if ((first >= 0) && (first < last)) {
+        gtk_range_set_range(GTK_RANGE(globals->browser_scale), first, last);
+        gtk_range_set_value(GTK_RANGE(globals->browser_scale), globals->gv->cycle);
+        gtk_widget_set_sensitive(globals->browser_scale, TRUE);
+    }
+    else {
+        gtk_range_set_range(GTK_RANGE(globals->browser_scale), 0, 1);
+        gtk_range_set_value(GTK_RANGE(globals->browser_scale), 0);
+        gtk_widget_set_sensitive(globals->browser_scale, FALSE);
+    }
+    browser_scale_updating = FALSE;
+}
+
 void browser_draw_x(XGlobals *globals)
 {
     if (globals->browser != NULL) {
@@ -130,14 +158,16 @@ void browser_draw_x(XGlobals *globals)
         g_snprintf(buffer, 64, "Current cycle: %d", globals->gv->cycle);
         gtk_label_set_text(GTK_LABEL(globals->browser_label), buffer);
     }
+    browser_scale_update(globals);
 }
 
 /******************************************************************************/
 
 static void x_task_initialise(GtkWidget *caller, XGlobals *globals)
 {
-    rng_create(globals->gv, &(globals->params));
+    rng_model_reset(globals->gv, &(globals->params));
     rng_initialise_subject(globals->gv);
+    oos_history_clear(globals->history);
     browser_draw_x(globals);
 }
 
@@ -148,7 +178,7 @@ static void x_task_step_cycle(GtkWidget *caller, XGlobals *globals)
     globals->running = TRUE;
     browser_draw_x(globals);
     gtk_main_iteration_do(FALSE);
-    if (!oos_step(globals->gv)) {
+    if (!oos_history_step(globals->gv, globals->history)) {
         subject = &(((RngData *)globals->gv->task_data)->subject[globals->gv->block]);
         rng_analyse_subject_responses(NULL, subject, globals->gv->trials_per_subject);
     }
@@ -156,6 +186,25 @@ static void x_task_step_cycle(GtkWidget *caller, XGlobals *globals)
     browser_draw_x(globals);
 }
 
+static void x_task_step_back(GtkWidget *caller, XGlobals *globals)
+{
+    if (!globals->running && oos_history_back(globals->gv, globals->history)) {
+        browser_draw_x(globals);
+    }
+}
+
+static void x_task_scrub(GtkWidget *caller, XGlobals *globals)
+{
+    // Move to the cycle selected on the scale (unless we're setting it)
+
+    int cycle = (int) gtk_range_get_value(GTK_RANGE(caller));
+
+    if (!browser_scale_updating && !globals->running && (cycle != globals->gv->cycle)) {
+        oos_history_goto(globals->gv, globals->history, cycle);
+        browser_draw_x(globals);
+    }
+}
+
 static void x_task_pause_block(GtkWidget *caller, XGlobals *globals)
 {
     globals->running = FALSE;
@@ -166,13 +215,16 @@ static void x_task_step_block(GtkWidget *caller, XGlobals *globals)
     RngSubjectData *subject;
 
     globals->running = TRUE;
-    do {
-        browser_draw_x(globals);
-        gtk_main_iteration_do(FALSE);
-    } while ((globals->running) && (oos_step(globals->gv)));
+    browser_draw_x(globals);
+    while ((globals->running) && (oos_history_step(globals->gv, globals->history))) {
+        if (x_frame_due()) {
+            x_frame_draw(globals);
+        }
+    }
     subject = &(((RngData *)globals->gv->task_data)->subject[globals->gv->block]);
     rng_analyse_subject_responses(NULL, subject, globals->gv->trials_per_subject);
     globals->running = FALSE;
+    browser_draw_x(globals);
 }
 
 static int browser_canvas_event_expose(GtkWidget *da, GdkEventConfigure *event, XGlobals *globals)
@@ -223,12 +275,29 @@ GtkWidget *browser_create_notepage(XGlobals *globals)
     gtk_tooltips_set_tip(tooltips, GTK_WIDGET(tool_item), "Run one processing cycle", NULL);
     gtk_widget_show(GTK_WIDGET(tool_item));
 
+    tool_item = gtk_tool_button_new_from_stock(GTK_STOCK_GO_BACK); // Step back one cycle
+    g_signal_connect(G_OBJECT(tool_item), "clicked", G_CALLBACK(x_task_step_back), globals);
+    gtk_box_pack_end(GTK_BOX(hbox), GTK_WIDGET(tool_item), FALSE, FALSE, 5);
+    gtk_tooltips_set_tip(tooltips, GTK_WIDGET(tool_item), "Go back one processing cycle", NULL);
+    gtk_widget_show(GTK_WIDGET(tool_item));
+
     tool_item = gtk_tool_button_new_from_stock(GTK_STOCK_GOTO_FIRST); // Initialise
     g_signal_connect(G_OBJECT(tool_item), "clicked", G_CALLBACK(x_task_initialise), globals);
     gtk_box_pack_end(GTK_BOX(hbox), GTK_WIDGET(tool_item), FALSE, FALSE, 5);
     gtk_tooltips_set_tip(tooltips, GTK_WIDGET(tool_item), "Initialise the model", NULL);
     gtk_widget_show(GTK_WIDGET(tool_item));
 
+    /* A scale to move through the cycles in the history: */
+    globals->history = oos_history_create(globals->history_window);
+    tmp = gtk_hscale_new_with_range(0, 1, 1);
+    gtk_scale_set_digits(GTK_SCALE(tmp), 0);
+    gtk_scale_set_value_pos(GTK_SCALE(tmp), GTK_POS_LEFT);
+    gtk_widget_set_sensitive(tmp, FALSE);
+    g_signal_connect(G_OBJECT(tmp), "value-changed", G_CALLBACK(x_task_scrub), globals);
+    gtk_box_pack_start(GTK_BOX(page), tmp, FALSE, FALSE, 0);
+    globals->browser_scale = tmp;
+    gtk_widget_show(tmp);
+
     /* A separator for aesthetic reasons: */
     tmp = gtk_hseparator_new();
     gtk_box_pack_start(GTK_BOX(page), tmp, FALSE, FALSE, 0);
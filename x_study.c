@@ -0,0 +1,166 @@
+/*******************************************************************************
+
+    File:       x_study.c
+    Contents:   Running parameter studies in background threads.
+
+    Public procedures:
+        XStudy *x_study_start(int points, XStudyRunFunction run, XStudyUpdateFunction update, void *data);
+        void    x_study_cancel(XStudy *study);
+        Boolean x_study_point_done(XStudy *study, int point);
+        int     x_study_points_done(XStudy *study);
+        Boolean x_study_finished(XStudy *study);
+        Boolean x_study_cancelled(XStudy *study);
+
+*******************************************************************************/
+
+#include <pthread.h>
+#include "xrng.h"
+#include "lib_math.h"
+#include "lib_thread.h"
+
+// A study is a number of independent points, each simulated by run(gv, point,
+// data) in one of a pool of worker threads. Each worker has its own model,
+// so run() may do anything with gv but must write its results only to the
+// point's own place in data. The random number generator is seeded for each
+// point, so a study's results do not depend on which thread ran each point.
+//
+// The GTK main loop is never blocked: update(study, data) is called from it
+// FRAME_RATE times a second while points are being completed (use
+// x_study_point_done/2 to find out which), and a final time once the study
+// has finished or been cancelled (x_study_finished/1 is then TRUE), after
+// which the study is freed. Cancelling a study stops workers taking new
+// points; those already started run to completion.
+
+struct x_study {
+    int points;
+    int threads;
+    volatile int next;              /* The next point to be claimed */
+    volatile int completed;
+    volatile unsigned char *done;   /* Set as each point is completed */
+    volatile Boolean cancelled;
+    volatile Boolean finished;      /* Set when all workers have stopped */
+    int reported;                   /* completed at the last update */
+    unsigned long seed;
+    XStudyRunFunction run;
+    XStudyUpdateFunction update;
+    void *data;
+    pthread_t thread;
+};
+
+/******************************************************************************/
+
+static void x_study_worker(int thread_id, void *data)
+{
+    XStudy *study = (XStudy *)data;
+    OosVars *gv;
+    int i;
+
+    if ((gv = oos_globals_create()) == NULL) {
+        fprintf(stdout, "WARNING: Cannot allocate a model for study thread %d\n", thread_id);
+        return;
+    }
+    while (!study->cancelled && ((i = thread_claim(&(study->next))) < study->points)) {
+        random_seed(study->seed + i);
+        study->run(gv, i, study->data);
+        __sync_synchronize();
+        study->done[i] = 1;
+        __sync_fetch_and_add(&(study->completed), 1);
+    }
+    if (gv->task_data != NULL) {
+        rng_globals_destroy((RngData *)gv->task_data);
+    }
+    oos_globals_destroy(gv);
+}
+
+static void *x_study_thread(void *arg)
+{
+    // The pool is run from its own thread, so the main loop carries on
+
+    XStudy *study = (XStudy *)arg;
+
+    thread_parallel_run(study->threads, x_study_worker, study);
+    __sync_synchronize();
+    study->finished = TRUE;
+    return(NULL);
+}
+
+static gboolean x_study_poll(gpointer data)
+{
+    XStudy *study = (XStudy *)data;
+
+    if (study->finished) {
+        pthread_join(study->thread, NULL);
+        study->update(study, study->data);
+        free((void *)study->done);
+        free(study);
+        return(FALSE);
+    }
+    else if (study->completed > study->reported) {
+        study->reported = study->completed;
+        study->update(study, study->data);
+    }
+    return(TRUE);
+}
+
+/******************************************************************************/
+
+XStudy *x_study_start(int points, XStudyRunFunction run, XStudyUpdateFunction update, void *data)
+{
+    XStudy *study;
+
+    if ((study = (XStudy *)malloc(sizeof(XStudy))) == NULL) {
+        return(NULL);
+    }
+    else if ((study->done = (unsigned char *)calloc(MAX(points, 1), sizeof(unsigned char))) == NULL) {
+        free(study);
+        return(NULL);
+    }
+    study->points = points;
+    study->threads = MAX(MIN(thread_count(), points), 1);
+    study->next = 0;
+    study->completed = 0;
+    study->reported = 0;
+    study->cancelled = FALSE;
+    study->finished = FALSE;
+    study->seed = (unsigned long) random_integer(0, 1 << 30);
+    study->run = run;
+    study->update = update;
+    study->data = data;
+    if (pthread_create(&(study->thread), NULL, x_study_thread, study) != 0) {
+        fprintf(stdout, "WARNING: Cannot start a thread for the study\n");
+        free((void *)study->done);
+        free(study);
+        return(NULL);
+    }
+    g_timeout_add(1000 / FRAME_RATE, x_study_poll, study);
+    return(study);
+}
+
+void x_study_cancel(XStudy *study)
+{
+    if (study != NULL) {
+        study->cancelled = TRUE;
+    }
+}
+
+Boolean x_study_point_done(XStudy *study, int point)
+{
+    return((point >= 0) && (point < study->points) && study->done[point]);
+}
+
+int x_study_points_done(XStudy *study)
+{
+    return(study->completed);
+}
+
+Boolean x_study_finished(XStudy *study)
+{
+    return(study->finished);
+}
+
+Boolean x_study_cancelled(XStudy *study)
+{
+    return(study->cancelled);
+}
+
+/******************************************************************************/
@@ -187,11 +187,13 @@ static void x_task_run_one_sequence(GtkWidget *caller, XGlobals *globals)
 {
     RngSubjectData *subject;
 
-    rng_create(globals->gv, &(globals->params));
+    rng_model_reset(globals->gv, &(globals->params));
     rng_initialise_subject(globals->gv);
     globals->running = TRUE;
     while ((globals->running) && (oos_step(globals->gv))) {
-        gtk_main_iteration_do(FALSE);
+        if (x_frame_due()) {
+            x_frame_draw(globals);
+        }
     }
     subject = &(((RngData *)globals->gv->task_data)->subject[globals->gv->block]);
     rng_analyse_subject_responses(NULL, subject, globals->gv->trials_per_subject);
@@ -1447,7 +1449,7 @@ static void x_draw_ps1d_canvas_to_pdf(cairo_t *cr, XGlobals *globals, double wid
 
 static void x_task_initialise(GtkWidget *caller, XGlobals *globals)
 {
-    rng_create(globals->gv, &(globals->params));
+    rng_model_reset(globals->gv, &(globals->params));
     rng_initialise_subject(globals->gv);
     basic_results_canvas_draw(globals);
 }
@@ -1457,7 +1459,7 @@ static void x_task_run_block(GtkWidget *caller, XGlobals *globals)
     globals->running = TRUE;
     basic_results_canvas_draw(globals);
     gtk_main_iteration_do(FALSE);
-    rng_create(globals->gv, &(globals->params));
+    rng_model_reset(globals->gv, &(globals->params));
     rng_initialise_subject(globals->gv);
     rng_run(globals->gv);
     rng_analyse_group_data((RngData *)globals->gv->task_data);
@@ -1506,103 +1508,174 @@ static void rng_parameters_restore(RngParameters *dest, RngParameters *tmp)
     dest->wm_update_efficiency = tmp->wm_update_efficiency;
 }
 
-static void run_parameter_study(XGlobals *globals)
-{
+/*----------------------------------------------------------------------------*/
+/* The 1-D parameter studies: each value of each parameter swept is a point   */
+/* of one XStudy, simulated in the background (see x_study.c). Point p is     */
+/* value p % MAX_GROUPS of sweep p / MAX_GROUPS.                              */
+
+#define PS_1D_SWEEPS 5
+
+typedef struct ps_1d_study {
+    XGlobals *globals;
+    int sweeps;
+    Canvas2View selection[PS_1D_SWEEPS];
+    RngParameters parameters[PS_1D_SWEEPS][MAX_GROUPS];
+    RngScores group_mean[PS_1D_SWEEPS][MAX_GROUPS];
+    RngScores group_sd[PS_1D_SWEEPS][MAX_GROUPS];
+    char *filename;             /* Where to print the sweeps, if anywhere */
+} PS_1D_Study;
+
+static void ps_1d_study_run(OosVars *gv, int point, void *data)
+{
+    PS_1D_Study *ps_1d = (PS_1D_Study *)data;
+    int k = point / MAX_GROUPS, i = point % MAX_GROUPS;
     RngData *task_data;
-    RngParameters tmp;
-
-    rng_parameters_save(&(globals->params), &tmp);
+    RngGroupData z_scores;
 
-    for (globals->group_index = 0; globals->group_index < MAX_GROUPS; globals->group_index++) {
-        set_variable_parameter(globals);
-        rng_create(globals->gv, &(globals->params));
-        rng_initialise_subject(globals->gv);
-        rng_run(globals->gv);
-        task_data = (RngData *)globals->gv->task_data;
-        rng_analyse_group_data(task_data);
-        globals->group_mean[globals->group_index].r1 = (task_data->group.mean.r1 - subject_ctl.mean.r1) / subject_ctl.sd.r1;
-        globals->group_sd[globals->group_index].r1 = task_data->group.sd.r1 / subject_ctl.sd.r1;
-        globals->group_mean[globals->group_index].r2 = (task_data->group.mean.r2 - subject_ctl.mean.r2) / subject_ctl.sd.r2;
-        globals->group_sd[globals->group_index].r2 = task_data->group.sd.r2 / subject_ctl.sd.r2;
-        globals->group_mean[globals->group_index].rng = (task_data->group.mean.rng - subject_ctl.mean.rng) / subject_ctl.sd.rng;
-        globals->group_sd[globals->group_index].rng = task_data->group.sd.rng / subject_ctl.sd.rng;
-        globals->group_mean[globals->group_index].rr = (task_data->group.mean.rr - subject_ctl.mean.rr) / subject_ctl.sd.rr;
-        globals->group_sd[globals->group_index].rr = task_data->group.sd.rr / subject_ctl.sd.rr;
-        globals->group_mean[globals->group_index].aa = (task_data->group.mean.aa - subject_ctl.mean.aa) / subject_ctl.sd.aa;
-        globals->group_sd[globals->group_index].aa = task_data->group.sd.aa / subject_ctl.sd.aa;
-        globals->group_mean[globals->group_index].oa = (task_data->group.mean.oa - subject_ctl.mean.oa) / subject_ctl.sd.oa;
-        globals->group_sd[globals->group_index].oa = task_data->group.sd.oa / subject_ctl.sd.oa;
-        globals->group_mean[globals->group_index].tpi = (task_data->group.mean.tpi - subject_ctl.mean.tpi) / subject_ctl.sd.tpi;
-        globals->group_sd[globals->group_index].tpi = task_data->group.sd.tpi / subject_ctl.sd.tpi;
-        globals->group_mean[globals->group_index].rg1 = (task_data->group.mean.rg1 - subject_ctl.mean.rg1) / subject_ctl.sd.rg1;
-        globals->group_sd[globals->group_index].rg1 = task_data->group.sd.rg1 / subject_ctl.sd.rg1;
-        globals->group_mean[globals->group_index].rg2 = (task_data->group.mean.rg2 - subject_ctl.mean.rg2) / subject_ctl.sd.rg2;
-        globals->group_sd[globals->group_index].rg2 = task_data->group.sd.rg2 / subject_ctl.sd.rg2;
-        if (globals->dynamic_canvases) {
-            x_draw_ps1d_canvas(globals);
-        }
-        gtk_main_iteration_do(FALSE);
-    }
-
-    rng_parameters_restore(&(globals->params), &tmp);
+    rng_model_reset(gv, &(ps_1d->parameters[k][i]));
+    rng_run(gv);
+    task_data = (RngData *)gv->task_data;
+    rng_analyse_group_data(task_data);
+    rng_scores_convert_to_z(&(task_data->group), &subject_ctl, &z_scores);
+    ps_1d->group_mean[k][i] = z_scores.mean;
+    ps_1d->group_sd[k][i] = z_scores.sd;
 }
 
-static void x_task_run_parameter_study(GtkWidget *caller, XGlobals *globals)
+static int ps_1d_study_show(XStudy *study, PS_1D_Study *ps_1d, int k)
 {
-    globals->running = TRUE;
-    x_draw_ps1d_canvas(globals);
-    gtk_main_iteration_do(FALSE);
-    run_parameter_study(globals);
-    globals->running = FALSE;
-    x_draw_ps1d_canvas(globals);
+    // Copy sweep k into globals, from the left up to the first point not yet
+    // done. Returns the number of points copied.
+
+    XGlobals *globals = ps_1d->globals;
+    int i;
+
+    for (i = 0; (i < MAX_GROUPS) && x_study_point_done(study, k * MAX_GROUPS + i); i++) {
+        globals->group_mean[i] = ps_1d->group_mean[k][i];
+        globals->group_sd[i] = ps_1d->group_sd[k][i];
+    }
+    globals->group_index = i;
+    return(i);
 }
 
-static void x_task_run_all_parameter_studies(GtkWidget *caller, XGlobals *globals)
+static void ps_1d_study_print(XStudy *study, PS_1D_Study *ps_1d)
 {
+    XGlobals *globals = ps_1d->globals;
     Canvas2View tmp_v = globals->canvas2_selection;
-    Boolean tmp_dc = globals->dynamic_canvases;
-
     cairo_surface_t *surface;
     cairo_t *cr;
     double width, height;
-    char *filename;
+    int k;
 
-    filename = "ScreenDumps/sim2_graphs.pdf";
     width = 1200; height = width * sqrt(2);
 
-    fprintf(stdout, "Saving image to %s ...", filename); fflush(stdout);
+    fprintf(stdout, "Saving image to %s ...", ps_1d->filename); fflush(stdout);
 
-    surface = cairo_pdf_surface_create(filename, width, height);
+    surface = cairo_pdf_surface_create(ps_1d->filename, width, height);
     cr = cairo_create(surface);
 
-    globals->dynamic_canvases = FALSE;
-    globals->canvas2_selection = CANVAS_VARY_DECAY;
-    run_parameter_study(globals);
-    x_draw_ps1d_canvas_to_pdf(cr, globals, width, height, 1);
+    for (k = 0; k < ps_1d->sweeps; k++) {
+        globals->canvas2_selection = ps_1d->selection[k];
+        ps_1d_study_show(study, ps_1d, k);
+        x_draw_ps1d_canvas_to_pdf(cr, globals, width, height, k+1);
+    }
+    fprintf(stdout, " Done\n");
+
+    cairo_destroy(cr);
+    cairo_surface_destroy(surface);
 
-    globals->canvas2_selection = CANVAS_VARY_UPDATE;
-    run_parameter_study(globals);
-    x_draw_ps1d_canvas_to_pdf(cr, globals, width, height, 2);
+    globals->canvas2_selection = tmp_v;
+}
 
-    globals->canvas2_selection = CANVAS_VARY_MONITORING;
-    run_parameter_study(globals);
-    x_draw_ps1d_canvas_to_pdf(cr, globals, width, height, 3);
+static void ps_1d_study_update(XStudy *study, void *data)
+{
+    // The canvas shows the sweep of the selected parameter, if there is one
 
-    globals->canvas2_selection = CANVAS_VARY_SWITCH;
-    run_parameter_study(globals);
-    x_draw_ps1d_canvas_to_pdf(cr, globals, width, height, 4);
+    PS_1D_Study *ps_1d = (PS_1D_Study *)data;
+    XGlobals *globals = ps_1d->globals;
+    int k;
 
-    globals->canvas2_selection = CANVAS_VARY_TEMPERATURE;
-    run_parameter_study(globals);
-    x_draw_ps1d_canvas_to_pdf(cr, globals, width, height, 5);
+    if (x_study_finished(study)) {
+        globals->study = NULL;
+        globals->running = FALSE;
+        if ((ps_1d->filename != NULL) && (x_study_points_done(study) == ps_1d->sweeps * MAX_GROUPS)) {
+            ps_1d_study_print(study, ps_1d);
+        }
+        else if (ps_1d->filename != NULL) {
+            fprintf(stdout, "Cancelled: %s not saved\n", ps_1d->filename);
+        }
+    }
+    for (k = 0; (k < ps_1d->sweeps) && (ps_1d->selection[k] != globals->canvas2_selection); k++);
+    if (k < ps_1d->sweeps) {
+        ps_1d_study_show(study, ps_1d, k);
+    }
+    if (x_study_finished(study) || globals->dynamic_canvases) {
+        x_draw_ps1d_canvas(globals);
+    }
+    if (x_study_finished(study)) {
+        free(ps_1d);
+    }
+}
 
-    fprintf(stdout, " Done\n");
+static Boolean run_parameter_studies(XGlobals *globals, Canvas2View *selection, int sweeps, char *filename)
+{
+    // Start a study of each parameter in selection; FALSE if a study is
+    // already running
 
-    cairo_destroy(cr);
-    cairo_surface_destroy(surface);
+    Canvas2View tmp_v = globals->canvas2_selection;
+    PS_1D_Study *ps_1d;
+    RngParameters tmp;
+    int k;
 
-    globals->dynamic_canvases = tmp_dc;
+    if ((globals->study != NULL) || ((ps_1d = (PS_1D_Study *)malloc(sizeof(PS_1D_Study))) == NULL)) {
+        return(FALSE);
+    }
+    ps_1d->globals = globals;
+    ps_1d->sweeps = sweeps;
+    ps_1d->filename = filename;
+    rng_parameters_save(&(globals->params), &tmp);
+    for (k = 0; k < sweeps; k++) {
+        ps_1d->selection[k] = selection[k];
+        globals->canvas2_selection = selection[k];
+        for (globals->group_index = 0; globals->group_index < MAX_GROUPS; globals->group_index++) {
+            set_variable_parameter(globals);
+            ps_1d->parameters[k][globals->group_index] = globals->params;
+        }
+        rng_parameters_restore(&(globals->params), &tmp);
+    }
     globals->canvas2_selection = tmp_v;
+
+    globals->group_index = 0;
+    globals->running = TRUE;
+    if ((globals->study = x_study_start(sweeps * MAX_GROUPS, ps_1d_study_run, ps_1d_study_update, ps_1d)) == NULL) {
+        globals->running = FALSE;
+        free(ps_1d);
+        return(FALSE);
+    }
+    return(TRUE);
+}
+
+static void x_task_run_parameter_study(GtkWidget *caller, XGlobals *globals)
+{
+    if (run_parameter_studies(globals, &(globals->canvas2_selection), 1, NULL)) {
+        x_draw_ps1d_canvas(globals);
+    }
+}
+
+static void x_task_cancel_parameter_study(GtkWidget *caller, XGlobals *globals)
+{
+    x_study_cancel(globals->study);
+}
+
+static void x_task_run_all_parameter_studies(GtkWidget *caller, XGlobals *globals)
+{
+    // All the sweeps are one study, so they run concurrently. The figures are
+    // printed when it is done.
+
+    static Canvas2View sweep[PS_1D_SWEEPS] = {CANVAS_VARY_DECAY, CANVAS_VARY_UPDATE, CANVAS_VARY_MONITORING, CANVAS_VARY_SWITCH, CANVAS_VARY_TEMPERATURE};
+
+    if (run_parameter_studies(globals, sweep, PS_1D_SWEEPS, "ScreenDumps/sim2_graphs.pdf")) {
+        x_draw_ps1d_canvas(globals);
+    }
 }
 
 /******************************************************************************/
@@ -2137,6 +2210,12 @@ static GtkWidget *notepage_parameter_studies_1d_create(XGlobals *globals)
     gtk_tooltips_set_tip(tooltips, GTK_WIDGET(tool_item), "Run all parameter studies (36 subjects at each value of each parameter)", NULL);
     gtk_widget_show(GTK_WIDGET(tool_item));
 
+    tool_item = gtk_tool_button_new_from_stock(GTK_STOCK_STOP); // Cancel study
+    g_signal_connect(G_OBJECT(tool_item), "clicked", G_CALLBACK(x_task_cancel_parameter_study), globals);
+    gtk_box_pack_end(GTK_BOX(hbox), GTK_WIDGET(tool_item), FALSE, FALSE, 5);
+    gtk_tooltips_set_tip(tooltips, GTK_WIDGET(tool_item), "Cancel the study", NULL);
+    gtk_widget_show(GTK_WIDGET(tool_item));
+
     hbox = gtk_hbox_new(FALSE, 5);
     gtk_box_pack_start(GTK_BOX(page), hbox, FALSE, FALSE, 5);
     gtk_widget_show(hbox);
@@ -2213,34 +2292,59 @@ static GtkWidget *notepage_parameter_studies_1d_create(XGlobals *globals)
 
 /******************************************************************************/
 
+// The parameter space is covered by a mesh of rectangular cells of pixels,
+// each simulated at its centre. The study starts with a PS_STEPS x PS_STEPS
+// grid of cells. In adaptive mode, cells whose value for any DV differs from
+// a neighbour's by more than PS_2D_REFINE of the colour range are then split
+// in two along each axis, and so on, until no cell needs refining, all are
+// single pixels or PS_2D_BUDGET further cells have been simulated.
+//
+// So that differences between cells reflect the parameters and not sampling
+// noise, every cell is run with common random numbers (the seed in the
+// parameters, or PS_2D_SEED if that is zero), and a difference must also be
+// more than PS_2D_Z standard errors to split a cell.
+
 #define PS_STEPS 10
+#define PS_RESOLUTION 100       /* Pixels on each axis: a multiple of PS_STEPS */
+#define PS_2D_REFINE 0.25
+#define PS_2D_Z 2.0
+#define PS_2D_SEED 1
+#define PS_2D_BUDGET 2000
+
+typedef struct ps_2d_cell {
+    int i0, i1;                 /* Pixels [i0, i1) on the first axis */
+    int j0, j1;                 /* Pixels [j0, j1) on the second axis */
+    double value[DATASETS];
+    double se[DATASETS];        /* Standard error of each value */
+} PS_2D_Cell;
 
 typedef struct ps_2d_data {
     int variable_1;
     int variable_2;
     RngParameters parameters;
-    OosVars *gv;
+    XStudy *study;
     GtkWidget *canvas;
     double scale;
-    double pixels[DATASETS][PS_STEPS][PS_STEPS];
+    double pixels[DATASETS][PS_RESOLUTION][PS_RESOLUTION];
+    Boolean adaptive;
+    int cells;
+    PS_2D_Cell cell[PS_RESOLUTION * PS_RESOLUTION];
 } PS_2D_Data;
 
-static PS_2D_Data ps_2d = {0, 1, {20, 1.00, 10.0, 0.50, 0, 1.00, 0.50, 36}, NULL, NULL, 0.5, {}};
+static PS_2D_Data ps_2d = {0, 1, {20, 1.00, 10.0, 0.50, 0, 1.00, 0.50, 36}, NULL, NULL, 0.5, {}, FALSE, 0, {}};
 
 static void ps_2d_initialise_data(PS_2D_Data *ps_2d)
 {
     int i, j, k;
 
-    for (i = 0; i < PS_STEPS; i++) {
-        for (j = 0; j < PS_STEPS; j++) {
+    for (i = 0; i < PS_RESOLUTION; i++) {
+        for (j = 0; j < PS_RESOLUTION; j++) {
             for (k = 0; k < DATASETS; k++) {
                 ps_2d->pixels[k][i][j] = 0.0;
             }
         }
     }
-    if (ps_2d->gv == NULL) {
-        ps_2d->gv = oos_globals_create();
-    }
+    ps_2d->cells = 0;
 }
 
 static void ps_2d_parameters_set(RngParameters *parameters, int pid, double val)
@@ -2268,20 +2372,22 @@ char *ps_2d_axis_label[4] = {
     "WM Update Efficiency"
 };
 
-static void cairo_draw_ps_2d_fit(cairo_t *cr, PangoLayout *layout, double x0, double y0, PS_2D_Data *ps_2d, char *label, double pixels[PS_STEPS][PS_STEPS])
+static void cairo_draw_ps_2d_fit(cairo_t *cr, PangoLayout *layout, double x0, double y0, PS_2D_Data *ps_2d, char *label, double pixels[PS_RESOLUTION][PS_RESOLUTION])
 {
     CairoxTextParameters p;
     double x, y, dx, dy, c;
     char buffer[64];
-    int i, j;
+    int i, j, j1;
 
-    dx = 100 / (double) PS_STEPS;
-    dy = -100 / (double) PS_STEPS;
+    dx = 100 / (double) PS_RESOLUTION;
 
-    for (i = 0; i < PS_STEPS; i++) {
-        x = x0 + 100 * i / (double) PS_STEPS;
-        for (j = 0; j < PS_STEPS; j++) {
-            y = y0 + 100 - 100 * j / (double) PS_STEPS;
+    for (i = 0; i < PS_RESOLUTION; i++) {
+        x = x0 + 100 * i / (double) PS_RESOLUTION;
+        for (j = 0; j < PS_RESOLUTION; j = j1) {
+            // A run of equal pixels (usually one cell of the mesh) is filled as one rectangle
+            for (j1 = j + 1; (j1 < PS_RESOLUTION) && (pixels[i][j1] == pixels[i][j]); j1++);
+            y = y0 + 100 - 100 * j / (double) PS_RESOLUTION;
+            dy = -100 * (j1 - j) / (double) PS_RESOLUTION;
 
             // Pixels code difference in z scores, so a zero pixel should map to colour 0.5
             // Assume that z-score differences range from -2.5 to +2.5;
@@ -2426,42 +2532,251 @@ static void ps_2d_canvas_draw(PS_2D_Data *ps_2d)
 
 static void x_task_ps_2d_initialise(GtkWidget *caller, PS_2D_Data *ps_2d)
 {
+    if (ps_2d->study != NULL) {
+        return;
+    }
     ps_2d_initialise_data(ps_2d);
     ps_2d_canvas_draw(ps_2d);
 }
 
-static void x_task_ps_2d_run(GtkWidget *caller, PS_2D_Data *ps_2d)
+/*----------------------------------------------------------------------------*/
+/* The 2-D study: each round of the refinement is an XStudy, whose point p is */
+/* the cell of the mesh numbered cell[p].                                     */
+
+typedef struct ps_2d_study {
+    PS_2D_Data *ps_2d;
+    RngParameters parameters;   /* And the variables, as when the study began */
+    int variable_1;
+    int variable_2;
+    int refined;                /* Cells simulated after the first round */
+    int n;
+    int cell[PS_RESOLUTION * PS_RESOLUTION];
+} PS_2D_Study;
+
+static void ps_2d_study_run(OosVars *gv, int point, void *data)
 {
-    RngParameters tmp;
+    PS_2D_Study *study = (PS_2D_Study *)data;
+    PS_2D_Cell *cell = &(study->ps_2d->cell[study->cell[point]]);
+    RngParameters parameters = study->parameters;
     RngData *task_data;
+    RngGroupData z_scores;
+    double n;
+
+    ps_2d_parameters_set(&parameters, study->variable_1, (cell->i0 + cell->i1) / (2.0 * PS_RESOLUTION));
+    ps_2d_parameters_set(&parameters, study->variable_2, (cell->j0 + cell->j1) / (2.0 * PS_RESOLUTION));
+    rng_model_reset(gv, &parameters);
+    rng_run(gv);
+    task_data = (RngData *)gv->task_data;
+    rng_analyse_group_data(task_data);
+    rng_scores_convert_to_z(&(task_data->group), &subject_ctl, &z_scores);
+
+    cell->value[0] = z_scores.mean.r1;
+//    cell->value[1] = z_scores.mean.r2;
+    cell->value[1] = z_scores.mean.rng;
+    cell->value[2] = z_scores.mean.rr;
+    cell->value[3] = z_scores.mean.aa;
+    cell->value[4] = z_scores.mean.oa;
+    cell->value[5] = z_scores.mean.tpi;
+//    cell->value[7] = z_scores.mean.rg1;
+
+    n = sqrt((double) MAX(task_data->group.n, 1));
+    cell->se[0] = z_scores.sd.r1 / n;
+    cell->se[1] = z_scores.sd.rng / n;
+    cell->se[2] = z_scores.sd.rr / n;
+    cell->se[3] = z_scores.sd.aa / n;
+    cell->se[4] = z_scores.sd.oa / n;
+    cell->se[5] = z_scores.sd.tpi / n;
+}
+
+static void ps_2d_cell_paint(PS_2D_Data *ps_2d, PS_2D_Cell *cell)
+{
+    int i, j, k;
+
+    for (i = cell->i0; i < cell->i1; i++) {
+        for (j = cell->j0; j < cell->j1; j++) {
+            for (k = 0; k < DATASETS; k++) {
+                ps_2d->pixels[k][i][j] = cell->value[k];
+            }
+        }
+    }
+}
+
+static double ps_2d_cell_change(PS_2D_Data *ps_2d, PS_2D_Cell *cell)
+{
+    // The largest difference, over all DVs, between the cell and the pixels
+    // beside the middle of each of its edges, relative to the least that
+    // merits a split: PS_2D_REFINE of the colour range, or PS_2D_Z standard
+    // errors of the difference (taking the neighbour's to be the same as the
+    // cell's) if that is more. The cell should be split if the result is > 1.
+
+    int im = (cell->i0 + cell->i1) / 2, jm = (cell->j0 + cell->j1) / 2;
+    double change = 0.0, d, least;
+    int k;
+
+    for (k = 0; k < DATASETS; k++) {
+        d = 0.0;
+        if (cell->i0 > 0) {
+            d = MAX(d, fabs(cell->value[k] - ps_2d->pixels[k][cell->i0 - 1][jm]));
+        }
+        if (cell->i1 < PS_RESOLUTION) {
+            d = MAX(d, fabs(cell->value[k] - ps_2d->pixels[k][cell->i1][jm]));
+        }
+        if (cell->j0 > 0) {
+            d = MAX(d, fabs(cell->value[k] - ps_2d->pixels[k][im][cell->j0 - 1]));
+        }
+        if (cell->j1 < PS_RESOLUTION) {
+            d = MAX(d, fabs(cell->value[k] - ps_2d->pixels[k][im][cell->j1]));
+        }
+        least = MAX(PS_2D_REFINE * 2.0 * ps_2d->scale, PS_2D_Z * M_SQRT2 * cell->se[k]);
+        change = MAX(change, d / least);
+    }
+    return(change);
+}
+
+typedef struct ps_2d_candidate {
+    int cell;
+    double change;
+} PS_2D_Candidate;
+
+static int ps_2d_candidate_compare(const void *a, const void *b)
+{
+    // Greatest change first
+
+    const PS_2D_Candidate *c1 = (const PS_2D_Candidate *) a;
+    const PS_2D_Candidate *c2 = (const PS_2D_Candidate *) b;
+
+    return((c1->change < c2->change) - (c1->change > c2->change));
+}
+
+static int ps_2d_refine(PS_2D_Study *study)
+{
+    // Split the cells that change fastest, fastest first, until the budget is
+    // spent. The new cells are listed in study->cell for the next round, and
+    // their number is returned. The pixels must be up to date.
+
+    PS_2D_Data *ps_2d = study->ps_2d;
+    PS_2D_Candidate *candidate;
+    PS_2D_Cell parent, child;
+    int c, m = 0, n = 0, split_i, split_j, a, b;
+
+    if ((candidate = (PS_2D_Candidate *)malloc(ps_2d->cells * sizeof(PS_2D_Candidate))) == NULL) {
+        return(0);
+    }
+    for (c = 0; c < ps_2d->cells; c++) {
+        parent = ps_2d->cell[c];
+        if ((parent.i1 - parent.i0 > 1) || (parent.j1 - parent.j0 > 1)) {
+            candidate[m].cell = c;
+            if ((candidate[m].change = ps_2d_cell_change(ps_2d, &parent)) > 1.0) {
+                m++;
+            }
+        }
+    }
+    qsort(candidate, m, sizeof(PS_2D_Candidate), ps_2d_candidate_compare);
+
+    for (c = 0; c < m; c++) {
+        parent = ps_2d->cell[candidate[c].cell];
+        split_i = (parent.i1 - parent.i0 > 1) ? 2 : 1;
+        split_j = (parent.j1 - parent.j0 > 1) ? 2 : 1;
+        if (study->refined + n + split_i * split_j > PS_2D_BUDGET) {
+            break;
+        }
+        // The first child replaces the parent, the others are added to the mesh:
+        child = parent;
+        for (a = 0; a < split_i; a++) {
+            child.i0 = (a == 0) ? parent.i0 : (parent.i0 + parent.i1) / 2;
+            child.i1 = (a + 1 < split_i) ? (parent.i0 + parent.i1) / 2 : parent.i1;
+            for (b = 0; b < split_j; b++) {
+                child.j0 = (b == 0) ? parent.j0 : (parent.j0 + parent.j1) / 2;
+                child.j1 = (b + 1 < split_j) ? (parent.j0 + parent.j1) / 2 : parent.j1;
+                if ((a == 0) && (b == 0)) {
+                    ps_2d->cell[candidate[c].cell] = child;
+                    study->cell[n++] = candidate[c].cell;
+                }
+                else {
+                    ps_2d->cell[ps_2d->cells] = child;
+                    study->cell[n++] = ps_2d->cells++;
+                }
+            }
+        }
+    }
+    free(candidate);
+    study->refined += n;
+    return(n);
+}
+
+static void ps_2d_study_update(XStudy *study, void *data)
+{
+    // Cells are painted as they are done. Until then the pixels keep the
+    // value of the cell that was split.
+
+    PS_2D_Study *ps_2d_study = (PS_2D_Study *)data;
+    PS_2D_Data *ps_2d = ps_2d_study->ps_2d;
+    int p;
+
+    for (p = 0; p < ps_2d_study->n; p++) {
+        if (x_study_point_done(study, p)) {
+            ps_2d_cell_paint(ps_2d, &(ps_2d->cell[ps_2d_study->cell[p]]));
+        }
+    }
+    if (x_study_finished(study)) {
+        if (!ps_2d->adaptive || x_study_cancelled(study) || ((ps_2d_study->n = ps_2d_refine(ps_2d_study)) == 0)) {
+            ps_2d->study = NULL;
+        }
+        else {
+            ps_2d->study = x_study_start(ps_2d_study->n, ps_2d_study_run, ps_2d_study_update, ps_2d_study);
+        }
+        if (ps_2d->study == NULL) {
+            free(ps_2d_study);
+        }
+    }
+    ps_2d_canvas_draw(ps_2d);
+}
+
+static void x_task_ps_2d_run(GtkWidget *caller, PS_2D_Data *ps_2d)
+{
+    // The first round is the coarse grid, with cell centres at (i + 0.5) / PS_STEPS
+
+    int size = PS_RESOLUTION / PS_STEPS;
+    PS_2D_Study *study;
     int i, j;
 
-    rng_parameters_save(&(ps_2d->parameters), &tmp);
-    ps_2d_initialise_data(ps_2d);
+    if ((ps_2d->study != NULL) || ((study = (PS_2D_Study *)malloc(sizeof(PS_2D_Study))) == NULL)) {
+        return;
+    }
+    study->ps_2d = ps_2d;
+    study->parameters = ps_2d->parameters;
+    if (study->parameters.seed == 0) {
+        study->parameters.seed = PS_2D_SEED;
+    }
+    study->variable_1 = ps_2d->variable_1;
+    study->variable_2 = ps_2d->variable_2;
+    study->refined = 0;
+    study->n = 0;
 
+    ps_2d_initialise_data(ps_2d);
     for (i = 0; i < PS_STEPS; i++) {
-        ps_2d_parameters_set(&(ps_2d->parameters), ps_2d->variable_1, (i + 0.5) / (double) PS_STEPS);
         for (j = 0; j < PS_STEPS; j++) {
-            ps_2d_parameters_set(&(ps_2d->parameters), ps_2d->variable_2, (j + 0.5) / (double) PS_STEPS);
-            rng_create(ps_2d->gv, &(ps_2d->parameters));
-            rng_initialise_subject(ps_2d->gv);
-            rng_run(ps_2d->gv);
-            rng_analyse_group_data((RngData *)ps_2d->gv->task_data);
-
-            task_data = (RngData *)ps_2d->gv->task_data;
-
-            ps_2d->pixels[0][i][j] = (task_data->group.mean.r1 - subject_ctl.mean.r1) / subject_ctl.sd.r1;
-//            ps_2d->pixels[1][i][j] = (task_data->group.mean.r2 - subject_ctl.mean.r2) / subject_ctl.sd.r2;
-            ps_2d->pixels[1][i][j] = (task_data->group.mean.rng - subject_ctl.mean.rng) / subject_ctl.sd.rng;
-            ps_2d->pixels[2][i][j] = (task_data->group.mean.rr - subject_ctl.mean.rr) / subject_ctl.sd.rr;
-            ps_2d->pixels[3][i][j] = (task_data->group.mean.aa - subject_ctl.mean.aa) / subject_ctl.sd.aa;
-            ps_2d->pixels[4][i][j] = (task_data->group.mean.oa - subject_ctl.mean.oa) / subject_ctl.sd.oa;
-            ps_2d->pixels[5][i][j] = (task_data->group.mean.tpi - subject_ctl.mean.tpi) / subject_ctl.sd.tpi;
-//            ps_2d->pixels[7][i][j] = (task_data->group.mean.rg1 - subject_ctl.mean.rg1) / subject_ctl.sd.rg1;
-            ps_2d_canvas_draw(ps_2d);
+            ps_2d->cell[ps_2d->cells].i0 = i * size;
+            ps_2d->cell[ps_2d->cells].i1 = (i + 1) * size;
+            ps_2d->cell[ps_2d->cells].j0 = j * size;
+            ps_2d->cell[ps_2d->cells].j1 = (j + 1) * size;
+            study->cell[study->n++] = ps_2d->cells++;
         }
     }
-    rng_parameters_restore(&(ps_2d->parameters), &tmp);
+    ps_2d_canvas_draw(ps_2d);
+    if ((ps_2d->study = x_study_start(study->n, ps_2d_study_run, ps_2d_study_update, study)) == NULL) {
+        free(study);
+    }
+}
+
+static void x_toggle_ps_2d_adaptive(GtkWidget *caller, PS_2D_Data *ps_2d)
+{
+    ps_2d->adaptive = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(caller));
+}
+
+static void x_task_ps_2d_cancel(GtkWidget *caller, PS_2D_Data *ps_2d)
+{
+    x_study_cancel(ps_2d->study);
 }
 
 static int canvas_2d_event_expose(GtkWidget *da, GdkEventConfigure *event, PS_2D_Data *ps_2d)
@@ -2520,6 +2835,19 @@ static GtkWidget *notepage_parameter_studies_2d_create(XGlobals *globals)
     gtk_box_pack_end(GTK_BOX(hbox), GTK_WIDGET(tool_item), FALSE, FALSE, 5);
     gtk_widget_show(GTK_WIDGET(tool_item));
 
+    tool_item = gtk_tool_button_new_from_stock(GTK_STOCK_STOP); // Cancel study
+    g_signal_connect(G_OBJECT(tool_item), "clicked", G_CALLBACK(x_task_ps_2d_cancel), &ps_2d);
+    gtk_tooltips_set_tip(tooltips, GTK_WIDGET(tool_item), "Cancel the study", NULL);
+    gtk_box_pack_end(GTK_BOX(hbox), GTK_WIDGET(tool_item), FALSE, FALSE, 5);
+    gtk_widget_show(GTK_WIDGET(tool_item));
+
+    tmp = gtk_check_button_new_with_label("Adaptive");
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(tmp), ps_2d.adaptive);
+    g_signal_connect(G_OBJECT(tmp), "toggled", G_CALLBACK(x_toggle_ps_2d_adaptive), &ps_2d);
+    gtk_tooltips_set_tip(tooltips, tmp, "Refine the grid where the DVs change fastest", NULL);
+    gtk_box_pack_end(GTK_BOX(hbox), tmp, FALSE, FALSE, 5);
+    gtk_widget_show(tmp);
+
     /* Defaults: */
 
     hbox = gtk_hbox_new(FALSE, 5);
@@ -2673,6 +3001,7 @@ static int qjep_count = 0;
 static int qjep_subjects = 36;
 static GtkWidget *qjep_canvas = NULL;
 static RngData qjep_data[4];
+static XStudy *qjep_study = NULL;
 static RngGroupData human_z[4];
 static int qjep_view = 0; // Initially show observed data
 
@@ -2857,41 +3186,91 @@ static void qjep_draw_canvas(XGlobals *globals)
 
 static void qjep_initialise(GtkWidget *caller, XGlobals *globals)
 {
+    if (qjep_study != NULL) {
+        return;
+    }
     qjep_count = 0;
     qjep_draw_canvas(globals);
 }
 
-static void qjep_run_block(GtkWidget *caller, XGlobals *globals)
+/*----------------------------------------------------------------------------*/
+/* Running the remaining subjects as a study: point p is subject first + p/3  */
+/* in condition 1 + p%3. (qjep_data[0] was for simulated control data - real  */
+/* control data is used instead.)                                             */
+
+typedef struct qjep_study_data {
+    XGlobals *globals;
+    int first;
+    RngParameters params[4];
+} QjepStudyData;
+
+static void qjep_study_run(OosVars *gv, int point, void *data)
 {
-    int i, tmp;
+    QjepStudyData *qjep = (QjepStudyData *)data;
+    int s = qjep->first + point / 3;
+    int c = 1 + point % 3;
 
-    tmp = globals->gv->subjects_per_experiment;
-    globals->gv->subjects_per_experiment = 1;
+    rng_model_reset(gv, &(qjep->params[c]));
+    gv->subjects_per_experiment = 1;
+    rng_run(gv);
+    // Subjects responses will already be scored, so we just need to record them:
+    rng_save_dvs(&(((RngData *)gv->task_data)->subject[0]), &qjep_data[c].subject[s]);
+}
 
-    globals->running = TRUE;
-    qjep_draw_canvas(globals);
-    gtk_main_iteration_do(FALSE);
+static void qjep_study_update(XStudy *study, void *data)
+{
+    // Subjects are added to the groups in order, once all three conditions
+    // have been run for them
 
-    while (qjep_count < qjep_subjects) {
-        // Note qjep_data[0] was for simulated control data - use real control
-        // data instead
+    QjepStudyData *qjep = (QjepStudyData *)data;
+    XGlobals *globals = qjep->globals;
+    int p, i, count = qjep_count;
+
+    for (p = (count - qjep->first) * 3; x_study_point_done(study, p) && x_study_point_done(study, p + 1) && x_study_point_done(study, p + 2); p += 3) {
+        count++;
+    }
+    if (count > qjep_count) {
+        qjep_count = count;
         for (i = 1; i < 4; i++) {
-            rng_create(globals->gv, &(qjep_data[i].params));
-            rng_initialise_subject(globals->gv);
-            rng_run(globals->gv);
-            // Subjects responses will already be scored, so we just need to record them:
-            rng_save_dvs(&(((RngData *)globals->gv->task_data)->subject[0]), &qjep_data[i].subject[qjep_count]);
-            // Now (re-)calculate the group statistics
-            qjep_data[i].group.n = (qjep_count + 1);
+            // (Re-)calculate the group statistics
+            qjep_data[i].group.n = qjep_count;
             rng_analyse_group_data(&qjep_data[i]);
-	}
-        qjep_count++;
-        qjep_draw_canvas(globals);
+        }
+    }
+    if (x_study_finished(study)) {
+        globals->running = FALSE;
+        qjep_study = NULL;
+        free(qjep);
     }
-    globals->running = FALSE;
     qjep_draw_canvas(globals);
+}
+
+static void qjep_run_block(GtkWidget *caller, XGlobals *globals)
+{
+    QjepStudyData *qjep;
+    int i;
 
-    globals->gv->subjects_per_experiment = tmp;
+    if ((qjep_study != NULL) || (qjep_count >= qjep_subjects) || ((qjep = (QjepStudyData *)malloc(sizeof(QjepStudyData))) == NULL)) {
+        return;
+    }
+    qjep->globals = globals;
+    qjep->first = qjep_count;
+    for (i = 1; i < 4; i++) {
+        qjep->params[i] = qjep_data[i].params;
+    }
+
+    globals->running = TRUE;
+    qjep_draw_canvas(globals);
+    if ((qjep_study = x_study_start((qjep_subjects - qjep_count) * 3, qjep_study_run, qjep_study_update, qjep)) == NULL) {
+        globals->running = FALSE;
+        free(qjep);
+        qjep_draw_canvas(globals);
+    }
+}
+
+static void qjep_cancel(GtkWidget *caller, XGlobals *globals)
+{
+    x_study_cancel(qjep_study);
 }
 
 static int analysis_qjep_event_expose(GtkWidget *da, GdkEventConfigure *event, XGlobals *globals)
@@ -2964,6 +3343,12 @@ static GtkWidget *notepage_qjep_simulation_create(XGlobals *globals)
     gtk_box_pack_end(GTK_BOX(hbox), GTK_WIDGET(tool_item), FALSE, FALSE, 5);
     gtk_widget_show(GTK_WIDGET(tool_item));
 
+    tool_item = gtk_tool_button_new_from_stock(GTK_STOCK_STOP); // Cancel
+    g_signal_connect(G_OBJECT(tool_item), "clicked", G_CALLBACK(qjep_cancel), globals);
+    gtk_tooltips_set_tip(tooltips, GTK_WIDGET(tool_item), "Cancel the run", NULL);
+    gtk_box_pack_end(GTK_BOX(hbox), GTK_WIDGET(tool_item), FALSE, FALSE, 5);
+    gtk_widget_show(GTK_WIDGET(tool_item));
+
     // Padding:
     tmp = gtk_label_new("");
     gtk_box_pack_end(GTK_BOX(hbox), tmp, FALSE, FALSE, 20);
@@ -3210,6 +3595,40 @@ static void x_redraw_canvases(GtkWidget *caller, XGlobals *globals)
     }
 }
 
+/*----------------------------------------------------------------------------*/
+/* While a model runs the canvas is redrawn (and events are handled) at most  */
+/* FRAME_RATE times a second rather than after every cycle, so the model runs */
+/* at close to full speed and the canvas shows its latest state.              */
+
+Boolean x_frame_due()
+{
+    // TRUE if 1/FRAME_RATE seconds have passed since it last returned TRUE
+
+    static GTimer *timer = NULL;
+
+    if (timer == NULL) {
+        timer = g_timer_new();
+        return(TRUE);
+    }
+    else if (g_timer_elapsed(timer, NULL) < 1.0 / FRAME_RATE) {
+        return(FALSE);
+    }
+    else {
+        g_timer_start(timer);
+        return(TRUE);
+    }
+}
+
+void x_frame_draw(XGlobals *globals)
+{
+    x_redraw_canvases(NULL, globals);
+    while (gtk_events_pending()) {
+        gtk_main_iteration_do(FALSE);
+    }
+}
+
+/*----------------------------------------------------------------------------*/
+
 static void x_print_canvas(GtkWidget *caller, XGlobals *globals)
 {
     cairo_surface_t *surface;
@@ -20,7 +20,7 @@
 int main(int argc, char **argv)
 {
     OosVars *gv;
-    XGlobals xg = {NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, TRUE, TRUE, FALSE, CANVAS_GLOBAL, CANVAS_VARY_DECAY, {}, -1, {}, {}};
+    XGlobals xg = {NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, TRUE, TRUE, FALSE, CANVAS_GLOBAL, CANVAS_VARY_DECAY, {}, -1, {}, {}, HISTORY_WINDOW, NULL, NULL};
 
     gtk_set_locale();
     gtk_init(&argc, &argv);
@@ -33,6 +33,7 @@ int main(int argc, char **argv)
     xg.params.monitoring_efficiency = pars.monitoring_efficiency;
     xg.params.individual_variability = pars.individual_variability;
     xg.params.sample_size = pars.sample_size;
+    xg.params.seed = pars.seed;
     if ((gv = oos_globals_create()) == NULL) {
         fprintf(stdout, "ABORTING: Cannot allocate global variable space\n");
     }
@@ -48,6 +49,7 @@ int main(int argc, char **argv)
         gtk_main();
     }
 
+    oos_history_free(xg.history);
     rng_globals_destroy((RngData *)gv->task_data);
     oos_globals_destroy(gv);
 
@@ -11,6 +11,12 @@
 
 #define MAX_GROUPS 21
 
+/* Cycles of the current block that the browser can step back through: */
+#define HISTORY_WINDOW 1000
+
+/* Most redraws per second of the visible canvas while a model is running: */
+#define FRAME_RATE 25
+
 typedef enum canvas1_view {
     CANVAS_TABLE, CANVAS_GLOBAL, CANVAS_SECOND_ORDER, CANVAS_STAR
 } Canvas1View;
@@ -19,6 +25,10 @@ typedef enum canvas2_view {
     CANVAS_VARY_DECAY, CANVAS_VARY_TEMPERATURE, CANVAS_VARY_SWITCH, CANVAS_VARY_MONITORING, CANVAS_VARY_UPDATE
 } Canvas2View;
 
+typedef struct x_study XStudy;
+typedef void (*XStudyRunFunction)(OosVars *gv, int point, void *data);
+typedef void (*XStudyUpdateFunction)(XStudy *study, void *data);
+
 typedef struct x_globals {
     OosVars *gv;
     GtkWidget *window;
@@ -26,6 +36,7 @@ typedef struct x_globals {
     GtkWidget *diagram;
     GtkWidget *browser;
     GtkWidget *browser_label;
+    GtkWidget *browser_scale;
     GtkWidget *seq_canvas;
     GtkWidget *output_panel1;
     GtkWidget *output_panel2;
@@ -38,6 +49,9 @@ typedef struct x_globals {
     int group_index;
     RngScores group_mean[MAX_GROUPS];
     RngScores group_sd[MAX_GROUPS];
+    int history_window;
+    OosHistory *history;
+    XStudy *study;              /* The 1-D parameter studies, while they run */
 } XGlobals;
 
 extern void diagram_draw_x(XGlobals *globals);
@@ -48,5 +62,14 @@ extern void browser_draw_x(XGlobals *globals);
 extern void browser_draw_cairo(cairo_t *cr, OosVars *gv, int width, int height);
 extern GtkWidget *browser_create_notepage(XGlobals *globals);
 extern Boolean rng_widgets_create(XGlobals *globals, OosVars *gv);
+extern Boolean x_frame_due();
+extern void x_frame_draw(XGlobals *globals);
+
+extern XStudy *x_study_start(int points, XStudyRunFunction run, XStudyUpdateFunction update, void *data);
+extern void x_study_cancel(XStudy *study);
+extern Boolean x_study_point_done(XStudy *study, int point);
+extern int x_study_points_done(XStudy *study);
+extern Boolean x_study_finished(XStudy *study);
+extern Boolean x_study_cancelled(XStudy *study);
 
 #endif
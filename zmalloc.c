@@ -0,0 +1,245 @@
+/* Allocation tracking, for leak detection (see zmalloc.h) */
+
+#define _zmalloc_c_
+
+#include <pthread.h>
+#include <glib.h>
+#include "zmalloc.h"
+
+typedef struct zmalloc_site {
+    const char *file;
+    int         line;
+    long        live_objects;
+    long        live_bytes;
+    long        allocations;        /* Total made at the site                 */
+    long        checked_objects;    /* Most live_objects seen by zmalloc_check */
+} ZmallocSite;
+
+typedef struct zmalloc_block {
+    ZmallocSite *site;
+    size_t       size;
+} ZmallocBlock;
+
+static pthread_mutex_t zmalloc_lock = PTHREAD_MUTEX_INITIALIZER;
+static GHashTable *sites = NULL;        /* ZmallocSite by (file, line) */
+static GHashTable *blocks = NULL;       /* ZmallocBlock by address     */
+static long live_objects = 0;
+static long live_bytes = 0;
+
+/******************************************************************************/
+
+static guint zmalloc_site_hash(gconstpointer key)
+{
+    const ZmallocSite *site = (const ZmallocSite *) key;
+
+    return(g_direct_hash(site->file) ^ ((guint) site->line * 2654435761u));
+}
+
+static gboolean zmalloc_site_equal(gconstpointer a, gconstpointer b)
+{
+    const ZmallocSite *s1 = (const ZmallocSite *) a;
+    const ZmallocSite *s2 = (const ZmallocSite *) b;
+
+    return((s1->file == s2->file) && (s1->line == s2->line));
+}
+
+static ZmallocSite *zmalloc_site_locate(const char *file, int line)
+{
+    ZmallocSite key, *site;
+
+    if (sites == NULL) {
+        sites = g_hash_table_new(zmalloc_site_hash, zmalloc_site_equal);
+        blocks = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+    }
+    key.file = file;
+    key.line = line;
+    if ((site = (ZmallocSite *) g_hash_table_lookup(sites, &key)) == NULL) {
+        site = g_new0(ZmallocSite, 1);
+        site->file = file;
+        site->line = line;
+        g_hash_table_insert(sites, site, site);
+    }
+    return(site);
+}
+
+static void zmalloc_forget(void *ptr)
+{
+    // Remove ptr from the live set (if it's there). The lock must be held.
+
+    ZmallocBlock *block;
+
+    if ((blocks != NULL) && ((block = (ZmallocBlock *) g_hash_table_lookup(blocks, ptr)) != NULL)) {
+        block->site->live_objects--;
+        block->site->live_bytes -= block->size;
+        live_objects--;
+        live_bytes -= block->size;
+        g_hash_table_remove(blocks, ptr);
+    }
+}
+
+static void zmalloc_record(void *ptr, size_t size, const char *file, int line)
+{
+    // Add ptr to the live set. If it is already there, it was freed without
+    // our knowledge (e.g. with g_free()) and the address has been reused.
+
+    ZmallocBlock *block;
+
+    if (ptr == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&zmalloc_lock);
+    zmalloc_forget(ptr);
+    block = g_new(ZmallocBlock, 1);
+    block->site = zmalloc_site_locate(file, line);
+    block->size = size;
+    block->site->live_objects++;
+    block->site->live_bytes += size;
+    block->site->allocations++;
+    live_objects++;
+    live_bytes += size;
+    g_hash_table_insert(blocks, ptr, block);
+    pthread_mutex_unlock(&zmalloc_lock);
+}
+
+/******************************************************************************/
+
+void *zmalloc(size_t size, const char *file, int line)
+{
+    void *ptr = malloc(size);
+
+    zmalloc_record(ptr, size, file, line);
+    return(ptr);
+}
+
+void *zcalloc(size_t n, size_t size, const char *file, int line)
+{
+    void *ptr = calloc(n, size);
+
+    zmalloc_record(ptr, n * size, file, line);
+    return(ptr);
+}
+
+void *zrealloc(void *ptr, size_t size, const char *file, int line)
+{
+    // ptr is forgotten first, as it may not be used after realloc(). If the
+    // reallocation fails ptr is still valid, but is no longer tracked.
+
+    void *new;
+
+    if (ptr != NULL) {
+        pthread_mutex_lock(&zmalloc_lock);
+        zmalloc_forget(ptr);
+        pthread_mutex_unlock(&zmalloc_lock);
+    }
+    new = realloc(ptr, size);
+    zmalloc_record(new, size, file, line);
+    return(new);
+}
+
+void zfree(void *ptr)
+{
+    if (ptr != NULL) {
+        pthread_mutex_lock(&zmalloc_lock);
+        zmalloc_forget(ptr);
+        pthread_mutex_unlock(&zmalloc_lock);
+        free(ptr);
+    }
+}
+
+long zmalloc_live_objects()
+{
+    return(live_objects);
+}
+
+long zmalloc_live_bytes()
+{
+    return(live_bytes);
+}
+
+/******************************************************************************/
+
+static int zmalloc_site_compare(const void *a, const void *b)
+{
+    // Most live bytes first
+
+    const ZmallocSite *s1 = *(ZmallocSite * const *) a;
+    const ZmallocSite *s2 = *(ZmallocSite * const *) b;
+
+    return((s1->live_bytes < s2->live_bytes) - (s1->live_bytes > s2->live_bytes));
+}
+
+static void zmalloc_site_collect(gpointer key, gpointer value, gpointer data)
+{
+    ZmallocSite ***next = (ZmallocSite ***) data;
+
+    *((*next)++) = (ZmallocSite *) value;
+}
+
+static ZmallocSite **zmalloc_sites_sorted(int *n)
+{
+    // The sites, sorted by live bytes, in an array to be freed by the caller.
+    // The lock must be held.
+
+    ZmallocSite **array, **next;
+
+    *n = (sites == NULL) ? 0 : g_hash_table_size(sites);
+    if ((array = (ZmallocSite **) malloc((*n + 1) * sizeof(ZmallocSite *))) == NULL) {
+        *n = 0;
+    }
+    else if (*n > 0) {
+        next = array;
+        g_hash_table_foreach(sites, zmalloc_site_collect, &next);
+        qsort(array, *n, sizeof(ZmallocSite *), zmalloc_site_compare);
+    }
+    return(array);
+}
+
+void zmalloc_report(FILE *fp, const char *label)
+{
+    // List every site with live objects
+
+    ZmallocSite **array;
+    int i, n;
+
+    pthread_mutex_lock(&zmalloc_lock);
+    array = zmalloc_sites_sorted(&n);
+    fprintf(fp, "MALLOC_CHECK: %s: %ld live objects, %ld bytes\n", label, live_objects, live_bytes);
+    for (i = 0; i < n; i++) {
+        ZmallocSite *site = array[i];
+        if (site->live_objects != 0) {
+            fprintf(fp, "  %s:%d: %ld live objects, %ld bytes (%ld allocated)\n", site->file, site->line, site->live_objects, site->live_bytes, site->allocations);
+        }
+    }
+    free(array);
+    pthread_mutex_unlock(&zmalloc_lock);
+}
+
+void zmalloc_check(FILE *fp, const char *label)
+{
+    // List only the sites with more live objects than at any previous check
+    // (nothing is printed if there are none). Counts that rise and fall
+    // between checks, e.g. with messages still pending at the end of a block,
+    // are reported once, but a steady leak is reported at every check.
+
+    ZmallocSite **array;
+    gboolean changed = FALSE;
+    int i, n;
+
+    pthread_mutex_lock(&zmalloc_lock);
+    array = zmalloc_sites_sorted(&n);
+    for (i = 0; i < n; i++) {
+        ZmallocSite *site = array[i];
+        if (site->live_objects > site->checked_objects) {
+            if (!changed) {
+                fprintf(fp, "MALLOC_CHECK: %s: %ld live objects, %ld bytes\n", label, live_objects, live_bytes);
+                changed = TRUE;
+            }
+            fprintf(fp, "  %s:%d: %ld live objects (%+ld), %ld bytes\n", site->file, site->line, site->live_objects, site->live_objects - site->checked_objects, site->live_bytes);
+            site->checked_objects = site->live_objects;
+        }
+    }
+    free(array);
+    pthread_mutex_unlock(&zmalloc_lock);
+}
+
+/******************************************************************************/
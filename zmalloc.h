@@ -0,0 +1,44 @@
+#ifndef _zmalloc_h_
+
+#define _zmalloc_h_
+
+/******************************************************************************/
+/* Allocation tracking:
+
+Compile everything with -DMALLOC_CHECK and every malloc(), calloc(), realloc()
+and free() in a file that includes this header (all files that include pl.h,
+and the lib_* files) is routed through the functions below, which record the
+site (file and line) of each live allocation. Pointers are not altered, so
+memory can still be passed to and from glib, but memory allocated here and
+released with g_free() (or vice versa) is not seen to be freed.
+
+zmalloc_report/2 lists the live objects and bytes for each allocation site.
+zmalloc_check/2 is quieter: it reports only the sites with more live objects
+than it has seen before, so when called at points where the live set should
+be the same (e.g. at the end of each block, which oos_step_block/1 does)
+output after the first few calls is a leak. Totals are for the whole process,
+so the block-by-block check is only meaningful in a single-threaded run.
+
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern void *zmalloc(size_t size, const char *file, int line);
+extern void *zcalloc(size_t n, size_t size, const char *file, int line);
+extern void *zrealloc(void *ptr, size_t size, const char *file, int line);
+extern void  zfree(void *ptr);
+extern long  zmalloc_live_objects();
+extern long  zmalloc_live_bytes();
+extern void  zmalloc_report(FILE *fp, const char *label);
+extern void  zmalloc_check(FILE *fp, const char *label);
+
+#ifndef _zmalloc_c_
+#define malloc(N)       zmalloc((N), __FILE__, __LINE__)
+#define calloc(N, S)    zcalloc((N), (S), __FILE__, __LINE__)
+#define realloc(P, N)   zrealloc((P), (N), __FILE__, __LINE__)
+#define free(P)         zfree(P)
+#endif
+
+#endif